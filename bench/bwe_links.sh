@@ -0,0 +1,30 @@
+#!/bin/sh
+# Time-to-stable-bitrate under emulated link capacities.
+# For each rate, shapes egress on IFACE with netem (root needed), starts the
+# sender with --test-source and waits for one viewer to connect (open or
+# reload index.html). Prints the sender's probe result and the time until its
+# bandwidth estimate held within 10% for a second.
+#
+#   IFACE=eth0 bench/bwe_links.sh [rates...] [-- extra gpt options...]
+#   IFACE=eth0 bench/bwe_links.sh 500kbit 1mbit 3mbit 20mbit -- --max-bitrate=8000
+iface=${IFACE:-eth0}
+bin=${GPT:-./gpt}
+rates=
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do rates="$rates $1"; shift; done
+[ "$1" = "--" ] && shift
+rates=${rates:-500kbit 1mbit 3mbit 20mbit}
+log=$(mktemp)
+trap 'tc qdisc del dev "$iface" root 2>/dev/null; rm -f "$log"' EXIT INT TERM
+
+for rate in $rates; do
+    tc qdisc replace dev "$iface" root netem rate "$rate" delay 20ms limit 1000 || exit 1
+    "$bin" --test-source --pool-size=0 "$@" >"$log" 2>&1 &
+    pid=$!
+    echo "$rate: waiting for a viewer..." >&2
+    t=0
+    while [ "$t" -lt 120 ] && ! grep -q 'Bandwidth stable' "$log"; do sleep 1; t=$((t + 1)); done
+    kill "$pid" 2>/dev/null; wait "$pid" 2>/dev/null
+    probe=$(grep -o 'Bandwidth probe: .*' "$log" | head -1)
+    stable=$(grep -o 'Bandwidth stable .*' "$log" | head -1)
+    echo "$rate: ${probe:-no probe}; ${stable:-not stable within 120 s}"
+done
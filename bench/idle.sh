@@ -0,0 +1,42 @@
+#!/bin/sh
+# Idle suspend check. Runs the sender with nobody watching, once with
+# --idle-suspend=0 (capture always on) and once with suspend, and reports:
+#   - idle CPU over S seconds, read from /proc
+#   - the first viewer's resume, as the sender logs it
+#     (request-offer to first encoded frame and first RTP packet)
+#   - that viewer's join time, from bench/loadgen
+#
+#   node signalingserver.js &
+#   bench/idle.sh [seconds] [extra gpt options...]
+secs=${1:-20}
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+loadgen=${LOADGEN:-./loadgen}
+server=${SERVER:-ws://127.0.0.1:8080}
+suspend_ms=${SUSPEND_MS:-3000}
+hz=$(getconf CLK_TCK)
+
+cpu_ticks() {
+    # utime + stime; the command name may hold spaces, so count from the ')'
+    sed 's/.*) //' "/proc/$1/stat" | awk '{ print $12 + $13 }'
+}
+
+for mode in 0 "$suspend_ms"; do
+    room=idle-$$-$mode
+    log=idle-$mode.log
+    "$bin" --server="$server" --room="$room" --idle-suspend="$mode" "$@" >"$log" 2>&1 &
+    pid=$!
+    # Startup, first frames and the suspend delay
+    sleep $((suspend_ms / 1000 + 5))
+    kill -0 "$pid" 2>/dev/null || { echo "sender did not start, see $log"; exit 1; }
+    t0=$(cpu_ticks "$pid")
+    sleep "$secs"
+    t1=$(cpu_ticks "$pid")
+    echo "idle-suspend=$mode: idle cpu $(( (t1 - t0) * 100 / hz / secs ))% over ${secs} s"
+
+    "$loadgen" --server="$server" --room="$room" --viewers=1 --hold=3 2>&1 | grep '^join ms' |
+        sed "s/^/idle-suspend=$mode: /"
+    grep -E '^(resume:|Idle:)' "$log" | sed "s/^/idle-suspend=$mode: /"
+    kill -INT "$pid"
+    wait "$pid"
+done
@@ -0,0 +1,81 @@
+// Join-storm benchmark for the sender's negotiation path.
+// Opens N viewer WebSockets at once; each sends request-offer and records how
+// long the sender takes to reply with its offer and its first ICE candidate.
+//
+//   ./gpt --max-viewers=50 &
+//   node bench/join_storm.js [ws://host:8080] [viewers]
+//
+// Viewers never answer, so this measures offer creation and candidate
+// gathering under contention, not media setup.
+//
+// With GPT_PID set, the sender's CPU time (user+sys from /proc) spent during
+// the storm is reported per join. Compare a fresh `./gpt` against
+// `./gpt --no-dtls-prewarm` to see what the DTLS certificate costs a join.
+// Compare --pool-size=0 against the default to see what the warm pool saves;
+// the sender prints its own join-to-offer histogram on SIGUSR1 and at exit.
+const fs = require('fs');
+const WebSocket = require('ws');
+
+const url = process.argv[2] || 'ws://127.0.0.1:8080';
+const viewers = parseInt(process.argv[3] || '50', 10);
+const timeoutMs = 20000;
+const gptPid = process.env.GPT_PID;
+
+// utime + stime of the sender in ms
+function cpuMs(pid) {
+  const stat = fs.readFileSync(`/proc/${pid}/stat`, 'utf8');
+  const fields = stat.slice(stat.lastIndexOf(')') + 2).split(' ');
+  return (Number(fields[11]) + Number(fields[12])) * 10;   // USER_HZ = 100
+}
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) return NaN;
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+function runViewer() {
+  return new Promise((resolve) => {
+    const ws = new WebSocket(url);
+    const result = { offer: null, candidate: null };
+    let start = 0;
+    const done = () => { ws.close(); resolve(result); };
+    const timer = setTimeout(done, timeoutMs);
+
+    ws.on('message', (raw) => {
+      const msg = JSON.parse(raw);
+      if (msg.type === 'registered') {
+        start = process.hrtime.bigint();
+        ws.send(JSON.stringify({ type: 'request-offer' }));
+      } else if (msg.type === 'offer' && result.offer === null) {
+        result.offer = Number(process.hrtime.bigint() - start) / 1e6;
+      } else if (msg.type === 'ice-candidate' && result.candidate === null) {
+        result.candidate = Number(process.hrtime.bigint() - start) / 1e6;
+      }
+      if (result.offer !== null && result.candidate !== null) {
+        clearTimeout(timer);
+        done();
+      }
+    });
+    ws.on('error', () => { clearTimeout(timer); done(); });
+  });
+}
+
+function report(name, values) {
+  const ok = values.filter((v) => v !== null).sort((a, b) => a - b);
+  console.log(`${name.padEnd(16)} n=${ok.length}/${values.length}` +
+    `  p50=${percentile(ok, 0.5).toFixed(1)} ms` +
+    `  p95=${percentile(ok, 0.95).toFixed(1)} ms` +
+    `  max=${(ok[ok.length - 1] || NaN).toFixed(1)} ms`);
+}
+
+(async () => {
+  console.log(`Join storm: ${viewers} viewers against ${url}`);
+  const cpuStart = gptPid ? cpuMs(gptPid) : 0;
+  const results = await Promise.all(Array.from({ length: viewers }, runViewer));
+  report('offer', results.map((r) => r.offer));
+  report('first candidate', results.map((r) => r.candidate));
+  if (gptPid) {
+    const used = cpuMs(gptPid) - cpuStart;
+    console.log(`sender cpu       ${used} ms total, ${(used / viewers).toFixed(1)} ms per join`);
+  }
+})();
@@ -0,0 +1,604 @@
+// Headless load generator: N receiving webrtcbin viewers against one gpt sender.
+// Speaks the same signaling JSON as index.html (join, request-offer, answer,
+// ice-candidate) and ramps viewers up at --rate joins per second, printing one
+// line per second so the viewer count where frames start dropping is visible.
+//
+//   node signalingserver.js &
+//   ./gpt --test-source --server=ws://127.0.0.1:8080 --max-viewers=64 &
+//   g++ -O2 -o loadgen bench/loadgen.cpp $(pkg-config --cflags --libs gstreamer-1.0
+//       gstreamer-webrtc-1.0 gstreamer-sdp-1.0 gstreamer-rtp-1.0 libsoup-2.4 json-glib-1.0)
+//   ./loadgen --viewers=50 --rate=2 --sender-pid=$(pidof gpt)
+//
+// Per viewer: join time (request-offer to first video frame), received fps,
+// queueing delay (RTP arrival against RTP timestamp, above that viewer's own
+// minimum, so it needs no shared clock) and failures. Frames are counted from
+// RTP marker bits unless --decode runs each stream through decodebin.
+#define GST_USE_UNSTABLE_API
+
+#include <gst/gst.h>
+#include <gst/webrtc/webrtc.h>
+#include <gst/sdp/sdp.h>
+#include <gst/rtp/rtp.h>
+#include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <glib-unix.h>
+#include <signal.h>
+
+// ===================== Config =====================
+struct Config {
+    gchar *server;
+    gchar *room;
+    gint viewers;
+    gdouble rate;                   // joins per second
+    gint hold_s;                    // run time after the last join
+    gint join_timeout_ms;           // request-offer to first frame, else failed
+    gboolean decode;
+    gint sender_pid;                // 0 = don't sample the sender
+};
+
+struct Viewer {
+    gint index;
+    SoupWebsocketConnection *ws;
+    gchar *id;                      // our signaling id
+    gchar *sender;                  // whoever sent the first offer
+    GstElement *webrtc;
+    gint64 t_request;               // request-offer sent
+    gchar *failure;                 // static reason, first one wins (atomic); NULL while healthy
+
+    // Streaming threads write, the main loop reads; under lock
+    GMutex lock;
+    gint64 t_first_frame;
+    gint frames;
+    guint32 last_rtp_ts;
+    gint64 rtp_ts_ext;              // unwrapped RTP timestamp
+    gint64 min_delay_us;
+    GArray *delay_ms;               // gdouble, queueing delay per frame
+
+    // Main loop only
+    gint last_frames;
+    gint min_fps;
+    gint fps_sum;
+    gint fps_samples;
+};
+
+// ===================== Globals =====================
+static struct Config config;
+static GMainLoop *loop = NULL;
+static SoupSession *soup_session = NULL;
+static GstElement *pipeline = NULL;
+static Viewer *viewers = NULL;
+static gint started = 0;
+static gint64 t_begin = 0;
+static gint64 t_last_join = 0;
+static gboolean stopping = FALSE;
+
+// Sender samples, main loop only
+static gint64 sender_last_ticks = -1;
+static gint64 sender_last_sample = 0;
+static GArray *sender_cpu = NULL;   // gdouble, percent of one core per second
+static gdouble sender_rss_peak_mb = 0;
+
+// ===================== Utils =====================
+static void fail_viewer(Viewer *v, const gchar *reason) {
+    if (g_atomic_pointer_compare_and_exchange(&v->failure, NULL, (gchar *)reason))
+        g_print("viewer %d failed: %s\n", v->index, reason);
+}
+
+struct Outgoing {
+    Viewer *v;
+    gchar *text;
+};
+
+// Main loop: the only place that touches a viewer's WebSocket.
+static gboolean send_outgoing(gpointer data) {
+    Outgoing *o = (Outgoing *)data;
+    if (o->v->ws && soup_websocket_connection_get_state(o->v->ws) == SOUP_WEBSOCKET_STATE_OPEN)
+        soup_websocket_connection_send_text(o->v->ws, o->text);
+    g_free(o->text);
+    g_free(o);
+    return G_SOURCE_REMOVE;
+}
+
+// Thread-safe; messages from one thread keep their order.
+static void send_json(Viewer *v, JsonObject *msg) {
+    JsonNode *root = json_node_new(JSON_NODE_OBJECT);
+    json_node_set_object(root, msg);
+    Outgoing *o = g_new0(Outgoing, 1);
+    o->v = v;
+    o->text = json_to_string(root, FALSE);
+    json_node_free(root);
+    g_main_context_invoke(NULL, send_outgoing, o);
+}
+
+static gint compare_doubles(gconstpointer a, gconstpointer b) {
+    gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+    return x < y ? -1 : x > y;
+}
+
+static gdouble percentile(GArray *values, gdouble p) {
+    if (values->len == 0) return NAN;
+    g_array_sort(values, compare_doubles);
+    guint i = MIN(values->len - 1, (guint)(values->len * p));
+    return g_array_index(values, gdouble, i);
+}
+
+// ===================== Sender sampling =====================
+static void sample_sender() {
+    if (!config.sender_pid) return;
+    gchar *path = g_strdup_printf("/proc/%d/stat", config.sender_pid);
+    gchar *stat = NULL;
+    g_file_get_contents(path, &stat, NULL, NULL);
+    g_free(path);
+    if (!stat) return;
+    // utime and stime are fields 14 and 15; skip past the parenthesized name
+    gint64 ticks = -1;
+    const gchar *p = strrchr(stat, ')');
+    gchar **fields = p ? g_strsplit(p + 2, " ", 16) : NULL;
+    if (fields && g_strv_length(fields) > 12)
+        ticks = g_ascii_strtoll(fields[11], NULL, 10) + g_ascii_strtoll(fields[12], NULL, 10);
+    g_strfreev(fields);
+    g_free(stat);
+
+    gint64 now = g_get_monotonic_time();
+    if (ticks >= 0 && sender_last_ticks >= 0) {
+        gdouble cpu_s = (gdouble)(ticks - sender_last_ticks) / sysconf(_SC_CLK_TCK);
+        gdouble pct = 100.0 * cpu_s / ((now - sender_last_sample) / 1e6);
+        g_array_append_val(sender_cpu, pct);
+    }
+    sender_last_ticks = ticks;
+    sender_last_sample = now;
+
+    path = g_strdup_printf("/proc/%d/status", config.sender_pid);
+    gchar *status = NULL;
+    g_file_get_contents(path, &status, NULL, NULL);
+    g_free(path);
+    const gchar *rss = status ? strstr(status, "VmRSS:") : NULL;
+    if (rss) sender_rss_peak_mb = MAX(sender_rss_peak_mb, g_ascii_strtoll(rss + 6, NULL, 10) / 1024.0);
+    g_free(status);
+}
+
+// ===================== Media =====================
+// RTP side of every video stream: queueing delay always, frames unless decoding.
+static GstPadProbeReturn on_rtp_buffer(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer user_data) {
+    Viewer *v = (Viewer *)user_data;
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    if (!gst_rtp_buffer_map(GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ, &rtp)) return GST_PAD_PROBE_OK;
+    gboolean marker = gst_rtp_buffer_get_marker(&rtp);
+    guint32 ts = gst_rtp_buffer_get_timestamp(&rtp);
+    gst_rtp_buffer_unmap(&rtp);
+    if (!marker) return GST_PAD_PROBE_OK;
+
+    gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&v->lock);
+    v->rtp_ts_ext = v->delay_ms->len ? v->rtp_ts_ext + (gint32)(ts - v->last_rtp_ts) : ts;
+    v->last_rtp_ts = ts;
+    // Video RTP clocks run at 90 kHz
+    gint64 delay_us = now - v->rtp_ts_ext * 1000000 / 90000;
+    if (v->delay_ms->len == 0 || delay_us < v->min_delay_us) v->min_delay_us = delay_us;
+    gdouble excess_ms = (delay_us - v->min_delay_us) / 1000.0;
+    g_array_append_val(v->delay_ms, excess_ms);
+    if (!config.decode) {
+        if (!v->frames) v->t_first_frame = now;
+        v->frames++;
+    }
+    g_mutex_unlock(&v->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn on_decoded_frame(GstPad * /*pad*/, GstPadProbeInfo * /*info*/, gpointer user_data) {
+    Viewer *v = (Viewer *)user_data;
+    g_mutex_lock(&v->lock);
+    if (!v->frames) v->t_first_frame = g_get_monotonic_time();
+    v->frames++;
+    g_mutex_unlock(&v->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstElement *add_sink() {
+    GstElement *sink = gst_element_factory_make("fakesink", NULL);
+    g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add(GST_BIN(pipeline), sink);
+    gst_element_sync_state_with_parent(sink);
+    return sink;
+}
+
+static void on_decoded_pad(GstElement * /*decodebin*/, GstPad *pad, gpointer user_data) {
+    GstElement *sink = add_sink();
+    GstPad *sinkpad = gst_element_get_static_pad(sink, "sink");
+    if (gst_pad_link(pad, sinkpad) == GST_PAD_LINK_OK)
+        gst_pad_add_probe(sinkpad, GST_PAD_PROBE_TYPE_BUFFER, on_decoded_frame, user_data, NULL);
+    gst_object_unref(sinkpad);
+}
+
+// webrtcbin streaming thread: one pad per received stream.
+static void on_incoming_stream(GstElement * /*webrtc*/, GstPad *pad, gpointer user_data) {
+    Viewer *v = (Viewer *)user_data;
+    if (GST_PAD_DIRECTION(pad) != GST_PAD_SRC) return;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps) caps = gst_pad_query_caps(pad, NULL);
+    const gchar *media = gst_structure_get_string(gst_caps_get_structure(caps, 0), "media");
+    gboolean video = g_strcmp0(media, "video") == 0;
+    gst_caps_unref(caps);
+
+    GstElement *queue = gst_element_factory_make("queue", NULL);
+    gst_bin_add(GST_BIN(pipeline), queue);
+    gst_element_sync_state_with_parent(queue);
+    if (video && config.decode) {
+        GstElement *decode = gst_element_factory_make("decodebin", NULL);
+        g_signal_connect(decode, "pad-added", G_CALLBACK(on_decoded_pad), v);
+        gst_bin_add(GST_BIN(pipeline), decode);
+        gst_element_sync_state_with_parent(decode);
+        gst_element_link(queue, decode);
+    } else {
+        gst_element_link(queue, add_sink());
+    }
+
+    GstPad *qpad = gst_element_get_static_pad(queue, "sink");
+    if (gst_pad_link(pad, qpad) != GST_PAD_LINK_OK) fail_viewer(v, "link failed");
+    else if (video) gst_pad_add_probe(qpad, GST_PAD_PROBE_TYPE_BUFFER, on_rtp_buffer, v, NULL);
+    gst_object_unref(qpad);
+}
+
+static void on_connection_state(GstElement *webrtc, GParamSpec * /*pspec*/, gpointer user_data) {
+    GstWebRTCPeerConnectionState st;
+    g_object_get(webrtc, "connection-state", &st, NULL);
+    if (st == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED) fail_viewer((Viewer *)user_data, "connection failed");
+}
+
+// ===================== Negotiation =====================
+static void on_ice_candidate(GstElement * /*webrtc*/, guint mlineindex, gchar *candidate, gpointer user_data) {
+    Viewer *v = (Viewer *)user_data;
+    JsonObject *ice = json_object_new();
+    json_object_set_string_member(ice, "candidate", candidate);
+    json_object_set_int_member(ice, "sdpMLineIndex", mlineindex);
+    JsonObject *msg = json_object_new();
+    json_object_set_string_member(msg, "type", "ice-candidate");
+    json_object_set_string_member(msg, "to", v->sender);
+    json_object_set_object_member(msg, "candidate", ice);
+    send_json(v, msg);
+    json_object_unref(msg);
+}
+
+static void on_answer_created(GstPromise *promise, gpointer user_data) {
+    Viewer *v = (Viewer *)user_data;
+    GstWebRTCSessionDescription *answer = NULL;
+    if (gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED)
+        gst_structure_get(gst_promise_get_reply(promise), "answer",
+                          GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
+    gst_promise_unref(promise);
+    if (!answer) { fail_viewer(v, "create-answer failed"); return; }
+
+    // Queue the answer before set-local-description starts gathering, so it
+    // reaches the sender ahead of our candidates.
+    gchar *sdp = gst_sdp_message_as_text(answer->sdp);
+    JsonObject *msg = json_object_new();
+    json_object_set_string_member(msg, "type", "answer");
+    json_object_set_string_member(msg, "to", v->sender);
+    json_object_set_string_member(msg, "sdp", sdp);
+    send_json(v, msg);
+    json_object_unref(msg);
+    g_free(sdp);
+
+    g_signal_emit_by_name(v->webrtc, "set-local-description", answer, NULL);
+    gst_webrtc_session_description_free(answer);
+}
+
+static void on_offer_set(GstPromise *promise, gpointer user_data) {
+    Viewer *v = (Viewer *)user_data;
+    gboolean ok = gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED;
+    gst_promise_unref(promise);
+    if (!ok) { fail_viewer(v, "set-remote-description failed"); return; }
+    g_signal_emit_by_name(v->webrtc, "create-answer", NULL,
+                          gst_promise_new_with_change_func(on_answer_created, v, NULL));
+}
+
+// Main loop. Renegotiations (ICE restarts) reuse the same webrtcbin.
+static void handle_offer(Viewer *v, const gchar *sdp_text) {
+    GstSDPMessage *sdp; gst_sdp_message_new(&sdp);
+    if (!sdp_text || gst_sdp_message_parse_buffer((guint8 *)sdp_text, strlen(sdp_text), sdp) != GST_SDP_OK) {
+        gst_sdp_message_free(sdp);
+        fail_viewer(v, "bad offer");
+        return;
+    }
+    if (!v->webrtc) {
+        v->webrtc = gst_element_factory_make("webrtcbin", NULL);
+        g_object_set(v->webrtc, "bundle-policy", GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE, NULL);
+        g_signal_connect(v->webrtc, "on-ice-candidate", G_CALLBACK(on_ice_candidate), v);
+        g_signal_connect(v->webrtc, "pad-added", G_CALLBACK(on_incoming_stream), v);
+        g_signal_connect(v->webrtc, "notify::connection-state", G_CALLBACK(on_connection_state), v);
+        gst_bin_add(GST_BIN(pipeline), v->webrtc);
+        gst_element_sync_state_with_parent(v->webrtc);
+    }
+    GstWebRTCSessionDescription *offer = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_OFFER, sdp);
+    g_signal_emit_by_name(v->webrtc, "set-remote-description", offer,
+                          gst_promise_new_with_change_func(on_offer_set, v, NULL));
+    gst_webrtc_session_description_free(offer);
+}
+
+// ===================== Signaling =====================
+static void on_message(SoupWebsocketConnection * /*conn*/, SoupWebsocketDataType type,
+                       GBytes *message, gpointer user_data) {
+    Viewer *v = (Viewer *)user_data;
+    if (type != SOUP_WEBSOCKET_DATA_TEXT) return;
+    gsize size;
+    const gchar *data = (const gchar *)g_bytes_get_data(message, &size);
+    JsonParser *parser = json_parser_new();
+    if (!json_parser_load_from_data(parser, data, size, NULL)) { g_object_unref(parser); return; }
+    JsonObject *object = json_node_get_object(json_parser_get_root(parser));
+    const gchar *msg_type = json_object_get_string_member_with_default(object, "type", "");
+    const gchar *from = json_object_get_string_member_with_default(object, "from", NULL);
+
+    if (g_strcmp0(msg_type, "registered") == 0) {
+        v->id = g_strdup(json_object_get_string_member(object, "id"));
+        JsonObject *join = json_object_new();
+        json_object_set_string_member(join, "type", "join");
+        json_object_set_string_member(join, "room", config.room);
+        json_object_set_string_member(join, "clientType", "viewer");
+        send_json(v, join);
+        json_object_unref(join);
+        JsonObject *request = json_object_new();
+        json_object_set_string_member(request, "type", "request-offer");
+        send_json(v, request);
+        json_object_unref(request);
+        v->t_request = g_get_monotonic_time();
+
+    } else if (g_strcmp0(msg_type, "offer") == 0 && from && (!v->sender || g_strcmp0(from, v->sender) == 0)) {
+        if (!v->sender) v->sender = g_strdup(from);
+        handle_offer(v, json_object_get_string_member_with_default(object, "sdp", NULL));
+
+    } else if (g_strcmp0(msg_type, "ice-candidate") == 0 && v->webrtc && g_strcmp0(from, v->sender) == 0) {
+        JsonObject *cand = json_object_get_object_member(object, "candidate");
+        const gchar *candidate = cand ? json_object_get_string_member_with_default(cand, "candidate", "") : "";
+        if (*candidate)
+            g_signal_emit_by_name(v->webrtc, "add-ice-candidate",
+                                  (guint)json_object_get_int_member(cand, "sdpMLineIndex"), candidate);
+
+    } else if (g_strcmp0(msg_type, "peer-left") == 0 && v->sender &&
+               g_strcmp0(json_object_get_string_member_with_default(object, "id", NULL), v->sender) == 0) {
+        fail_viewer(v, "sender left");
+    }
+    g_object_unref(parser);
+}
+
+static void on_closed(SoupWebsocketConnection * /*conn*/, gpointer user_data) {
+    if (!stopping) fail_viewer((Viewer *)user_data, "signaling closed");
+}
+
+static void on_connected(GObject *session, GAsyncResult *res, gpointer user_data) {
+    Viewer *v = (Viewer *)user_data;
+    GError *error = NULL;
+    v->ws = soup_session_websocket_connect_finish(SOUP_SESSION(session), res, &error);
+    if (error) {
+        fail_viewer(v, "signaling connect failed");
+        g_error_free(error);
+        return;
+    }
+    g_signal_connect(v->ws, "message", G_CALLBACK(on_message), v);
+    g_signal_connect(v->ws, "closed", G_CALLBACK(on_closed), v);
+}
+
+static gboolean start_next_viewer(gpointer) {
+    if (stopping || started >= config.viewers) return G_SOURCE_REMOVE;
+    Viewer *v = &viewers[started++];
+    SoupMessage *msg = soup_message_new("GET", config.server);
+    soup_session_websocket_connect_async(soup_session, msg, NULL, NULL, NULL, on_connected, v);
+    g_object_unref(msg);
+    if (started < config.viewers) return G_SOURCE_CONTINUE;
+    t_last_join = g_get_monotonic_time();
+    return G_SOURCE_REMOVE;
+}
+
+// ===================== Progress / report =====================
+static gboolean on_tick(gpointer) {
+    gint64 now = g_get_monotonic_time();
+    gint connected = 0, failed = 0, fps_total = 0, fps_min = G_MAXINT, fps_viewers = 0;
+    for (gint i = 0; i < started; i++) {
+        Viewer *v = &viewers[i];
+        g_mutex_lock(&v->lock);
+        gint frames = v->frames;
+        gint64 t_first = v->t_first_frame;
+        g_mutex_unlock(&v->lock);
+
+        if (g_atomic_pointer_get(&v->failure)) { failed++; continue; }
+        if (!t_first) {
+            if (v->t_request && now - v->t_request > (gint64)config.join_timeout_ms * 1000) {
+                fail_viewer(v, "no video");
+                failed++;
+            }
+            continue;
+        }
+        connected++;
+        gint fps = frames - v->last_frames;
+        v->last_frames = frames;
+        // The first second is partial
+        if (now - t_first < 1500000) continue;
+        v->min_fps = v->fps_samples ? MIN(v->min_fps, fps) : fps;
+        v->fps_sum += fps;
+        v->fps_samples++;
+        fps_total += fps;
+        fps_min = MIN(fps_min, fps);
+        fps_viewers++;
+    }
+    sample_sender();
+
+    g_print("t=%3llds  joined %d/%d  video %d  failed %d  fps avg %.1f min %d",
+            (long long)((now - t_begin) / 1000000), started, config.viewers, connected, failed,
+            fps_viewers ? (gdouble)fps_total / fps_viewers : 0.0, fps_viewers ? fps_min : 0);
+    if (config.sender_pid && sender_cpu->len)
+        g_print("  sender cpu %.0f%% rss %.0f MB", g_array_index(sender_cpu, gdouble, sender_cpu->len - 1),
+                sender_rss_peak_mb);
+    g_print("\n");
+
+    if (t_last_join && now - t_last_join >= (gint64)config.hold_s * 1000000) g_main_loop_quit(loop);
+    return G_SOURCE_CONTINUE;
+}
+
+static void report_line(const gchar *name, GArray *values, const gchar *unit) {
+    guint n = values->len;
+    gdouble sum = 0;
+    for (guint i = 0; i < n; i++) sum += g_array_index(values, gdouble, i);
+    g_print("%-18s n=%u  mean %.1f%s  p5 %.1f%s  p50 %.1f%s  p95 %.1f%s  max %.1f%s\n", name, n,
+            n ? sum / n : NAN, unit, percentile(values, 0.05), unit, percentile(values, 0.5), unit,
+            percentile(values, 0.95), unit, percentile(values, 1.0), unit);
+}
+
+static void print_report() {
+    GArray *join_ms = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    GArray *mean_fps = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    GArray *worst_fps = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    GArray *delay_p95 = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    GHashTable *failures = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (gint i = 0; i < started; i++) {
+        Viewer *v = &viewers[i];
+        const gchar *failure = (const gchar *)g_atomic_pointer_get(&v->failure);
+        if (failure) {
+            g_hash_table_insert(failures, (gpointer)failure,
+                                GINT_TO_POINTER(GPOINTER_TO_INT(g_hash_table_lookup(failures, failure)) + 1));
+            continue;
+        }
+        g_mutex_lock(&v->lock);
+        if (v->t_first_frame && v->t_request) {
+            gdouble ms = (v->t_first_frame - v->t_request) / 1000.0;
+            g_array_append_val(join_ms, ms);
+        }
+        if (v->delay_ms->len) {
+            gdouble p95 = percentile(v->delay_ms, 0.95);
+            g_array_append_val(delay_p95, p95);
+        }
+        g_mutex_unlock(&v->lock);
+        if (v->fps_samples) {
+            gdouble mean = (gdouble)v->fps_sum / v->fps_samples, worst = v->min_fps;
+            g_array_append_val(mean_fps, mean);
+            g_array_append_val(worst_fps, worst);
+        }
+    }
+
+    g_print("\n===== Load test: %d/%d viewers started, %u with video =====\n", started, config.viewers, join_ms->len);
+    report_line("join ms", join_ms, "");
+    report_line("fps (mean)", mean_fps, "");
+    report_line("fps (worst 1 s)", worst_fps, "");
+    report_line("delay p95 ms", delay_p95, "");
+    GHashTableIter it; gpointer key, value;
+    g_hash_table_iter_init(&it, failures);
+    while (g_hash_table_iter_next(&it, &key, &value))
+        g_print("failed: %-24s %d\n", (const gchar *)key, GPOINTER_TO_INT(value));
+    if (config.sender_pid && sender_cpu->len) {
+        gdouble sum = 0;
+        for (guint i = 0; i < sender_cpu->len; i++) sum += g_array_index(sender_cpu, gdouble, i);
+        g_print("sender             cpu mean %.0f%%  peak %.0f%%  rss peak %.0f MB\n",
+                sum / sender_cpu->len, percentile(sender_cpu, 1.0), sender_rss_peak_mb);
+    }
+
+    g_array_free(join_ms, TRUE);
+    g_array_free(mean_fps, TRUE);
+    g_array_free(worst_fps, TRUE);
+    g_array_free(delay_p95, TRUE);
+    g_hash_table_unref(failures);
+}
+
+// ===================== Args / main =====================
+static void print_usage(const char *prog) {
+    g_print("Usage: %s [options]\n", prog);
+    g_print("  --server=URL        signaling server (default: ws://127.0.0.1:8080)\n");
+    g_print("  --room=NAME         sender room to join (default: default)\n");
+    g_print("  --viewers=N         simulated viewers (default: 10)\n");
+    g_print("  --rate=R            joins per second during the ramp (default: 1)\n");
+    g_print("  --hold=S            keep running S seconds after the last join (default: 10)\n");
+    g_print("  --join-timeout=MS   request-offer to first frame before a viewer counts as failed (default: 15000)\n");
+    g_print("  --decode            decode video instead of counting RTP frames\n");
+    g_print("  --sender-pid=PID    sample the sender's CPU and RSS from /proc\n");
+    g_print("  --help              show this help\n");
+}
+
+static gboolean parse_arguments(int argc, char *argv[]) {
+    config.server = g_strdup("ws://127.0.0.1:8080");
+    config.room = g_strdup("default");
+    config.viewers = 10;
+    config.rate = 1;
+    config.hold_s = 10;
+    config.join_timeout_ms = 15000;
+
+    struct option long_options[] = {
+        {"server", required_argument, 0, 's'},
+        {"room", required_argument, 0, 'R'},
+        {"viewers", required_argument, 0, 'n'},
+        {"rate", required_argument, 0, 'r'},
+        {"hold", required_argument, 0, 'h'},
+        {"join-timeout", required_argument, 0, 't'},
+        {"decode", no_argument, 0, 'd'},
+        {"sender-pid", required_argument, 0, 'p'},
+        {"help", no_argument, 0, '?'},
+        {0,0,0,0}
+    };
+    int c, idx=0;
+    while ((c = getopt_long(argc, argv, "s:R:n:r:h:t:dp:?", long_options, &idx)) != -1) {
+        switch (c) {
+            case 's': g_free(config.server); config.server = g_strdup(optarg); break;
+            case 'R': g_free(config.room); config.room = g_strdup(optarg); break;
+            case 'n': config.viewers = atoi(optarg); if (config.viewers<=0){ g_printerr("viewers>0\n"); return FALSE; } break;
+            case 'r': config.rate = g_ascii_strtod(optarg, NULL); if (config.rate<=0){ g_printerr("rate>0\n"); return FALSE; } break;
+            case 'h': config.hold_s = atoi(optarg); if (config.hold_s<0){ g_printerr("hold>=0\n"); return FALSE; } break;
+            case 't': config.join_timeout_ms = atoi(optarg); if (config.join_timeout_ms<=0){ g_printerr("join-timeout>0\n"); return FALSE; } break;
+            case 'd': config.decode = TRUE; break;
+            case 'p': config.sender_pid = atoi(optarg); break;
+            case '?': default: print_usage(argv[0]); return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    gst_init(&argc, &argv);
+    if (!parse_arguments(argc, argv)) return -1;
+
+    loop = g_main_loop_new(NULL, FALSE);
+    soup_session = soup_session_new();
+    pipeline = gst_pipeline_new("loadgen");
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    sender_cpu = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    viewers = g_new0(Viewer, config.viewers);
+    for (gint i = 0; i < config.viewers; i++) {
+        viewers[i].index = i;
+        g_mutex_init(&viewers[i].lock);
+        viewers[i].delay_ms = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    }
+
+    g_print("Load test: %d viewers at %.1f joins/s against %s, room '%s'%s\n", config.viewers, config.rate,
+            config.server, config.room, config.decode ? ", decoding" : "");
+    t_begin = g_get_monotonic_time();
+    start_next_viewer(NULL);
+    g_timeout_add(MAX(1, (guint)(1000 / config.rate)), start_next_viewer, NULL);
+    g_timeout_add_seconds(1, on_tick, NULL);
+    g_unix_signal_add(SIGINT, [](gpointer) -> gboolean { g_main_loop_quit(loop); return G_SOURCE_REMOVE; }, NULL);
+
+    g_main_loop_run(loop);
+
+    stopping = TRUE;
+    print_report();
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    for (gint i = 0; i < config.viewers; i++) {
+        Viewer *v = &viewers[i];
+        if (v->ws) {
+            soup_websocket_connection_close(v->ws, SOUP_WEBSOCKET_CLOSE_NORMAL, NULL);
+            g_object_unref(v->ws);
+        }
+        g_free(v->id);
+        g_free(v->sender);
+        g_array_free(v->delay_ms, TRUE);
+        g_mutex_clear(&v->lock);
+    }
+    g_free(viewers);
+    g_array_free(sender_cpu, TRUE);
+    g_object_unref(soup_session);
+    g_main_loop_unref(loop);
+    g_free(config.server);
+    g_free(config.room);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Loopback check of --multicast: one sender, several local receivers on the
+# same group. Fetches the SDP over HTTP, measures the sender's CPU over S
+# seconds with no receiver and again while N receivers decode the stream
+# (sdpdemux ! decodebin, video and audio), and reports how many of them got
+# FRAMES decoded video frames. The sender's cost should not move with N.
+#
+#   node signalingserver.js &
+#   bench/multicast.sh [seconds] [extra gpt options...]
+#   RECEIVERS=8 GROUP=239.255.0.1:5004 bench/multicast.sh 20 --multicast-srtp
+#
+# Multicast on loopback needs a route, e.g. sudo ip route add 239.0.0.0/8 dev lo
+# (and --multicast-iface=lo if another interface has the default route).
+secs=${1:-20}
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+server=${SERVER:-ws://127.0.0.1:8080}
+group=${GROUP:-239.255.0.1:5004}
+http=${HTTP_PORT:-8554}
+receivers=${RECEIVERS:-4}
+frames=${FRAMES:-150}
+hz=$(getconf CLK_TCK)
+log=multicast.log
+sdp=multicast-$$.sdp
+
+cpu_ticks() {
+    # utime + stime; the command name may hold spaces, so count from the ')'
+    sed 's/.*) //' "/proc/$1/stat" | awk '{ print $12 + $13 }'
+}
+
+"$bin" --server="$server" --room="multicast-$$" --source=test --multicast="$group" \
+    --multicast-http="$http" "$@" >"$log" 2>&1 &
+pid=$!
+trap 'kill -INT $pid 2>/dev/null; wait $pid; rm -f "$sdp"' EXIT
+
+# The SDP is served once both streams have negotiated caps
+for i in $(seq 1 20); do
+    curl -sf -o "$sdp" "http://127.0.0.1:$http/stream.sdp" && break
+    kill -0 "$pid" 2>/dev/null || { echo "sender exited, see $log"; exit 1; }
+    sleep 0.5
+done
+[ -s "$sdp" ] || { echo "no SDP on :$http, see $log"; exit 1; }
+echo "SDP from http://127.0.0.1:$http/stream.sdp:"
+sed 's/^/  /' "$sdp"
+
+t0=$(cpu_ticks "$pid")
+sleep "$secs"
+t1=$(cpu_ticks "$pid")
+echo "0 receivers: sender cpu $(( (t1 - t0) * 100 / hz / secs ))% over ${secs} s"
+
+# Each receiver stops after FRAMES decoded video and audio buffers
+rpids=
+for n in $(seq 1 "$receivers"); do
+    timeout $((secs + 30)) gst-launch-1.0 -q filesrc location="$sdp" ! sdpdemux name=d \
+        d. ! queue ! decodebin ! video/x-raw ! fakesink num-buffers="$frames" \
+        d. ! queue ! decodebin ! audio/x-raw ! fakesink num-buffers="$frames" >"multicast-rx-$n.log" 2>&1 &
+    rpids="$rpids $!"
+done
+t0=$(cpu_ticks "$pid")
+sleep "$secs"
+t1=$(cpu_ticks "$pid")
+echo "$receivers receivers: sender cpu $(( (t1 - t0) * 100 / hz / secs ))% over ${secs} s"
+
+ok=0
+n=0
+for r in $rpids; do
+    n=$((n + 1))
+    wait "$r" && ok=$((ok + 1)) || echo "receiver $n failed, see multicast-rx-$n.log"
+done
+echo "$ok/$receivers receivers decoded $frames frames"
+kill -INT "$pid"
+wait "$pid"
+trap - EXIT
+rm -f "$sdp"
+grep -E '^(Multicast:|multicast:)' "$log"
+[ "$ok" -eq "$receivers" ]
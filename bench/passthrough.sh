@@ -0,0 +1,56 @@
+#!/bin/sh
+# Compressed-source check: serves a clip through bench/rtsp_standin and runs
+# gpt against it with --source=rtsp, then against the file with --source=file.
+# Each run prints its encoder choice and the bench-profile lines; a passthrough
+# run must say "passthrough" and produce packets, and costs no encoder CPU
+# (compare the "cpu" line against a --test-source run of the same size).
+#
+#   g++ -O2 -o rtsp_standin bench/rtsp_standin.cpp $(pkg-config --cflags --libs gstreamer-rtsp-server-1.0)
+#   bench/passthrough.sh [clip.mp4] [seconds] [extra gpt options...]
+#
+# Without a clip, a 60 s 720p30 H.264 one is made with x264enc.
+# CODEC=vp8 forces the transcode path instead (decode, then re-encode).
+clip=${1:-passthrough-clip.mp4}
+secs=${2:-10}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+standin=${STANDIN:-./rtsp_standin}
+port=${PORT:-8554}
+codec=${CODEC:-h264}
+
+if [ ! -f "$clip" ]; then
+    echo "Making $clip"
+    gst-launch-1.0 -q videotestsrc num-buffers=1800 pattern=ball ! \
+        video/x-raw,width=1280,height=720,framerate=30/1 ! \
+        x264enc tune=zerolatency key-int-max=60 bitrate=2000 ! h264parse ! mp4mux ! \
+        filesink location="$clip" || exit 1
+fi
+
+"$standin" "$clip" h264 "$port" >/dev/null 2>&1 &
+standin_pid=$!
+trap 'kill "$standin_pid" 2>/dev/null' EXIT INT TERM
+sleep 1
+
+fail=0
+run() {
+    name=$1; shift
+    log=passthrough-$name.log
+    "$bin" --codec="$codec" --bench-profile="$secs" "$@" >"$log" 2>&1 &
+    pid=$!
+    # Sample CPU mid-run, once the source is flowing
+    sleep $((secs / 2 + 2))
+    cpu=$(ps -o %cpu= -p "$pid")
+    wait "$pid"
+    grep -E '^(profile |Transcoding)| encoder started' "$log" | sed "s/^/$name: /"
+    echo "$name: cpu ${cpu:-?}%"
+    if ! grep -q 'packets in' "$log"; then
+        echo "FAIL: $name produced no packets, see $log"; fail=1
+    elif [ "$codec" = h264 ] && ! grep -q 'started (passthrough)' "$log"; then
+        echo "FAIL: $name re-encoded, see $log"; fail=1
+    fi
+}
+
+run rtsp --source=rtsp --input="rtsp://127.0.0.1:$port/cam" "$@"
+run file --source=file --input="$clip" "$@"
+exit $fail
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Thread placement benchmark: --bench-profile runs with and without pinning
+# while LOAD busy loops compete for every core, the way other services do on
+# the board. Each run prints capture-interval jitter (spacing of frames at the
+# source pad) and capture-to-packet latency including p99.
+#
+#   bench/pinning.sh [seconds] [extra gpt options...]
+#   PINNED="--cpus-capture=3 --cpus-encode=2 --cpus-network=0-1 --rt-priority=50" bench/pinning.sh 30
+#
+# SCHED_FIFO needs root or CAP_SYS_NICE; without it only the pinning applies
+# and gpt says so once.
+secs=${1:-20}
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+load=${LOAD:-$(nproc)}
+pinned=${PINNED:---cpus-capture=3 --cpus-encode=2 --cpus-network=0-1 --rt-priority=50}
+
+i=0
+while [ "$i" -lt "$load" ]; do
+    sh -c 'while :; do :; done' &
+    i=$((i + 1))
+done
+trap 'kill $(jobs -p) 2>/dev/null' EXIT INT TERM
+
+run() {
+    name=$1; shift
+    timeout $((secs + 30)) "$bin" --test-source --bench-profile="$secs" "$@" 2>&1 |
+        grep -E '^(profile |threads placed|Thread placement)' | sed "s/^/$name: /"
+}
+
+echo "$load busy loops competing"
+run unpinned "$@"
+run pinned $pinned "$@"
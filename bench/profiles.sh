@@ -0,0 +1,22 @@
+#!/bin/sh
+# Latency/bitrate benchmark of the --profile presets against videotestsrc.
+# Each profile runs for S seconds after its first packet and prints two lines:
+# capture-to-packet latency (p50/p95/max) and the encoded output bitrate, then
+# the encoded frame size distribution (max vs mean shows keyframe spikes).
+# Receiver jitterbuffer and decode time are not part of the number.
+# Set CLIP to a .y4m file to replay it instead, so runs see identical content
+# (motion and detail change bitrate and frame sizes a lot).
+#
+#   bench/profiles.sh [seconds] [extra gpt options...]
+#   bench/profiles.sh 20 --intra-refresh=columns --max-frame-kb=40   # compare vs periodic IDR
+#   CLIP=park_joy_720p.y4m bench/profiles.sh 20
+secs=${1:-20}
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+source="--test-source"
+[ -n "$CLIP" ] && source="--source=replay --input=$CLIP"
+
+for profile in ultra-low-latency balanced quality; do
+    timeout $((secs + 30)) "$bin" $source --profile="$profile" --bench-profile="$secs" "$@" 2>/dev/null |
+        grep '^profile ' || echo "profile $profile: failed"
+done
@@ -0,0 +1,143 @@
+// Push-API benchmark: a thin client of libgptsender that plays the part of a
+// vision pipeline. It owns a small ring of I420 frames, draws a moving bar
+// into a free one, pushes it at --fps with pts = capture time and reuses it
+// only after the sender releases it.
+//
+//   g++ -O2 -fPIC -shared -o libgptsender.so gpt_sender.cpp $(pkg-config ...) -lcrypto
+//   g++ -O2 -I. -o push_bench bench/push_bench.cpp -L. -lgptsender $(pkg-config --cflags --libs glib-2.0)
+//   LD_LIBRARY_PATH=. ./push_bench [gpt options...]
+//
+// Runs gpt with --source=app --bench-profile=10 unless overridden, so the
+// sender prints capture-to-RTP latency (the capture being the push) and how
+// many frames reached the encoder without a copy. This side adds the cost of
+// the push call itself and how long the sender held each frame.
+#include <glib.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "gpt_sender.h"
+
+struct Slot {
+    guint8 *data;
+    gint busy;                      // pushed and not yet released
+    gint64 pushed_at;
+};
+
+static const guint n_slots = 4;
+static Slot slots[n_slots];
+static gint width = 1280, height = 720, fps = 30;
+static gint stopping = 0;
+static gint flow_ready = 1;
+
+static GMutex stats_lock;
+static GArray *push_us = NULL;      // gdouble per push call
+static GArray *held_ms = NULL;      // gdouble per released frame
+static guint results[4];            // per GptPushResult
+static guint starved = 0;           // no free slot when a frame was due
+
+static void on_release(void *user_data) {
+    Slot *slot = (Slot *)user_data;
+    gdouble ms = (g_get_monotonic_time() - slot->pushed_at) / 1000.0;
+    g_mutex_lock(&stats_lock);
+    g_array_append_val(held_ms, ms);
+    g_mutex_unlock(&stats_lock);
+    g_atomic_int_set(&slot->busy, 0);
+}
+
+static void on_flow(int ready, void * /*user_data*/) { g_atomic_int_set(&flow_ready, ready); }
+
+// Moving vertical bar on grey, so the encoder has motion to work on
+static void draw(guint8 *frame, guint64 n) {
+    gsize luma = (gsize)width * height, chroma = luma / 4;
+    memset(frame, 96, luma);
+    gint x0 = (gint)((n * 8) % width), bar = MIN(64, width - x0);
+    for (gint y = 0; y < height; y++) memset(frame + (gsize)y * width + x0, 220, bar);
+    memset(frame + luma, 128, chroma * 2);
+}
+
+static gpointer pusher(gpointer /*data*/) {
+    gint64 interval = G_USEC_PER_SEC / fps, next = g_get_monotonic_time();
+    gsize size = (gsize)width * height * 3 / 2;
+    for (guint64 n = 0; !g_atomic_int_get(&stopping); n++) {
+        next += interval;
+        Slot *slot = NULL;
+        for (Slot &s : slots) if (!g_atomic_int_get(&s.busy)) { slot = &s; break; }
+        if (!slot || !g_atomic_int_get(&flow_ready)) {
+            // A real capture loop would drop this frame too
+            starved += !slot;
+        } else {
+            draw(slot->data, n);
+            g_atomic_int_set(&slot->busy, 1);
+            GptFrame frame = {};
+            frame.data = slot->data;
+            frame.size = size;
+            slot->pushed_at = g_get_monotonic_time();
+            frame.pts = (uint64_t)slot->pushed_at * 1000;       // CLOCK_MONOTONIC ns
+            frame.release = on_release;
+            frame.user_data = slot;
+            GptPushResult r = gpt_sender_push_frame(&frame);
+            gdouble us = (gdouble)(g_get_monotonic_time() - slot->pushed_at);
+            g_mutex_lock(&stats_lock);
+            g_array_append_val(push_us, us);
+            results[r]++;
+            g_mutex_unlock(&stats_lock);
+        }
+        gint64 wait = next - g_get_monotonic_time();
+        if (wait > 0) g_usleep(wait);
+    }
+    return NULL;
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b) {
+    gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, GArray *values, const char *unit) {
+    if (!values->len) { g_print("%-12s none\n", name); return; }
+    g_array_sort(values, compare_double);
+    gdouble *v = (gdouble *)(void *)values->data;
+    guint n = values->len;
+    g_print("%-12s n=%u p50 %.1f, p99 %.1f, max %.1f %s\n", name, n, v[n / 2], v[MIN(n - 1, n * 99 / 100)], v[n - 1], unit);
+}
+
+int main(int argc, char *argv[]) {
+    // Defaults first, so the caller's options override them
+    GPtrArray *args = g_ptr_array_new();
+    g_ptr_array_add(args, argv[0]);
+    g_ptr_array_add(args, (gpointer)"--source=app");
+    g_ptr_array_add(args, (gpointer)"--bench-profile=10");
+    for (int i = 1; i < argc; i++) {
+        g_ptr_array_add(args, argv[i]);
+        if (g_str_has_prefix(argv[i], "--width=")) width = atoi(argv[i] + 8);
+        else if (g_str_has_prefix(argv[i], "--height=")) height = atoi(argv[i] + 9);
+        else if (g_str_has_prefix(argv[i], "--fps=")) fps = atoi(argv[i] + 6);
+    }
+    g_ptr_array_add(args, NULL);
+    if (width <= 0 || height <= 0 || (width | height) & 1 || fps <= 0) {
+        g_printerr("Need an even --width/--height and --fps > 0\n");
+        return -1;
+    }
+
+    if (!gpt_sender_init((int)args->len - 1, (char **)args->pdata)) return -1;
+    push_us = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    held_ms = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    for (Slot &s : slots) s.data = (guint8 *)g_malloc((gsize)width * height * 3 / 2);
+    gpt_sender_set_flow_callback(on_flow, NULL);
+
+    GThread *thread = g_thread_new("pusher", pusher, NULL);
+    gpt_sender_run();                   // returns when --bench-profile is done
+    g_atomic_int_set(&stopping, 1);
+    g_thread_join(thread);
+    gpt_sender_shutdown();              // releases whatever is still in flight
+
+    g_print("push results: %u ok, %u busy, %u not running, %u invalid; %u frames starved of a free slot\n",
+            results[GPT_PUSH_OK], results[GPT_PUSH_BUSY], results[GPT_PUSH_NOT_RUNNING], results[GPT_PUSH_INVALID], starved);
+    report("push call", push_us, "us");
+    report("held", held_ms, "ms");
+    for (Slot &s : slots) g_free(s.data);
+    g_array_free(push_us, TRUE);
+    g_array_free(held_ms, TRUE);
+    g_ptr_array_free(args, TRUE);
+    return 0;
+}
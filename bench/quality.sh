@@ -0,0 +1,51 @@
+#!/bin/sh
+# Rate-distortion sweep: replays CLIP through each encoder backend, latency
+# profile and bitrate with --bench-quality, so the sender decodes its own RTP
+# and scores every frame against the clip. One CSV row per run, in
+# quality.csv: a curve per encoder/profile, PSNR and SSIM against the
+# measured bitrate. Use a real camera recording; synthetic patterns are far
+# too easy to encode.
+#
+#   CLIP=lobby_720p.y4m bench/quality.sh [seconds] [extra gpt options...]
+#   ENCODERS=x264 BITRATES="300 600 1200" CLIP=... bench/quality.sh 15
+#
+# With BASELINE set to an earlier quality.csv, runs whose Y PSNR dropped by
+# more than MAX_DROP_DB (default 0.3) against the same encoder/profile/bitrate
+# are listed and the script exits 1, to catch regressions from encoder changes.
+secs=${1:-15}
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+encoders=${ENCODERS:-omx x264}
+profiles=${PROFILES:-ultra-low-latency balanced quality}
+bitrates=${BITRATES:-500 1000 2000 4000}
+csv=${CSV:-quality.csv}
+max_drop=${MAX_DROP_DB:-0.3}
+[ -n "$CLIP" ] && [ -f "$CLIP" ] || { echo "set CLIP to a .y4m recording"; exit 1; }
+
+echo "encoder,profile,target_kbps,kbps,psnr_y,psnr_yuv,ssim,ssim_min,frames" >"$csv"
+for encoder in $encoders; do
+    for profile in $profiles; do
+        for bitrate in $bitrates; do
+            log=quality-$encoder-$profile-$bitrate.log
+            timeout $((secs + 30)) "$bin" --source=replay --input="$CLIP" --encoder="$encoder" --profile="$profile" \
+                --bitrate="$bitrate" --bench-profile="$secs" --bench-quality "$@" >"$log" 2>&1
+            kbps=$(sed -n 's/^profile .* bitrate \([0-9]*\) kbps.*/\1/p' "$log")
+            # profile P quality: N frames, psnr y A, yuv B dB; ssim y C (min D); ...
+            row=$(sed -n 's/^profile .* quality: \([0-9]*\) frames, psnr y \([0-9.]*\), yuv \([0-9.]*\) dB; ssim y \([0-9.]*\) (min \([0-9.]*\)).*/\2,\3,\4,\5,\1/p' "$log")
+            if [ -z "$kbps" ] || [ -z "$row" ]; then
+                echo "$encoder $profile $bitrate: no result, see $log"
+                continue
+            fi
+            echo "$encoder,$profile,$bitrate,$kbps,$row" >>"$csv"
+            echo "$encoder $profile $bitrate kbps: $kbps kbps, psnr y/yuv/ssim/min/frames $row"
+        done
+    done
+done
+
+[ -n "$BASELINE" ] || exit 0
+awk -F, -v max="$max_drop" '
+    NR == FNR { if (FNR > 1) base[$1 "," $2 "," $3] = $5; next }
+    FNR > 1 && ($1 "," $2 "," $3) in base && base[$1 "," $2 "," $3] - $5 > max {
+        printf "REGRESSION: %s %s %s kbps: psnr y %.2f -> %.2f dB\n", $1, $2, $3, base[$1 "," $2 "," $3], $5; bad = 1
+    }
+    END { if (!bad) print "no PSNR drop over " max " dB against the baseline"; exit bad }' "$BASELINE" "$csv"
@@ -0,0 +1,48 @@
+// File-backed RTSP stand-in for an IP camera: serves the H.264 or H.265 video
+// of an MP4/MKV file at rtsp://127.0.0.1:PORT/cam, packetized as-is (no
+// re-encode). Used by bench/passthrough.sh to exercise --source=rtsp.
+//
+//   g++ -O2 -o rtsp_standin bench/rtsp_standin.cpp $(pkg-config --cflags --libs gstreamer-rtsp-server-1.0)
+//   ./rtsp_standin clip.mp4 [h264|h265] [port]
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+int main(int argc, char *argv[]) {
+    gst_init(&argc, &argv);
+    if (argc < 2) {
+        g_printerr("Usage: %s FILE [h264|h265] [port]\n", argv[0]);
+        return -1;
+    }
+    const gchar *codec = argc > 2 ? argv[2] : "h264";
+    const gchar *port = argc > 3 ? argv[3] : "8554";
+    if (g_strcmp0(codec, "h264") != 0 && g_strcmp0(codec, "h265") != 0) {
+        g_printerr("Unsupported codec: %s\n", codec);
+        return -1;
+    }
+
+    GstRTSPServer *server = gst_rtsp_server_new();
+    g_object_set(server, "service", port, NULL);
+    // One shared media for all clients, like a camera; parsebin picks the demuxer
+    gchar *launch = g_strdup_printf(
+        "( filesrc location=\"%s\" ! parsebin ! %sparse ! queue ! "
+        "rtp%spay name=pay0 pt=96 config-interval=-1 )", argv[1], codec, codec);
+    GstRTSPMediaFactory *factory = gst_rtsp_media_factory_new();
+    gst_rtsp_media_factory_set_launch(factory, launch);
+    gst_rtsp_media_factory_set_shared(factory, TRUE);
+    g_free(launch);
+
+    GstRTSPMountPoints *mounts = gst_rtsp_server_get_mount_points(server);
+    gst_rtsp_mount_points_add_factory(mounts, "/cam", factory);
+    g_object_unref(mounts);
+
+    if (!gst_rtsp_server_attach(server, NULL)) {
+        g_printerr("Failed to listen on port %s\n", port);
+        return -1;
+    }
+    g_print("Serving %s at rtsp://127.0.0.1:%s/cam\n", argv[1], port);
+    GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(loop);
+    g_main_loop_unref(loop);
+    g_object_unref(server);
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Load test for the signaling relay alone (no gpt, no media).
+// Simulates fake senders, one room each, and viewers spread across the rooms.
+// Every viewer joins, asks for an offer, answers it and trickles candidates,
+// so the relay sees a full join storm with realistic SDP sizes.
+//
+//   node signalingserver.js &
+//   node bench/signaling_load.js [ws://host:8080] [clients] [senders]
+//
+// Reports join time, messages and bytes each simulated client received, and
+// the relay's own counters and CPU time from its /stats endpoint. Against a
+// relay without /stats, set SIGNAL_PID to read its CPU time from /proc.
+// LEGACY=1 skips the join messages, so everyone lands in the default room.
+const fs = require('fs');
+const http = require('http');
+const WebSocket = require('ws');
+
+const url = process.argv[2] || 'ws://127.0.0.1:8080';
+const total = parseInt(process.argv[3] || '100', 10);
+const senders = parseInt(process.argv[4] || '4', 10);
+const viewers = total - senders;
+const candidatesPerSide = 4;
+const timeoutMs = 20000;
+const legacy = !!process.env.LEGACY;
+const signalPid = process.env.SIGNAL_PID;
+
+// Roughly the size of a gpt offer with audio, video and several codecs
+const fakeSdp = 'v=0\r\n' + 'a=x-padding:'.padEnd(3000, 'x') + '\r\n';
+const fakeCandidate = { candidate: 'candidate:1 1 UDP 2122252543 192.168.1.10 50000 typ host', sdpMLineIndex: 0 };
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) return NaN;
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+function relayStats() {
+  return new Promise((resolve) => {
+    const statsUrl = url.replace(/^ws/, 'http').replace(/\/?$/, '/stats');
+    http.get(statsUrl, (res) => {
+      let body = '';
+      res.on('data', (chunk) => { body += chunk; });
+      res.on('end', () => { try { resolve(JSON.parse(body)); } catch (e) { resolve(null); } });
+    }).on('error', () => resolve(null));
+  });
+}
+
+// utime + stime in ms
+function procCpuMs(pid) {
+  const stat = fs.readFileSync(`/proc/${pid}/stat`, 'utf8');
+  const fields = stat.slice(stat.lastIndexOf(')') + 2).split(' ');
+  return (Number(fields[11]) + Number(fields[12])) * 10;   // USER_HZ = 100
+}
+
+function relayCpuMs(stats) {
+  if (stats) return (stats.cpu.user + stats.cpu.system) / 1000;
+  return signalPid ? procCpuMs(signalPid) : NaN;
+}
+
+function connect(onMessage) {
+  const ws = new WebSocket(url);
+  const counts = { messages: 0, bytes: 0 };
+  ws.on('message', (raw) => {
+    counts.messages++;
+    counts.bytes += raw.length;
+    onMessage(JSON.parse(raw));
+  });
+  return { ws, counts };
+}
+
+// Answers every request-offer with an offer and a burst of candidates
+function runSender(room) {
+  return new Promise((resolve) => {
+    const peer = connect((msg) => {
+      if (msg.type === 'registered') {
+        if (!legacy) peer.ws.send(JSON.stringify({ type: 'join', room, clientType: 'sender' }));
+        resolve(peer);
+      } else if (msg.type === 'request-offer') {
+        peer.ws.send(JSON.stringify({ type: 'offer', to: msg.from, sdp: fakeSdp }));
+        for (let i = 0; i < candidatesPerSide; i++) {
+          peer.ws.send(JSON.stringify({ type: 'ice-candidate', to: msg.from, candidate: fakeCandidate }));
+        }
+      }
+    });
+  });
+}
+
+function runViewer(room) {
+  return new Promise((resolve) => {
+    let start = 0;
+    let sender = null;
+    let candidates = 0;
+    const result = { joinMs: null, counts: null };
+    const peer = connect((msg) => {
+      if (msg.type === 'registered') {
+        start = process.hrtime.bigint();
+        if (!legacy) peer.ws.send(JSON.stringify({ type: 'join', room, clientType: 'viewer' }));
+        peer.ws.send(JSON.stringify({ type: 'request-offer' }));
+      } else if (msg.type === 'offer' && sender === null) {
+        // Take the first offer, like index.html does
+        sender = msg.from;
+        peer.ws.send(JSON.stringify({ type: 'answer', to: sender, sdp: fakeSdp }));
+        for (let i = 0; i < candidatesPerSide; i++) {
+          peer.ws.send(JSON.stringify({ type: 'ice-candidate', to: sender, candidate: fakeCandidate }));
+        }
+      } else if (msg.type === 'ice-candidate' && msg.from === sender && ++candidates === candidatesPerSide) {
+        result.joinMs = Number(process.hrtime.bigint() - start) / 1e6;
+        clearTimeout(timer);
+        resolve(result);
+      }
+    });
+    result.counts = peer.counts;
+    result.ws = peer.ws;
+    const timer = setTimeout(() => resolve(result), timeoutMs);
+    peer.ws.on('error', () => { clearTimeout(timer); resolve(result); });
+  });
+}
+
+function report(name, values, unit) {
+  const sorted = values.filter((v) => v !== null).sort((a, b) => a - b);
+  const mean = sorted.reduce((a, b) => a + b, 0) / sorted.length;
+  console.log(`${name.padEnd(20)} n=${sorted.length}/${values.length}` +
+    `  mean=${mean.toFixed(1)}${unit}  p50=${percentile(sorted, 0.5).toFixed(1)}${unit}` +
+    `  p95=${percentile(sorted, 0.95).toFixed(1)}${unit}  max=${(sorted[sorted.length - 1] || NaN).toFixed(1)}${unit}`);
+}
+
+(async () => {
+  console.log(`Signaling load: ${senders} senders, ${viewers} viewers against ${url}${legacy ? ' (no rooms)' : ''}`);
+  const senderPeers = await Promise.all(Array.from({ length: senders }, (_, i) => runSender(`load-${i}`)));
+  // Let the joins land before the storm starts
+  await new Promise((r) => setTimeout(r, 200));
+
+  const before = await relayStats();
+  const cpuBefore = relayCpuMs(before);
+  const results = await Promise.all(Array.from({ length: viewers }, (_, i) => runViewer(`load-${i % senders}`)));
+  const after = await relayStats();
+  const cpuAfter = relayCpuMs(after);
+
+  report('join (offer+cands)', results.map((r) => r.joinMs), ' ms');
+  report('viewer msgs rx', results.map((r) => r.counts.messages), '');
+  report('viewer kB rx', results.map((r) => r.counts.bytes / 1024), '');
+  report('sender msgs rx', senderPeers.map((p) => p.counts.messages), '');
+  if (before && after) {
+    console.log(`relay messages     in=${after.in - before.in}  out=${after.out - before.out}` +
+      `  ${((after.bytesOut - before.bytesOut) / 1024).toFixed(0)} kB out`);
+  }
+  const cpu = cpuAfter - cpuBefore;
+  if (!Number.isNaN(cpu)) {
+    console.log(`relay cpu          ${cpu.toFixed(0)} ms total, ${(cpu / viewers).toFixed(2)} ms per join`);
+  }
+
+  results.forEach((r) => r.ws.close());
+  senderPeers.forEach((p) => p.ws.close());
+})();
@@ -0,0 +1,94 @@
+#!/bin/sh
+# Session-churn soak test for the sender.
+# Starts gpt on videotestsrc with the GStreamer leaks tracer, then runs
+# bench/loadgen rounds against it: each round joins BATCH viewers, holds them
+# for HOLD seconds and drops them all, so a round is BATCH complete join/leave
+# cycles (DTLS, data channels, encoder start and stop with the last viewer).
+# After every round the sender's RSS, open fds and thread count go to soak.csv.
+#
+#   node signalingserver.js &
+#   bench/soak.sh [cycles] [extra gpt options...]
+#
+# The first WARMUP rounds fill pools and caches; the sample after them is the
+# baseline. The run fails (exit 1) if the final sample grew past MAX_RSS_MB,
+# MAX_FDS or MAX_THREADS over that baseline, or if the leaks tracer finds an
+# object type with at least one instance alive per round when gpt exits:
+# a handful of leftovers is a fixed cost, one per round is a per-session leak.
+cycles=${1:-2000}
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+loadgen=${LOADGEN:-./loadgen}
+server=${SERVER:-ws://127.0.0.1:8080}
+batch=${BATCH:-10}
+rate=${RATE:-5}
+hold=${HOLD:-3}
+warmup=${WARMUP:-5}
+max_rss_mb=${MAX_RSS_MB:-16}
+max_fds=${MAX_FDS:-4}
+max_threads=${MAX_THREADS:-4}
+log=${LOG:-soak.log}
+csv=${CSV:-soak.csv}
+room=soak-$$
+
+rounds=$(( (cycles + batch - 1) / batch ))
+[ "$rounds" -gt "$warmup" ] || { echo "need more than $warmup rounds of $batch viewers"; exit 1; }
+
+GST_TRACERS=leaks GST_DEBUG="${GST_DEBUG:+$GST_DEBUG,}GST_TRACER:7" \
+    "$bin" --test-source --server="$server" --room="$room" --max-viewers="$batch" "$@" >"$log" 2>&1 &
+pid=$!
+trap 'kill "$pid" 2>/dev/null' EXIT INT TERM
+sleep 2
+kill -0 "$pid" 2>/dev/null || { echo "sender did not start, see $log"; exit 1; }
+
+sample() {
+    rss=$(awk '/^VmRSS:/ { print int($2 / 1024) }' "/proc/$pid/status")
+    threads=$(awk '/^Threads:/ { print $2 }' "/proc/$pid/status")
+    fds=$(ls "/proc/$pid/fd" | wc -l)
+}
+
+echo "Soak: $rounds rounds of $batch viewers against $bin (pid $pid), log in $log"
+echo "round,cycles,seconds,rss_mb,fds,threads" >"$csv"
+start=$(date +%s)
+round=0
+while [ "$round" -lt "$rounds" ]; do
+    "$loadgen" --server="$server" --room="$room" --viewers="$batch" --rate="$rate" --hold="$hold" >/dev/null 2>&1
+    # Let the sender finish tearing the sessions down
+    sleep 1
+    kill -0 "$pid" 2>/dev/null || { echo "sender died in round $((round + 1)), see $log"; exit 1; }
+    round=$((round + 1))
+    sample
+    echo "$round,$((round * batch)),$(( $(date +%s) - start )),$rss,$fds,$threads" >>"$csv"
+    if [ "$round" -eq "$warmup" ]; then
+        base_rss=$rss; base_fds=$fds; base_threads=$threads
+        echo "baseline after $round rounds: rss $rss MB, $fds fds, $threads threads"
+    elif [ $((round % 10)) -eq 0 ] || [ "$round" -eq "$rounds" ]; then
+        echo "round $round ($((round * batch)) cycles): rss $rss MB, $fds fds, $threads threads"
+    fi
+done
+
+# Clean exit makes gst_deinit() run the leaks tracer
+kill -INT "$pid"
+wait "$pid"
+trap - EXIT INT TERM
+
+fail=0
+check() {
+    if [ "$2" -gt "$3" ]; then echo "FAIL: $1 grew by $2 (limit $3)"; fail=1; else echo "ok:   $1 grew by $2"; fi
+}
+check "rss MB" $((rss - base_rss)) "$max_rss_mb"
+check "fds" $((fds - base_fds)) "$max_fds"
+check "threads" $((threads - base_threads)) "$max_threads"
+
+# object-alive, type-name=(string)GstPad, address=...
+alive=$(grep 'object-alive' "$log" | sed -n 's/.*type-name=(string)\([^,]*\),.*/\1/p' | sort | uniq -c | sort -rn)
+if [ -n "$alive" ]; then
+    echo "alive at exit:"
+    echo "$alive" | head -15
+    if echo "$alive" | awk -v n="$rounds" '$1 >= n { found = 1 } END { exit !found }'; then
+        echo "FAIL: objects alive in proportion to the session count"
+        fail=1
+    fi
+else
+    echo "ok:   no objects alive at exit"
+fi
+exit $fail
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Cold-start benchmark for the sender's pipeline.
+# Runs `gpt --bench-startup` N times and prints the median of each phase from
+# its "startup:" line: gst_init, registry (factory lookup + plugin load), DTLS
+# certificate generation, pipeline build, PLAYING, first encoded frame and
+# first RTP packet.
+#
+#   bench/startup.sh [runs] [extra gpt options...]
+#
+# Drop the page cache between runs (echo 3 > /proc/sys/vm/drop_caches as root)
+# to measure a true cold start; otherwise this is a warm-cache number.
+runs=${1:-10}
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+
+i=0
+while [ "$i" -lt "$runs" ]; do
+    timeout 30 "$bin" --bench-startup "$@" 2>/dev/null | grep '^startup:'
+    i=$((i + 1))
+done | awk '
+BEGIN { n = 0 }
+{
+    # startup: init A, registry B, dtls C, build D, playing E, first-frame F, first-rtp G ms (total H ms)
+    gsub(/[(),]/, " ")
+    for (i = 2; i < NF; i++) if ($(i + 1) ~ /^[0-9.]+$/) { v[$i, n] = $(i + 1) }
+    n++
+}
+function median(name,   a, k, t, j) {
+    for (k = 0; k < n; k++) a[k] = v[name, k]
+    for (k = 1; k < n; k++) { t = a[k]; for (j = k - 1; j >= 0 && a[j] > t; j--) a[j + 1] = a[j]; a[j + 1] = t }
+    return n % 2 ? a[int(n / 2)] : (a[n / 2 - 1] + a[n / 2]) / 2
+}
+END {
+    if (n == 0) { print "no startup lines (is the camera available?)"; exit 1 }
+    printf "runs: %d\n", n
+    split("init registry dtls build playing first-frame first-rtp total", order, " ")
+    for (k = 1; k <= 8; k++) printf "  %-12s %8.1f ms (median)\n", order[k], median(order[k])
+}'
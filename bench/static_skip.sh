@@ -0,0 +1,44 @@
+#!/bin/sh
+# Bitrate and encoder CPU saved by --skip-static on a static scene. Replays
+# CLIP (a .y4m recording from a camera watching a still scene) once with every
+# frame encoded and once per threshold, and prints the bitrate, encoded frame
+# count and the sender's CPU time for each run, plus the skip stats.
+# Without CLIP a still SMPTE pattern is recorded with videotestsrc; it has no
+# sensor noise, so it shows the upper bound of the saving, not a real camera.
+#
+#   bench/static_skip.sh [seconds] [extra gpt options...]
+#   CLIP=lobby_720p.y4m THRESHOLDS="2 4 8" bench/static_skip.sh 30
+secs=${1:-20}
+[ $# -gt 0 ] && shift
+bin=${GPT:-./gpt}
+clip=${CLIP:-static.y4m}
+thresholds=${THRESHOLDS:-4}
+hz=$(getconf CLK_TCK)
+
+if [ ! -f "$clip" ]; then
+    gst-launch-1.0 -q videotestsrc pattern=smpte num-buffers=300 ! \
+        video/x-raw,format=I420,width=1280,height=720,framerate=30/1 ! y4menc ! filesink location="$clip" ||
+        { echo "could not record $clip"; exit 1; }
+fi
+
+base=
+for skip in 0 $thresholds; do
+    log=static-skip-$skip.log
+    "$bin" --source=replay --input="$clip" --skip-static="$skip" --bench-profile="$secs" "$@" >"$log" 2>&1 &
+    pid=$!
+    # utime + stime just before exit; the command name may hold spaces, so count from the ')'
+    ticks=0
+    while kill -0 "$pid" 2>/dev/null; do
+        t=$(sed 's/.*) //' "/proc/$pid/stat" 2>/dev/null | awk '{ print $12 + $13 }')
+        [ -n "$t" ] && ticks=$t
+        sleep 0.5
+    done
+    wait "$pid"
+    kbps=$(sed -n 's/^profile .* bitrate \([0-9]*\) kbps.*/\1/p' "$log")
+    frames=$(sed -n 's/^profile .* frames: \([0-9]*\),.*/\1/p' "$log")
+    [ -n "$kbps" ] || { echo "skip-static=$skip: no result, see $log"; continue; }
+    [ -n "$base" ] || base=$kbps
+    echo "skip-static=$skip: $kbps kbps ($(awk -v b="$base" -v k="$kbps" 'BEGIN { printf "%.0f", b ? 100 * (b - k) / b : 0 }')% saved)," \
+        "$frames frames encoded, cpu $(awk -v t="$ticks" -v hz="$hz" 'BEGIN { printf "%.1f", t / hz }') s"
+    grep '^static skip' "$log"
+done
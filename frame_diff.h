@@ -0,0 +1,80 @@
+// Block-wise frame difference for static-scene skipping: sum of absolute
+// differences over 16x16 luma blocks, with NEON and SSE2 paths and a scalar
+// fallback. Shared by gpt_sender.cpp and bench/sad_bench.cpp.
+#ifndef FRAME_DIFF_H
+#define FRAME_DIFF_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FRAME_DIFF_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FRAME_DIFF_SSE2 1
+#endif
+
+#define FRAME_DIFF_BLOCK 16
+
+static inline uint32_t block_sad_16x16_scalar(const uint8_t *a, int stride_a, const uint8_t *b, int stride_b) {
+    uint32_t sad = 0;
+    for (int y = 0; y < FRAME_DIFF_BLOCK; y++, a += stride_a, b += stride_b)
+        for (int x = 0; x < FRAME_DIFF_BLOCK; x++) sad += (uint32_t)abs(a[x] - b[x]);
+    return sad;
+}
+
+#if FRAME_DIFF_NEON
+static inline uint32_t block_sad_16x16_simd(const uint8_t *a, int stride_a, const uint8_t *b, int stride_b) {
+    // 16 rows of at most 255 per lane pair fit in u16
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (int y = 0; y < FRAME_DIFF_BLOCK; y++, a += stride_a, b += stride_b)
+        acc = vpadalq_u8(acc, vabdq_u8(vld1q_u8(a), vld1q_u8(b)));
+#if defined(__aarch64__)
+    return vaddvq_u16(acc);
+#else
+    uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(acc));
+    return (uint32_t)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#endif
+}
+#elif FRAME_DIFF_SSE2
+static inline uint32_t block_sad_16x16_simd(const uint8_t *a, int stride_a, const uint8_t *b, int stride_b) {
+    __m128i acc = _mm_setzero_si128();
+    for (int y = 0; y < FRAME_DIFF_BLOCK; y++, a += stride_a, b += stride_b)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b)));
+    return (uint32_t)(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+}
+#else
+#define block_sad_16x16_simd block_sad_16x16_scalar
+#endif
+
+static inline const char *frame_diff_kernel_name() {
+#if FRAME_DIFF_NEON
+    return "neon";
+#elif FRAME_DIFF_SSE2
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+// Largest block SAD between two planes, stopping early once a block reaches
+// stop_at (the caller's "changed" threshold). Only whole blocks are compared;
+// a right/bottom strip narrower than a block is ignored.
+typedef uint32_t (*BlockSadFn)(const uint8_t *, int, const uint8_t *, int);
+
+static inline uint32_t max_block_sad(BlockSadFn sad, const uint8_t *a, int stride_a, const uint8_t *b, int stride_b,
+                                     int width, int height, uint32_t stop_at) {
+    uint32_t max = 0;
+    for (int y = 0; y + FRAME_DIFF_BLOCK <= height; y += FRAME_DIFF_BLOCK) {
+        const uint8_t *ra = a + (size_t)y * stride_a, *rb = b + (size_t)y * stride_b;
+        for (int x = 0; x + FRAME_DIFF_BLOCK <= width; x += FRAME_DIFF_BLOCK) {
+            uint32_t s = sad(ra + x, stride_a, rb + x, stride_b);
+            if (s > max) max = s;
+            if (max >= stop_at) return max;
+        }
+    }
+    return max;
+}
+
+#endif // FRAME_DIFF_H
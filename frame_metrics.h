@@ -0,0 +1,145 @@
+// PSNR and SSIM between two 8-bit planes for --bench-quality, with the SIMD
+// selection of frame_diff.h (NEON, SSE2 or scalar). SSIM uses 8x8 windows on
+// an 8-pixel grid with flat weights and the usual constants, which is enough
+// to compare runs with each other but not numerically the reference SSIM.
+#ifndef FRAME_METRICS_H
+#define FRAME_METRICS_H
+
+#include <math.h>
+
+#include "frame_diff.h"
+
+typedef struct { uint32_t sum_a, sum_b, sum_sq, sum_ab; } SsimWindow;     // sum_sq is a^2 + b^2
+
+static inline uint64_t row_sse_scalar(const uint8_t *a, const uint8_t *b, int n) {
+    uint64_t sse = 0;
+    for (int x = 0; x < n; x++) { int d = a[x] - b[x]; sse += (uint32_t)(d * d); }
+    return sse;
+}
+
+static inline void ssim_window_scalar(const uint8_t *a, int stride_a, const uint8_t *b, int stride_b, SsimWindow *w) {
+    SsimWindow s = { 0, 0, 0, 0 };
+    for (int y = 0; y < 8; y++, a += stride_a, b += stride_b)
+        for (int x = 0; x < 8; x++) {
+            s.sum_a += a[x]; s.sum_b += b[x];
+            s.sum_sq += a[x] * a[x] + b[x] * b[x];
+            s.sum_ab += a[x] * b[x];
+        }
+    *w = s;
+}
+
+// Per-lane sums stay within 32 bits for rows up to 8192 pixels.
+#if FRAME_DIFF_NEON
+static inline uint32_t sum_u32x4(uint32x4_t v) {
+#if defined(__aarch64__)
+    return vaddvq_u32(v);
+#else
+    uint64x2_t s = vpaddlq_u32(v);
+    return (uint32_t)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+#endif
+}
+
+static inline uint64_t row_sse_simd(const uint8_t *a, const uint8_t *b, int n) {
+    uint32x4_t acc = vdupq_n_u32(0);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        uint8x16_t d = vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x));
+        acc = vpadalq_u16(acc, vmull_u8(vget_low_u8(d), vget_low_u8(d)));
+        acc = vpadalq_u16(acc, vmull_u8(vget_high_u8(d), vget_high_u8(d)));
+    }
+    return sum_u32x4(acc) + row_sse_scalar(a + x, b + x, n - x);
+}
+
+static inline void ssim_window_simd(const uint8_t *a, int stride_a, const uint8_t *b, int stride_b, SsimWindow *w) {
+    uint16x8_t sa = vdupq_n_u16(0), sb = vdupq_n_u16(0);
+    uint32x4_t sq = vdupq_n_u32(0), ab = vdupq_n_u32(0);
+    for (int y = 0; y < 8; y++, a += stride_a, b += stride_b) {
+        uint8x8_t va = vld1_u8(a), vb = vld1_u8(b);
+        sa = vaddw_u8(sa, va);
+        sb = vaddw_u8(sb, vb);
+        sq = vpadalq_u16(sq, vmull_u8(va, va));
+        sq = vpadalq_u16(sq, vmull_u8(vb, vb));
+        ab = vpadalq_u16(ab, vmull_u8(va, vb));
+    }
+    w->sum_a = sum_u32x4(vpaddlq_u16(sa));
+    w->sum_b = sum_u32x4(vpaddlq_u16(sb));
+    w->sum_sq = sum_u32x4(sq);
+    w->sum_ab = sum_u32x4(ab);
+}
+#elif FRAME_DIFF_SSE2
+static inline uint32_t sum_epi32(__m128i v) {
+    v = _mm_add_epi32(v, _mm_srli_si128(v, 8));
+    v = _mm_add_epi32(v, _mm_srli_si128(v, 4));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+static inline uint64_t row_sse_simd(const uint8_t *a, const uint8_t *b, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + x)), vb = _mm_loadu_si128((const __m128i *)(b + x));
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+        acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+    return sum_epi32(acc) + row_sse_scalar(a + x, b + x, n - x);
+}
+
+static inline void ssim_window_simd(const uint8_t *a, int stride_a, const uint8_t *b, int stride_b, SsimWindow *w) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sad_a = zero, sad_b = zero, sq = zero, ab = zero;
+    for (int y = 0; y < 8; y++, a += stride_a, b += stride_b) {
+        __m128i va = _mm_loadl_epi64((const __m128i *)a), vb = _mm_loadl_epi64((const __m128i *)b);
+        sad_a = _mm_add_epi64(sad_a, _mm_sad_epu8(va, zero));
+        sad_b = _mm_add_epi64(sad_b, _mm_sad_epu8(vb, zero));
+        __m128i a16 = _mm_unpacklo_epi8(va, zero), b16 = _mm_unpacklo_epi8(vb, zero);
+        sq = _mm_add_epi32(sq, _mm_add_epi32(_mm_madd_epi16(a16, a16), _mm_madd_epi16(b16, b16)));
+        ab = _mm_add_epi32(ab, _mm_madd_epi16(a16, b16));
+    }
+    w->sum_a = (uint32_t)_mm_cvtsi128_si32(sad_a);
+    w->sum_b = (uint32_t)_mm_cvtsi128_si32(sad_b);
+    w->sum_sq = sum_epi32(sq);
+    w->sum_ab = sum_epi32(ab);
+}
+#else
+#define row_sse_simd row_sse_scalar
+#define ssim_window_simd ssim_window_scalar
+#endif
+
+typedef uint64_t (*RowSseFn)(const uint8_t *, const uint8_t *, int);
+typedef void (*SsimWindowFn)(const uint8_t *, int, const uint8_t *, int, SsimWindow *);
+
+static inline uint64_t plane_sse(RowSseFn sse, const uint8_t *a, int stride_a, const uint8_t *b, int stride_b,
+                                 int width, int height) {
+    uint64_t total = 0;
+    for (int y = 0; y < height; y++) total += sse(a + (size_t)y * stride_a, b + (size_t)y * stride_b, width);
+    return total;
+}
+
+// 10 log10(255^2 / MSE), capped at 100 dB for identical planes
+static inline double psnr_from_sse(uint64_t sse, uint64_t samples) {
+    if (!sse) return 100.0;
+    return fmin(100.0, 10.0 * log10(255.0 * 255.0 * (double)samples / (double)sse));
+}
+
+// Mean SSIM over whole 8x8 windows; a right/bottom strip narrower than 8 is left out.
+static inline double plane_ssim(SsimWindowFn window, const uint8_t *a, int stride_a, const uint8_t *b, int stride_b,
+                                int width, int height) {
+    const double c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+    double total = 0;
+    long n = 0;
+    for (int y = 0; y + 8 <= height; y += 8) {
+        for (int x = 0; x + 8 <= width; x += 8, n++) {
+            SsimWindow s;
+            window(a + (size_t)y * stride_a + x, stride_a, b + (size_t)y * stride_b + x, stride_b, &s);
+            double mu_a = s.sum_a / 64.0, mu_b = s.sum_b / 64.0;
+            double var = s.sum_sq / 64.0 - mu_a * mu_a - mu_b * mu_b;     // var_a + var_b
+            double cov = s.sum_ab / 64.0 - mu_a * mu_b;
+            total += (2 * mu_a * mu_b + c1) * (2 * cov + c2) / ((mu_a * mu_a + mu_b * mu_b + c1) * (var + c2));
+        }
+    }
+    return n ? total / n : 1.0;
+}
+
+#endif // FRAME_METRICS_H
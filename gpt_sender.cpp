@@ -0,0 +1,4788 @@
+#define GST_USE_UNSTABLE_API
+
+#include <gst/gst.h>
+#include <gst/webrtc/webrtc.h>
+#include <gst/sdp/sdp.h>
+#include <gst/video/video.h>
+#include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
+#include <glib/gstdio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <string.h>
+#include <iostream>
+#include <getopt.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/random.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "gpt_sender.h"
+#include "frame_diff.h"
+#include "frame_metrics.h"
+
+// ===================== Config =====================
+struct Config {
+    gchar *codec;
+    gint bitrate;
+    gint fps;
+    gint width;
+    gint height;
+    gchar *device;
+    gint max_viewers;
+    gint ice_grace_ms;
+    gint negotiation_timeout_ms;
+    gboolean bench_startup;
+    gboolean dtls_prewarm;
+    gint dtls_rotate_hours;         // new certificate for new sessions this often, 0 = never
+    gint pool_size;
+    gchar *profile;
+    gchar *encoder;
+    gint gop;
+    gchar *intra_refresh;
+    gint max_frame_kb;
+    gint keyframe_interval_ms;
+    gint max_bitrate;               // kbps ceiling for bandwidth estimation, 0 = bitrate
+    gint bwe_probe_ms;              // probing window after connect, 0 = off
+    gchar *codecs;                  // offered video codecs in preference order, NULL = all available
+    gchar *server;                  // signaling WebSocket URL
+    gchar *room;                    // signaling room; viewers in other rooms never see our offers
+    gchar *source;                  // v4l2, test, file, rtsp, uvc-h264, replay or app
+    gchar *input;                   // file path, rtsp:// URL or replay clip
+    gchar *replay_load;             // memory or mmap
+    gchar *app_format;              // raw format of frames pushed through gpt_sender_push_frame()
+    gint bench_seconds;
+    gboolean bench_quality;         // decode the bench encoder's RTP and score it against the replay clip
+    gboolean bench_encoders;        // compare the backends for --codec and record the fastest
+    gchar *multicast_group;         // LAN multicast output, NULL = off
+    gint multicast_port;            // video; audio on the next even port
+    gint multicast_ttl;
+    gchar *multicast_iface;         // NULL = the routing table's choice
+    gchar *multicast_sdp;           // SDP file to write, NULL = none
+    gint multicast_http_port;       // serves /stream.sdp, 0 = off
+    gboolean multicast_srtp;        // SRTP with a per-run key carried in the SDP
+    gint multicast_idr_ms;          // keyframe request period, 0 = off
+    gint idle_suspend_ms;           // capture suspends this long after the last viewer, 0 = never
+    gchar *cpus[4];                 // per ThreadClass CPU list ("2", "0-1,3"), NULL = unpinned
+    gint rt_priority;               // SCHED_FIFO for capture (and encode one below), 0 = off
+    gint network_nice;              // nice level of session / webrtcbin threads
+    gint skip_static;               // mean per-pixel block change below which a frame is dropped, 0 = off
+    gint skip_min_fps;              // frames still passed per second in a static scene
+};
+
+// ===================== Sessions =====================
+// Negotiation is driven by the sender: every phase below has a deadline
+// (negotiation_timeout_ms) and a timed-out or failed phase retries the offer.
+enum NegotiationState {
+    NEG_IDLE,
+    NEG_CREATING_OFFER,             // create-offer emitted
+    NEG_SETTING_LOCAL,              // set-local-description emitted
+    NEG_AWAITING_ANSWER,            // offer sent to the viewer
+    NEG_SETTING_REMOTE,             // set-remote-description emitted
+    NEG_CONNECTING,                 // waiting for ICE and DTLS
+    NEG_CONNECTED,
+};
+
+static const char *neg_state_names[] = {
+    "idle", "creating-offer", "setting-local", "awaiting-answer", "setting-remote", "connecting", "connected"
+};
+
+struct CodecInfo;
+struct EncodeChain;
+
+// One PeerSession per viewer. Each owns a queue ! webrtcbin branch hanging off
+// the shared encoder tee of the codec it negotiated and its own GMainContext; its negotiation runs on a
+// worker thread from session_pool, so a slow viewer only stalls itself.
+// The WebSocket stays on the default context: sessions receive through their
+// inbox and send through ws_outbox.
+// Pre-warmed sessions wait in warm_pool with their offer already set as local
+// description and candidates gathered; a request-offer claims one and renames it.
+struct PeerSession {
+    gint refcount;
+    gchar *id;                      // viewer id (pool-N until claimed); session context only
+    GMainContext *context;
+    GMainLoop *loop;
+    GAsyncQueue *inbox;             // InboxMessage*, filled on the WebSocket thread
+    GstElement *webrtc;
+    GstElement *vqueue;             // linked to the tee of its codec's encoder once answered
+    GstElement *aqueue;
+    gboolean closed;
+    gint media_up;                  // reached NEG_CONNECTED once; atomic, read when routing
+    const CodecInfo *answer_codec;  // video codec the last answer picked
+    EncodeChain *chain;             // encoder it is attached to; written under sessions_lock
+
+    NegotiationState neg_state;
+    guint neg_generation;           // bumped per offer; replies from older offers are dropped
+    guint neg_retries;
+    GSource *neg_timer;             // deadline of the current phase
+    gboolean neg_ice_restart;       // current offer carries ice-restart
+    gboolean have_remote;           // an answer has been applied at least once
+    gchar *local_sdp;               // offer text, sent once set-local-description succeeded
+
+    // Phase timestamps of the current offer (monotonic us, 0 = not reached)
+    gint64 t_request;               // request-offer arrival on the WebSocket thread
+    gint64 t_attempt;               // create-offer emitted
+    gint64 t_offer_created;
+    gint64 t_local_set;             // offer sent
+    gint64 t_answer;
+    gint64 t_remote_set;
+    gint64 t_ice_connected;
+    gint64 t_dtls_connected;
+    GSource *ice_timer;             // DISCONNECTED grace period, then ICE restart deadline
+    gint64 t_disconnected;          // 0 while connected
+    gboolean ice_restarting;
+
+    gboolean from_pool;             // pre-warmed and not yet claimed by its first request-offer
+    gboolean pooled;                // still waiting in warm_pool; guarded by sessions_lock
+    gboolean warm_claim;            // the current offer was prepared before the viewer asked
+    GPtrArray *held_candidates;     // JsonObject*, local candidates waiting for the offer to go out
+    gint64 t_offer_sent;            // first offer sent after the viewer's request-offer
+
+    GstWebRTCDataChannel *control;  // reliable, ordered: viewer commands and their replies
+    GstWebRTCDataChannel *telemetry;    // unordered, no retransmits: periodic sender stats
+    GSource *telemetry_timer;
+    gint bitrate_hint_kbps;         // viewer's requested ceiling, 0 = none; guarded by sessions_lock
+
+    GstElement *bwe;                // rtpgccbwe aux sender, NULL without bandwidth estimation
+    gint bwe_kbps;                  // latest estimate, written on streaming threads
+    gint bwe_ceiling_kbps;          // estimate applied to the encoder, 0 = still probing; guarded by sessions_lock
+    GSource *probe_timer;
+    gint64 t_probe_start;           // connect time; probing and stability are measured from here
+    gint64 t_stable_since;
+    gint stable_ref_kbps;
+    gboolean bwe_stable_reported;
+};
+
+struct InboxMessage {
+    JsonNode *node;
+    gint64 received;                // monotonic us, stamped on the WebSocket thread
+};
+
+// ===================== Globals =====================
+static struct Config config;
+static GstElement *pipeline = NULL;
+static GstElement *audio_tee = NULL;
+static GstElement *audio_src = NULL;        // owned by the pipeline
+static gboolean bwe_available = FALSE;      // rtpgccbwe present and probing enabled
+static GMainLoop *loop = NULL;
+static SoupWebsocketConnection *ws_conn = NULL;
+static SoupSession *soup_session = NULL;
+static gchar *my_id = NULL;                 // kept across reconnects so viewers can still reach us
+static gchar *my_token = NULL;              // resume token the server issued with my_id
+static guint ws_reconnect_id = 0;
+static guint ws_backoff_ms = 0;
+static gboolean ws_stopping = FALSE;
+
+static GHashTable *sessions = NULL;        // viewer id -> PeerSession*, guarded by sessions_lock
+static GMutex sessions_lock;
+static GQueue warm_pool = G_QUEUE_INIT;    // idle pre-warmed PeerSession*, guarded by sessions_lock
+static guint warm_pool_seq = 0;
+static gboolean warm_pool_enabled = FALSE;
+static GThreadPool *session_pool = NULL;
+static GAsyncQueue *ws_outbox = NULL;      // gchar* JSON text, drained on the default context
+static gint ws_flush_scheduled = 0;
+
+static const gchar *default_server_url = "ws://192.168.25.69:8080";
+static const guint ice_restart_timeout_ms = 10000;
+static const guint negotiation_max_retries = 2;
+static const guint ws_backoff_min_ms = 500;
+static const guint ws_backoff_max_ms = 30000;
+static const guint warm_pool_max_idle_ms = 300000;    // recycle before STUN bindings go stale
+static const guint telemetry_interval_ms = 500;
+static const gchar *twcc_extension_uri = "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01";
+static const gint bwe_min_kbps = 150;
+static const guint bwe_stable_ms = 1000;    // estimate within 10% for this long = stable
+
+// join-to-offer latency histogram: request-offer arrival to the offer leaving
+static const guint join_hist_bounds_ms[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+static gint join_hist[G_N_ELEMENTS(join_hist_bounds_ms) + 1];
+
+// ===================== Decls =====================
+static void force_renegotiate(PeerSession *s, gboolean ice_restart);
+static void set_neg_state(PeerSession *s, NegotiationState st);
+static void check_connected(PeerSession *s);
+static void cancel_neg_timer(PeerSession *s);
+static void apply_answer(PeerSession *s, const gchar *sdp_text, gint64 received);
+static void on_negotiation_needed(GstElement *element, gpointer user_data);
+static void on_ice_candidate(GstElement *webrtc, guint mlineindex, gchar *candidate, gpointer user_data);
+static void send_ice_candidate_message(PeerSession *s, JsonObject *ice);
+static void handle_local_candidate(PeerSession *s, JsonObject *ice);
+static void on_incoming_stream(GstElement *webrtc, GstPad *pad, gpointer user_data);
+static gboolean on_bus_message(GstBus *bus, GstMessage *message, gpointer user_data);
+static gboolean build_and_start_pipeline();
+static void stop_and_destroy_pipeline();
+static void end_session(PeerSession *s);
+static void end_all_sessions();
+static void refill_warm_pool();
+static gboolean drain_session_inbox(gpointer data);
+static gboolean on_warm_idle_expired(gpointer data);
+static void send_offer(PeerSession *s);
+static void connect_signaling();
+static void open_data_channels(PeerSession *s);
+static void close_data_channels(PeerSession *s);
+static void handle_control_message(PeerSession *s, JsonObject *object);
+static gboolean link_tee_to(GstElement *tee, GstElement *queue);
+static void unlink_from_tee(GstElement *tee, GstElement *queue);
+static void detach_from_encoder(PeerSession *s);
+static GstElement *on_request_aux_sender(GstElement *webrtc, GstWebRTCDTLSTransport *dtls, gpointer user_data);
+static void start_bwe_probe(PeerSession *s);
+static void stop_bwe(PeerSession *s);
+static void arm_first_buffer_probes(EncodeChain *c);
+static void collect_capture_elements(GPtrArray *out);
+static void reset_file_loop();
+
+static gdouble ms_since(gint64 t0, gint64 t1) { return (t1 - t0) / 1000.0; }
+
+// ===================== Utils: signaling =====================
+// Runs on the default context; the only place that touches ws_conn for sending.
+// While reconnecting, messages stay queued and go out once the socket is back.
+static gboolean flush_ws_outbox(gpointer /*user_data*/) {
+    g_atomic_int_set(&ws_flush_scheduled, 0);
+    if (!ws_conn) return G_SOURCE_REMOVE;
+    gchar *text;
+    while ((text = (gchar *)g_async_queue_try_pop(ws_outbox))) {
+        g_print("[ws->] %s\n", text);
+        soup_websocket_connection_send_text(ws_conn, text);
+        g_free(text);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Thread-safe: callable from session workers and webrtcbin streaming threads.
+static void send_json_message(JsonObject *msg) {
+    JsonNode *root = json_node_new(JSON_NODE_OBJECT);
+    json_node_set_object(root, msg);
+    gchar *text = json_to_string(root, FALSE);
+    json_node_free(root);
+    g_async_queue_push(ws_outbox, text);
+    if (g_atomic_int_compare_and_exchange(&ws_flush_scheduled, 0, 1))
+        g_main_context_invoke(NULL, flush_ws_outbox, NULL);
+}
+
+// ===================== Session lifetime =====================
+static void inbox_message_free(gpointer data) {
+    InboxMessage *m = (InboxMessage *)data;
+    json_node_free(m->node);
+    g_free(m);
+}
+
+static PeerSession *peer_session_new(const gchar *id) {
+    PeerSession *s = g_new0(PeerSession, 1);
+    s->refcount = 1;
+    s->id = g_strdup(id);
+    s->context = g_main_context_new();
+    s->loop = g_main_loop_new(s->context, FALSE);
+    s->inbox = g_async_queue_new_full(inbox_message_free);
+    s->held_candidates = g_ptr_array_new_with_free_func((GDestroyNotify)json_object_unref);
+    return s;
+}
+
+static PeerSession *peer_session_ref(PeerSession *s) {
+    g_atomic_int_inc(&s->refcount);
+    return s;
+}
+
+static void peer_session_unref(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    if (!g_atomic_int_dec_and_test(&s->refcount)) return;
+    g_async_queue_unref(s->inbox);
+    g_ptr_array_unref(s->held_candidates);
+    g_main_loop_unref(s->loop);
+    g_main_context_unref(s->context);
+    g_free(s->local_sdp);
+    g_free(s->id);
+    g_free(s);
+}
+
+// Schedule func on the session's own context; the session stays alive until it ran.
+static void session_invoke(PeerSession *s, GSourceFunc func) {
+    g_main_context_invoke_full(s->context, G_PRIORITY_DEFAULT, func,
+                               peer_session_ref(s), peer_session_unref);
+}
+
+static gboolean session_quit(gpointer data) {
+    g_main_loop_quit(((PeerSession *)data)->loop);
+    return G_SOURCE_REMOVE;
+}
+
+// Any thread: queue a message for the session and wake its context.
+static void session_post(PeerSession *s, JsonNode *node, gint64 received) {
+    InboxMessage *m = g_new0(InboxMessage, 1);
+    m->node = node;
+    m->received = received;
+    g_async_queue_push(s->inbox, m);
+    session_invoke(s, drain_session_inbox);
+}
+
+// ----- join-to-offer histogram -----
+static void record_join_to_offer(gint64 us) {
+    guint i = 0;
+    while (i < G_N_ELEMENTS(join_hist_bounds_ms) && us >= (gint64)join_hist_bounds_ms[i] * 1000) i++;
+    g_atomic_int_inc(&join_hist[i]);
+}
+
+static void print_join_histogram() {
+    g_print("join-to-offer latency:\n");
+    for (guint i = 0; i <= G_N_ELEMENTS(join_hist_bounds_ms); i++) {
+        gint n = g_atomic_int_get(&join_hist[i]);
+        if (i < G_N_ELEMENTS(join_hist_bounds_ms)) g_print("  < %4u ms: %d\n", join_hist_bounds_ms[i], n);
+        else g_print("  >=%4u ms: %d\n", join_hist_bounds_ms[i - 1], n);
+    }
+}
+
+// ===================== Latency profiles =====================
+// Every latency-related knob of the chain, set together. balanced is what the
+// sender always did; the others trade bitrate efficiency against delay.
+struct LatencyProfile {
+    const char *name;
+    gboolean do_timestamp;          // stamp frames at capture time
+    gint queue_buffers;             // capture -> encoder queue
+    guint session_queue_ms;         // per-viewer queue bound, 0 = queue default (1 s)
+    const char *control_rate;       // omx: 1 variable, 2 constant
+    gint gop_seconds;               // IDR interval, 0 = encoder default
+    gint mtu;
+    const char *aggregate_mode;     // rtph26xpay: zero-latency, none, max-stap
+    guint webrtc_latency_ms;        // webrtcbin jitterbuffer
+};
+
+static const LatencyProfile latency_profiles[] = {
+    { "ultra-low-latency", TRUE,  1, 100, "2", 1, 1200, "zero-latency", 20 },
+    { "balanced",          FALSE, 3,   0, "2", 0, 1400, "none",         100 },
+    { "quality",           FALSE, 5,   0, "1", 4, 1400, "max-stap",     200 },
+};
+
+static const LatencyProfile *find_latency_profile(const gchar *name) {
+    for (const LatencyProfile &p : latency_profiles)
+        if (g_strcmp0(p.name, name) == 0) return &p;
+    return NULL;
+}
+
+// Encoder and payloader properties differ between OMX targets and GStreamer releases.
+static void set_prop_if_present(GstElement *e, const gchar *prop, const gchar *value) {
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(e), prop)) {
+        g_print("%s has no '%s', leaving it at its default\n", GST_ELEMENT_NAME(e), prop);
+        return;
+    }
+    gst_util_set_object_arg(G_OBJECT(e), prop, value);
+}
+
+static void set_int_prop_if_present(GstElement *e, const gchar *prop, gint value) {
+    gchar buf[16];
+    g_snprintf(buf, sizeof(buf), "%d", value);
+    set_prop_if_present(e, prop, buf);
+}
+
+// ===================== Pipeline build/start/stop =====================
+// Shared capture/encode part only; viewers attach to the tees at runtime. The
+// pipeline is built from a typed description with element factories resolved
+// once, so a restart costs state changes rather than a parse and registry lookups.
+// Capture runs into rawtee; each video codec in use has one encoder hanging off
+// it, started by its first viewer and stopped with its last.
+struct EncoderBackend;
+
+// Where video comes from. Raw sources are encoded per codec. Compressed ones
+// (H.264/H.265 already) are parsed and payloaded as they are for viewers of
+// that codec, and only decoded while some viewer needs another codec.
+struct SourceKind {
+    const char *name;               // --source value
+    const char *element;
+    gboolean compressed;
+};
+
+static const SourceKind source_kinds[] = {
+    { "v4l2",     "v4l2src",      FALSE },
+    { "test",     "videotestsrc", FALSE },
+    { "file",     "filesrc",      TRUE },
+    { "rtsp",     "rtspsrc",      TRUE },
+    { "uvc-h264", "v4l2src",      TRUE },
+    { "replay",   "appsrc",       FALSE },
+    { "app",      "appsrc",       FALSE },
+};
+
+static const SourceKind *find_source_kind(const gchar *name) {
+    for (const SourceKind &k : source_kinds)
+        if (g_strcmp0(k.name, name) == 0) return &k;
+    return NULL;
+}
+
+struct PipelineDesc {
+    std::string codec;              // preferred codec, the one benchmarks encode and compressed sources carry
+    const SourceKind *source;
+    std::string input;              // file / rtsp / replay
+    std::string device;             // v4l2 / uvc-h264
+    const LatencyProfile *profile;
+    const EncoderBackend *encoder;
+    gint width, height, fps;
+    gint bitrate;                   // kbps
+    gint gop;                       // frames between IDRs, 0 = profile / encoder default
+    std::string intra_refresh;      // off, columns or rows
+    gint max_frame_kb;              // per-frame size cap, 0 = none
+};
+
+// Capture elements; reused across restarts. Raw sources run
+//   src ! srccaps ! convert ! rawtee
+// and compressed ones
+//   src [! srccaps | ! demux] ! parse [! pace] ! ctee
+// with a transcode branch, ctee ! dqueue ! decode ! convert ! rawtee, that
+// only exists while an encoder hangs off rawtee.
+struct VideoChain {
+    GstElement *src, *srccaps, *demux, *parse, *pace, *ctee;
+    GstElement *dqueue, *decode, *convert, *rawtee;
+};
+
+// An RTP video codec the sender can offer. H.264/H.265 encode on the encoder
+// backend; the others only have software encoders. Payload types are fixed so
+// one encoder's packets fit every viewer that picked the codec.
+struct CodecInfo {
+    const char *name;               // --codec / --codecs value
+    const char *encoding_name;
+    gint payload;
+    const char *enc_caps;           // encoder output
+    const char *fmtp;               // extra offer fields, NULL = none
+    const char *sw_encoder;         // NULL = from the encoder backend
+    const char *parser;             // NULL = none needed
+    const char *payloader;
+    void (*configure)(GstElement *enc, const PipelineDesc &d);     // NULL = backend's
+    void (*set_bitrate)(GstElement *enc, gint kbps);
+};
+
+// rawtee ! queue ! enc ! capsfilter ! [parse !] pay ! capsfilter ! tee, shared by
+// every viewer of the codec. Elements are NULL while stopped; the struct itself
+// lives for the whole process, so deferred callbacks may still look at it.
+struct EncodeChain {
+    const CodecInfo *codec;
+    GstElement *queue, *enc, *enccaps, *parse, *pay, *rtpcaps, *tee;
+    gint viewers;                   // guarded by encoders_lock
+    gint kbps;                      // rate set on the encoder
+    gint frames, keyframes;         // out of the encoder, counted on streaming threads
+    gint64 kf_last_forwarded;       // keyframe gate, guarded by kf_lock
+    guint kf_pending_id;
+};
+
+// Monotonic us; first_frame/first_rtp are set from streaming threads.
+struct StartupTimes { gint64 start, init, registry, dtls, built, playing, first_frame, first_rtp; };
+
+static PipelineDesc current_desc;
+static VideoChain vchain;
+static GMutex encoders_lock;                // encode_chains elements and viewer counts
+static EncodeChain *bench_chain = NULL;     // held for --bench-startup / --bench-profile
+static GHashTable *factory_cache = NULL;    // factory name -> loaded GstElementFactory*
+static StartupTimes startup;
+static gboolean startup_reported = FALSE;
+static guint pipeline_restarts = 0;
+static const guint pipeline_max_restarts = 3;
+
+// ===================== Thread placement =====================
+// Streaming threads are classified by the element that owns them: capture
+// (sources, parsers, the raw tee), encode (each encoder's queue, the
+// transcode branch, the audio encoder's queue) and network (session queues
+// and everything inside webrtcbin). A bus sync handler sees each thread's
+// STREAM_STATUS enter on the thread itself, and pins it to its class's CPU
+// list, with SCHED_FIFO for capture and encode or a nice level for network.
+// Session workers get the network placement too, so the threads webrtcbin
+// and libnice spawn from them inherit it.
+enum ThreadClass { THREAD_OTHER, THREAD_CAPTURE, THREAD_ENCODE, THREAD_NETWORK };
+
+static const char *thread_class_names[] = { "other", "capture", "encode", "network" };
+
+struct ThreadPlacement {
+    gboolean pinned;
+    cpu_set_t cpus;
+    gint fifo;                      // SCHED_FIFO priority, 0 = leave the policy alone
+    gint nice;                      // applied when fifo is 0 and this is not
+};
+
+static ThreadPlacement placements[G_N_ELEMENTS(thread_class_names)];
+static gboolean placement_enabled = FALSE;
+static gint threads_placed[G_N_ELEMENTS(thread_class_names)];
+static gint placement_warned = 0;
+
+// Elements that start threads carry their class; children find it on an ancestor.
+static void set_thread_class(GstElement *e, ThreadClass cls) {
+    if (e) g_object_set_data(G_OBJECT(e), "gpt-thread-class", GINT_TO_POINTER(cls));
+}
+
+static ThreadClass thread_class_of(GstObject *owner) {
+    ThreadClass cls = THREAD_OTHER;
+    GstObject *o = owner ? (GstObject *)gst_object_ref(owner) : NULL;
+    while (o && cls == THREAD_OTHER) {
+        cls = (ThreadClass)GPOINTER_TO_INT(g_object_get_data(G_OBJECT(o), "gpt-thread-class"));
+        GstObject *parent = gst_object_get_parent(o);
+        gst_object_unref(o);
+        o = parent;
+    }
+    if (o) gst_object_unref(o);
+    return cls;
+}
+
+// "0-1,3"
+static gboolean parse_cpu_list(const gchar *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    gchar **parts = g_strsplit(list, ",", -1);
+    gboolean ok = parts[0] != NULL;
+    for (gchar **p = parts; *p && ok; p++) {
+        gint lo, hi;
+        if (sscanf(*p, "%d-%d", &lo, &hi) == 2) ok = lo >= 0 && hi >= lo && hi < CPU_SETSIZE;
+        else if (sscanf(*p, "%d", &lo) == 1) { hi = lo; ok = lo >= 0 && lo < CPU_SETSIZE; }
+        else ok = FALSE;
+        for (gint cpu = lo; ok && cpu <= hi; cpu++) CPU_SET(cpu, set);
+    }
+    g_strfreev(parts);
+    return ok;
+}
+
+static gboolean init_thread_placement() {
+    for (guint i = 1; i < G_N_ELEMENTS(placements); i++) {
+        ThreadPlacement *p = &placements[i];
+        if (config.cpus[i]) {
+            if (!parse_cpu_list(config.cpus[i], &p->cpus)) {
+                g_printerr("Error: bad CPU list '%s' for %s threads\n", config.cpus[i], thread_class_names[i]);
+                return FALSE;
+            }
+            p->pinned = TRUE;
+        }
+    }
+    // Capture above encode, so a busy encoder never delays a frame coming in
+    if (config.rt_priority) {
+        placements[THREAD_CAPTURE].fifo = config.rt_priority;
+        placements[THREAD_ENCODE].fifo = MAX(1, config.rt_priority - 1);
+    }
+    placements[THREAD_NETWORK].nice = config.network_nice;
+    for (guint i = 1; i < G_N_ELEMENTS(placements); i++)
+        placement_enabled |= placements[i].pinned || placements[i].fifo || placements[i].nice;
+    return TRUE;
+}
+
+// On the thread being placed.
+static void apply_thread_placement(ThreadClass cls) {
+    const ThreadPlacement *p = &placements[cls];
+    gint err = 0;
+    if (p->pinned) err = pthread_setaffinity_np(pthread_self(), sizeof(p->cpus), &p->cpus);
+    if (!err && p->fifo) {
+        struct sched_param param = {};
+        param.sched_priority = p->fifo;
+        err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    } else if (!err && p->nice) {
+        err = setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), p->nice) ? errno : 0;
+    }
+    if (err) {
+        // Usually EPERM: SCHED_FIFO and negative nice need CAP_SYS_NICE or an rtprio limit
+        if (g_atomic_int_compare_and_exchange(&placement_warned, 0, 1))
+            g_printerr("Thread placement failed for %s threads: %s\n", thread_class_names[cls], g_strerror(err));
+        return;
+    }
+    g_atomic_int_inc(&threads_placed[cls]);
+}
+
+static GstBusSyncReply on_bus_sync_message(GstBus * /*bus*/, GstMessage *message, gpointer /*user_data*/) {
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS) return GST_BUS_PASS;
+    GstStreamStatusType type;
+    GstElement *owner = NULL;
+    gst_message_parse_stream_status(message, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+        ThreadClass cls = thread_class_of(GST_OBJECT(owner));
+        if (cls != THREAD_OTHER) apply_thread_placement(cls);
+    }
+    return GST_BUS_PASS;
+}
+
+static void print_thread_placement() {
+    for (guint i = 1; i < G_N_ELEMENTS(placements); i++) {
+        const ThreadPlacement *p = &placements[i];
+        if (!p->pinned && !p->fifo && !p->nice) continue;
+        g_print("Threads:    %-8s cpus %s", thread_class_names[i], config.cpus[i] ? config.cpus[i] : "any");
+        if (p->fifo) g_print(", SCHED_FIFO %d", p->fifo);
+        else if (p->nice) g_print(", nice %d", p->nice);
+        g_print("\n");
+    }
+}
+
+static void print_threads_placed() {
+    if (!placement_enabled) return;
+    g_print("threads placed: capture %d, encode %d, network %d\n", g_atomic_int_get(&threads_placed[THREAD_CAPTURE]),
+            g_atomic_int_get(&threads_placed[THREAD_ENCODE]), g_atomic_int_get(&threads_placed[THREAD_NETWORK]));
+}
+
+// ===================== Replay source =====================
+// --source=replay loops a raw clip through appsrc so benchmark runs see the
+// same frames: Y4M (4:2:0), or headerless I420 at --width/--height/--fps. The
+// clip is loaded once, copied into memory or mmapped and pre-faulted
+// (--replay-load), and frames are wrapped in place. Frame n is stamped
+// start + n * duration and clocksync releases it at that running time, so the
+// pacing is exact instead of following arrival like do-timestamp.
+struct ReplayClip {
+    GBytes *data;
+    GArray *frames;                 // gsize offset of each frame in data
+    gsize frame_size;
+    gint width, height, fps_n, fps_d;
+    guint64 pushed;                 // since the chain last started; streaming thread only
+    GstClockTime start;             // running time of the first of those
+};
+
+static ReplayClip replay;
+
+// "YUV4MPEG2 W1280 H720 F30000:1001 Ip A1:1 C420jpeg". Returns the header length, 0 if invalid.
+static gsize parse_y4m_header(const gchar *data, gsize size) {
+    const gchar *end = (const gchar *)memchr(data, '\n', MIN(size, (gsize)256));
+    if (!end || size < 10 || strncmp(data, "YUV4MPEG2 ", 10) != 0) return 0;
+    gchar *line = g_strndup(data, end - data);
+    gchar **tokens = g_strsplit(line, " ", -1);
+    gboolean ok = TRUE;
+    for (gchar **t = tokens + 1; *t && ok; t++) {
+        switch (**t) {
+            case 'W': replay.width = atoi(*t + 1); break;
+            case 'H': replay.height = atoi(*t + 1); break;
+            case 'F': ok = sscanf(*t + 1, "%d:%d", &replay.fps_n, &replay.fps_d) == 2; break;
+            case 'C':
+                if (!g_str_has_prefix(*t + 1, "420")) { g_printerr("Y4M colorspace %s not supported, need 4:2:0\n", *t + 1); ok = FALSE; }
+                break;
+            default: break;
+        }
+    }
+    g_strfreev(tokens);
+    g_free(line);
+    return ok ? (gsize)(end - data) + 1 : 0;
+}
+
+static gboolean load_replay_clip(const gchar *path, gboolean mapped) {
+    GError *error = NULL;
+    if (mapped) {
+        GMappedFile *file = g_mapped_file_new(path, FALSE, &error);
+        if (file) {
+            replay.data = g_mapped_file_get_bytes(file);
+            g_mapped_file_unref(file);
+        }
+    } else {
+        gchar *contents = NULL;
+        gsize length = 0;
+        if (g_file_get_contents(path, &contents, &length, &error)) replay.data = g_bytes_new_take(contents, length);
+    }
+    if (!replay.data) {
+        g_printerr("Failed to load %s: %s\n", path, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    gsize size = 0;
+    const gchar *data = (const gchar *)g_bytes_get_data(replay.data, &size);
+    if (mapped && size) {
+        // Fault every page in now, so the first loop does not read from disk
+        long page = sysconf(_SC_PAGESIZE);
+        madvise((void *)((guintptr)data & ~(guintptr)(page - 1)), size, MADV_WILLNEED);
+        volatile gchar sink = 0;
+        for (gsize i = 0; i < size; i += page) sink ^= data[i];
+        (void)sink;
+    }
+
+    replay.frames = g_array_new(FALSE, FALSE, sizeof(gsize));
+    replay.width = config.width; replay.height = config.height;
+    replay.fps_n = config.fps; replay.fps_d = 1;
+    gsize pos = 0;
+    gboolean y4m = size >= 10 && strncmp(data, "YUV4MPEG2 ", 10) == 0;
+    if (y4m && !(pos = parse_y4m_header(data, size))) {
+        g_printerr("Invalid Y4M header in %s\n", path);
+        return FALSE;
+    }
+    if (replay.width <= 0 || replay.height <= 0 || replay.fps_n <= 0 || replay.fps_d <= 0) {
+        g_printerr("Invalid clip geometry in %s\n", path);
+        return FALSE;
+    }
+    gsize cw = (replay.width + 1) / 2, ch = (replay.height + 1) / 2;
+    replay.frame_size = (gsize)replay.width * replay.height + 2 * cw * ch;
+    while (pos < size) {
+        if (y4m) {
+            // "FRAME[ params]\n" before each frame
+            const gchar *nl = (const gchar *)memchr(data + pos, '\n', MIN(size - pos, (gsize)256));
+            if (!nl || strncmp(data + pos, "FRAME", 5) != 0) break;
+            pos = nl - data + 1;
+        }
+        if (pos + replay.frame_size > size) break;
+        g_array_append_val(replay.frames, pos);
+        pos += replay.frame_size;
+    }
+    if (pos < size) g_printerr("Ignoring %" G_GSIZE_FORMAT " trailing bytes in %s\n", size - pos, path);
+    if (replay.frames->len == 0) {
+        g_printerr("No complete %dx%d frames in %s\n", replay.width, replay.height, path);
+        return FALSE;
+    }
+    // The clip decides what the encoders are configured for
+    config.width = replay.width;
+    config.height = replay.height;
+    config.fps = MAX(1, (replay.fps_n + replay.fps_d / 2) / replay.fps_d);
+    return TRUE;
+}
+
+static void free_replay_clip() {
+    if (replay.data) g_bytes_unref(replay.data);
+    if (replay.frames) g_array_free(replay.frames, TRUE);
+    memset(&replay, 0, sizeof(replay));
+}
+
+static void on_replay_need_data(GstElement *src, guint /*length*/, gpointer /*data*/) {
+    if (replay.pushed == 0) {
+        // Live appsrc only asks once PLAYING, so the running time is valid here
+        replay.start = 0;
+        GstClock *clock = gst_element_get_clock(src);
+        if (clock) {
+            replay.start = gst_clock_get_time(clock) - gst_element_get_base_time(src);
+            gst_object_unref(clock);
+        }
+    }
+    gsize size;
+    const guint8 *data = (const guint8 *)g_bytes_get_data(replay.data, &size);
+    gsize offset = g_array_index(replay.frames, gsize, replay.pushed % replay.frames->len);
+    GstBuffer *buf = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, (gpointer)(data + offset),
+        replay.frame_size, 0, replay.frame_size, g_bytes_ref(replay.data), (GDestroyNotify)g_bytes_unref);
+    // Planes are packed, which differs from GStreamer's default I420 strides at odd sizes
+    gsize cw = (replay.width + 1) / 2, ch = (replay.height + 1) / 2;
+    gsize plane_offset[GST_VIDEO_MAX_PLANES] = { 0, (gsize)replay.width * replay.height,
+                                                 (gsize)replay.width * replay.height + cw * ch, 0 };
+    gint stride[GST_VIDEO_MAX_PLANES] = { replay.width, (gint)cw, (gint)cw, 0 };
+    gst_buffer_add_video_meta_full(buf, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_FORMAT_I420,
+                                   replay.width, replay.height, 3, plane_offset, stride);
+    GST_BUFFER_PTS(buf) = replay.start + gst_util_uint64_scale(replay.pushed, replay.fps_d * GST_SECOND, replay.fps_n);
+    GST_BUFFER_DURATION(buf) = gst_util_uint64_scale(1, replay.fps_d * GST_SECOND, replay.fps_n);
+    GST_BUFFER_OFFSET(buf) = replay.pushed++;
+    GstFlowReturn ret;
+    g_signal_emit_by_name(src, "push-buffer", buf, &ret);
+    gst_buffer_unref(buf);
+}
+
+// ===================== App source =====================
+// --source=app: frames come from gpt_sender_push_frame(). Each one is wrapped
+// as read-only GstMemory around the caller's pointer, with its strides in a
+// video meta, and handed back through its release callback once the last
+// buffer using it is gone. The memory carries app_frame_quark, so the bench
+// can tell whether a frame reached the encoder as pushed or as a copy.
+// Backpressure: appsrc holds at most app_queue_frames; past that pushes are
+// refused rather than queued, so a stalled encoder never grows memory.
+struct AppFrame {
+    void (*release)(void *user_data);
+    void *user_data;
+};
+
+struct AppStats { gint pushed, busy, released, zero_copy, copied; };
+
+static GstVideoInfo app_info;               // set when the chain is created
+static gint app_full = 0;                   // appsrc said enough-data
+static void (*app_flow_callback)(int ready, void *user_data) = NULL;
+static void *app_flow_data = NULL;
+static AppStats app_stats;
+static GQuark app_frame_quark = 0;
+static const guint app_queue_frames = 2;
+
+static void release_app_frame(gpointer data) {
+    AppFrame *frame = (AppFrame *)data;
+    if (frame->release) frame->release(frame->user_data);
+    g_atomic_int_inc(&app_stats.released);
+    g_free(frame);
+}
+
+static void set_app_flow(gboolean full) {
+    if (g_atomic_int_get(&app_full) == full) return;
+    g_atomic_int_set(&app_full, full);
+    if (app_flow_callback) app_flow_callback(!full, app_flow_data);
+}
+
+static void on_app_need_data(GstElement * /*src*/, guint /*length*/, gpointer /*data*/) { set_app_flow(FALSE); }
+static void on_app_enough_data(GstElement * /*src*/, gpointer /*data*/) { set_app_flow(TRUE); }
+
+static GstPadProbeReturn on_app_encoder_input(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer /*data*/) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gboolean ours = gst_buffer_n_memory(buf) == 1 &&
+                    gst_mini_object_get_qdata(GST_MINI_OBJECT(gst_buffer_peek_memory(buf, 0)), app_frame_quark);
+    g_atomic_int_inc(ours ? &app_stats.zero_copy : &app_stats.copied);
+    return GST_PAD_PROBE_OK;
+}
+
+// Frames not taken go straight back to the caller.
+static GptPushResult refuse_app_frame(const GptFrame *f, GptPushResult result) {
+    if (f->release) f->release(f->user_data);
+    return result;
+}
+
+// A caller's own layout: every plane inside the frame, rows no narrower than
+// the format's for its components.
+static gboolean app_layout_fits(const GstVideoInfo *info, const gsize *offset, const gint *stride, gsize size) {
+    for (guint i = 0; i < GST_VIDEO_INFO_N_PLANES(info); i++) {
+        gsize row = 0, rows = 0;
+        for (guint c = 0; c < GST_VIDEO_INFO_N_COMPONENTS(info); c++) {
+            if ((guint)GST_VIDEO_INFO_COMP_PLANE(info, c) != i) continue;
+            row = MAX(row, (gsize)GST_VIDEO_INFO_COMP_WIDTH(info, c) * GST_VIDEO_INFO_COMP_PSTRIDE(info, c));
+            rows = MAX(rows, (gsize)GST_VIDEO_INFO_COMP_HEIGHT(info, c));
+        }
+        if (stride[i] <= 0 || (gsize)stride[i] < row) return FALSE;
+        if (offset[i] > size || rows > (size - offset[i]) / (gsize)stride[i]) return FALSE;
+    }
+    return TRUE;
+}
+
+static GptPushResult push_app_frame(const GptFrame *f) {
+    const GstVideoInfo *info = &app_info;
+    guint n_planes = GST_VIDEO_INFO_N_PLANES(info);
+    gsize offset[GST_VIDEO_MAX_PLANES] = { 0 };
+    gint stride[GST_VIDEO_MAX_PLANES] = { 0 };
+    for (guint i = 0; i < n_planes; i++) {
+        offset[i] = f->n_planes ? f->offset[i] : GST_VIDEO_INFO_PLANE_OFFSET(info, i);
+        stride[i] = f->n_planes ? f->stride[i] : GST_VIDEO_INFO_PLANE_STRIDE(info, i);
+    }
+    if (!f->data || (f->n_planes && (guint)f->n_planes != n_planes) ||
+        (!f->n_planes && f->size < GST_VIDEO_INFO_SIZE(info)) ||
+        (f->n_planes && !app_layout_fits(info, offset, stride, f->size)))
+        return refuse_app_frame(f, GPT_PUSH_INVALID);
+    if (g_atomic_int_get(&app_full)) {
+        g_atomic_int_inc(&app_stats.busy);
+        return refuse_app_frame(f, GPT_PUSH_BUSY);
+    }
+
+    g_mutex_lock(&encoders_lock);
+    GstElement *src = vchain.src ? (GstElement *)gst_object_ref(vchain.src) : NULL;
+    g_mutex_unlock(&encoders_lock);
+    GstClock *clock = src ? gst_element_get_clock(src) : NULL;     // none until PLAYING
+    if (!clock) {
+        if (src) gst_object_unref(src);
+        return refuse_app_frame(f, GPT_PUSH_NOT_RUNNING);
+    }
+    GstClockTime base = gst_element_get_base_time(src);
+    // The pipeline clock is the monotonic system clock, the caller's time base
+    GstClockTime pts = f->pts == GPT_PTS_NONE ? gst_clock_get_time(clock) : f->pts;
+    gst_object_unref(clock);
+
+    AppFrame *frame = g_new0(AppFrame, 1);
+    frame->release = f->release;
+    frame->user_data = f->user_data;
+    GstMemory *mem = gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, (gpointer)f->data, f->size, 0, f->size,
+                                            frame, release_app_frame);
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(mem), app_frame_quark, frame, NULL);
+    GstBuffer *buf = gst_buffer_new();
+    gst_buffer_append_memory(buf, mem);
+    gst_buffer_add_video_meta_full(buf, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_INFO_FORMAT(info),
+                                   GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info), n_planes, offset, stride);
+    GST_BUFFER_PTS(buf) = pts > base ? pts - base : 0;
+
+    // Wrapped now: on failure the buffer dies with our ref below, which releases the frame
+    GstFlowReturn ret = GST_FLOW_OK;
+    g_signal_emit_by_name(src, "push-buffer", buf, &ret);
+    gst_buffer_unref(buf);
+    gst_object_unref(src);
+    if (ret != GST_FLOW_OK) return GPT_PUSH_NOT_RUNNING;
+    g_atomic_int_inc(&app_stats.pushed);
+    return GPT_PUSH_OK;
+}
+
+static void print_app_stats() {
+    gint zero_copy = g_atomic_int_get(&app_stats.zero_copy), copied = g_atomic_int_get(&app_stats.copied);
+    g_print("app frames: %d pushed, %d refused busy, %d released; at the encoder %d as pushed, %d copied "
+            "(%.2f copies/frame before the encoder)\n",
+            g_atomic_int_get(&app_stats.pushed), g_atomic_int_get(&app_stats.busy),
+            g_atomic_int_get(&app_stats.released), zero_copy, copied,
+            zero_copy + copied ? (gdouble)copied / (zero_copy + copied) : 0.0);
+}
+
+// ===================== Static scene skipping =====================
+// --skip-static: each frame out of videoconvert is compared with the last one
+// passed on, 16x16 luma block by block (frame_diff.h). Unless some block moved
+// by at least skip_static per pixel on average, the frame is dropped before
+// rawtee and no encoder sees it. One still goes through every
+// 1/skip_min_fps s, and the next frame after a forwarded keyframe request is
+// never dropped, so joins and PLI are not held up by a still scene. Formats
+// without an 8-bit luma plane first are passed through untouched.
+struct SkipState {
+    GstVideoInfo info;
+    gboolean usable;                // 8-bit luma in plane 0
+    guint8 *prev;                   // luma of the last frame passed on, width x height
+    gint64 prev_at;
+};
+
+struct SkipStats { gint seen, skipped, refreshed, compared; gint64 compare_us; };
+
+static SkipState skip;              // streaming thread only
+static SkipStats skip_stats;
+static gint skip_force_next = 0;    // a keyframe request reached an encoder
+
+static gboolean luma_plane_first(GstVideoFormat format) {
+    switch (format) {
+        case GST_VIDEO_FORMAT_I420: case GST_VIDEO_FORMAT_YV12: case GST_VIDEO_FORMAT_NV12: case GST_VIDEO_FORMAT_NV21:
+        case GST_VIDEO_FORMAT_Y42B: case GST_VIDEO_FORMAT_Y444: case GST_VIDEO_FORMAT_GRAY8:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static void reset_skip_state(GstCaps *caps) {
+    g_free(skip.prev);
+    memset(&skip, 0, sizeof(skip));
+    skip.usable = caps && gst_video_info_from_caps(&skip.info, caps) && luma_plane_first(GST_VIDEO_INFO_FORMAT(&skip.info));
+}
+
+// Does the frame differ enough from the last one passed on? Keeps its luma if so.
+static gboolean frame_has_changed(const GstVideoFrame *frame, gint64 now) {
+    const guint8 *luma = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, 0);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0);
+    gint width = GST_VIDEO_INFO_WIDTH(&skip.info), height = GST_VIDEO_INFO_HEIGHT(&skip.info);
+    gboolean changed = TRUE;
+    if (!skip.prev) {
+        skip.prev = (guint8 *)g_malloc((gsize)width * height);
+    } else if (g_atomic_int_compare_and_exchange(&skip_force_next, 1, 0) ||
+               now - skip.prev_at >= G_USEC_PER_SEC / config.skip_min_fps) {
+        g_atomic_int_inc(&skip_stats.refreshed);
+    } else {
+        guint32 stop_at = (guint32)config.skip_static * FRAME_DIFF_BLOCK * FRAME_DIFF_BLOCK;
+        changed = max_block_sad(block_sad_16x16_simd, luma, stride, skip.prev, width, width, height, stop_at) >= stop_at;
+        skip_stats.compare_us += g_get_monotonic_time() - now;
+        g_atomic_int_inc(&skip_stats.compared);
+    }
+    if (!changed) return FALSE;
+    for (gint y = 0; y < height; y++) memcpy(skip.prev + (gsize)y * width, luma + (gsize)y * stride, width);
+    skip.prev_at = now;
+    return TRUE;
+}
+
+static GstPadProbeReturn on_skip_static(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer /*data*/) {
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+            GstCaps *caps = NULL;
+            gst_event_parse_caps(event, &caps);
+            reset_skip_state(caps);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+    if (!skip.usable) return GST_PAD_PROBE_OK;
+    GstVideoFrame frame;
+    if (!gst_video_frame_map(&frame, &skip.info, GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ)) return GST_PAD_PROBE_OK;
+    g_atomic_int_inc(&skip_stats.seen);
+    gboolean changed = frame_has_changed(&frame, g_get_monotonic_time());
+    gst_video_frame_unmap(&frame);
+    if (changed) return GST_PAD_PROBE_OK;
+    g_atomic_int_inc(&skip_stats.skipped);
+    return GST_PAD_PROBE_DROP;
+}
+
+static void print_skip_stats() {
+    gint seen = g_atomic_int_get(&skip_stats.seen), skipped = g_atomic_int_get(&skip_stats.skipped);
+    gint compared = g_atomic_int_get(&skip_stats.compared);
+    g_print("static skip: %d of %d frames dropped (%.1f%%), %d passed for refresh or keyframes; "
+            "compare %.3f ms/frame (%s)\n",
+            skipped, seen, seen ? 100.0 * skipped / seen : 0.0, g_atomic_int_get(&skip_stats.refreshed),
+            compared ? skip_stats.compare_us / 1000.0 / compared : 0.0, frame_diff_kernel_name());
+}
+
+// ===================== Encoder backends =====================
+// Rate control, GOP, intra refresh and the frame size cap map onto different
+// properties per encoder family. With intra refresh the encoder only emits an
+// IDR when asked (new viewer); a rolling band of intra blocks replaces the
+// periodic IDR, so there is no keyframe-sized spike every GOP.
+struct EncoderBackend {
+    const char *name;
+    const char *h264, *h265;        // element factories
+    void (*configure)(GstElement *enc, const PipelineDesc &d);
+    void (*set_bitrate)(GstElement *enc, gint kbps);    // while PLAYING
+};
+
+static gint effective_gop(const PipelineDesc &d) {
+    if (d.gop) return d.gop;
+    if (d.profile->gop_seconds) return d.profile->gop_seconds * d.fps;
+    return d.intra_refresh != "off" ? d.fps : 0;    // one full refresh per second
+}
+
+// gst-omx: the generic targets only know interval-intraframes; the Zynq
+// UltraScale+ target adds gradual decoder refresh and a picture size cap.
+static void configure_omx_encoder(GstElement *enc, const PipelineDesc &d) {
+    g_object_set(enc, "target-bitrate", d.bitrate * 1000, NULL);
+    set_prop_if_present(enc, "control-rate", d.profile->control_rate);
+    set_int_prop_if_present(enc, "b-frames", 0);    // WebRTC decoders expect no reordering
+    gint gop = effective_gop(d);
+    if (gop) {
+        set_int_prop_if_present(enc, "interval-intraframes", gop);
+        set_int_prop_if_present(enc, "gop-length", gop);
+    }
+    if (d.intra_refresh != "off") {
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(enc), "gdr-mode")) {
+            gst_util_set_object_arg(G_OBJECT(enc), "gdr-mode", d.intra_refresh == "rows" ? "horizontal" : "vertical");
+            set_prop_if_present(enc, "gop-mode", "low-delay-p");
+            set_int_prop_if_present(enc, "periodicity-idr", 0);    // IDRs only on request
+        } else {
+            g_printerr("%s has no intra refresh; using GOP %d instead\n", GST_ELEMENT_NAME(enc), gop);
+        }
+    }
+    if (d.max_frame_kb) set_int_prop_if_present(enc, "max-picture-size", d.max_frame_kb * 8);   // kbit
+}
+
+// x264enc/x265enc: software fallback. x264 refreshes in columns only; the
+// frame cap becomes a VBV buffer of max_frame_kb at the target bitrate.
+static void configure_x26x_encoder(GstElement *enc, const PipelineDesc &d) {
+    gint gop = effective_gop(d);
+    gboolean refresh = d.intra_refresh != "off";
+    guint vbv_ms = d.max_frame_kb ? MAX(1, d.max_frame_kb * 8 * 1000 / d.bitrate) : 0;
+    gst_util_set_object_arg(G_OBJECT(enc), "tune", "zerolatency");
+    gst_util_set_object_arg(G_OBJECT(enc), "speed-preset", "ultrafast");
+    g_object_set(enc, "bitrate", d.bitrate, NULL);
+    if (gop) g_object_set(enc, "key-int-max", gop, NULL);
+    if (g_str_has_prefix(GST_OBJECT_NAME(gst_element_get_factory(enc)), "x265")) {
+        gchar *opts = vbv_ms ? g_strdup_printf("bframes=0:intra-refresh=%d:vbv-bufsize=%d:vbv-maxrate=%d",
+                                               refresh, d.max_frame_kb * 8, d.bitrate)
+                             : g_strdup_printf("bframes=0:intra-refresh=%d", refresh);
+        g_object_set(enc, "option-string", opts, NULL);
+        g_free(opts);
+        return;
+    }
+    g_object_set(enc, "bframes", 0, "intra-refresh", refresh, NULL);
+    if (vbv_ms) g_object_set(enc, "vbv-buf-capacity", vbv_ms, NULL);
+    if (refresh && d.intra_refresh == "rows") g_printerr("x264 refreshes in columns only\n");
+}
+
+// v4l2h264enc/v4l2h265enc: stateful V4L2 mem2mem (Raspberry Pi, i.MX, Rockchip).
+// Everything goes through V4L2 controls; drivers ignore the ones they lack.
+static void configure_v4l2_encoder(GstElement *enc, const PipelineDesc &d) {
+    gint gop = effective_gop(d);
+    GstStructure *controls = gst_structure_new("controls", "video_bitrate", G_TYPE_INT, d.bitrate * 1000,
+                                               "video_bitrate_mode", G_TYPE_INT, 1,     // CBR
+                                               "video_b_frames", G_TYPE_INT, 0,
+                                               "repeat_sequence_header", G_TYPE_BOOLEAN, TRUE, NULL);
+    if (gop) gst_structure_set(controls, "video_gop_size", G_TYPE_INT, gop, "h264_i_frame_period", G_TYPE_INT, gop, NULL);
+    g_object_set(enc, "extra-controls", controls, NULL);
+    gst_structure_free(controls);
+    if (d.intra_refresh != "off") g_printerr("%s has no intra refresh; using GOP %d instead\n", GST_ELEMENT_NAME(enc), gop);
+}
+
+// openh264enc: Cisco's software H.264, lighter than x264 at low resolutions.
+static void configure_openh264_encoder(GstElement *enc, const PipelineDesc &d) {
+    gint gop = effective_gop(d);
+    g_object_set(enc, "bitrate", (guint)d.bitrate * 1000, NULL);
+    set_prop_if_present(enc, "rate-control", "bitrate");
+    set_prop_if_present(enc, "usage-type", "camera");
+    set_prop_if_present(enc, "complexity", "low");
+    if (gop) set_int_prop_if_present(enc, "gop-size", gop);
+    if (d.intra_refresh != "off") g_printerr("%s has no intra refresh; using GOP %d instead\n", GST_ELEMENT_NAME(enc), gop);
+}
+
+// vaapih264enc/vaapih265enc: Intel/AMD through VA-API.
+static void configure_vaapi_encoder(GstElement *enc, const PipelineDesc &d) {
+    gint gop = effective_gop(d);
+    set_prop_if_present(enc, "rate-control", "cbr");
+    g_object_set(enc, "bitrate", (guint)d.bitrate, NULL);
+    set_int_prop_if_present(enc, "max-bframes", 0);
+    if (gop) set_int_prop_if_present(enc, "keyframe-period", gop);
+    if (d.intra_refresh != "off") g_printerr("%s has no intra refresh; using GOP %d instead\n", GST_ELEMENT_NAME(enc), gop);
+}
+
+// nvh264enc/nvh265enc: NVENC. Property names moved between releases, hence the checks.
+static void configure_nvcodec_encoder(GstElement *enc, const PipelineDesc &d) {
+    gint gop = effective_gop(d);
+    set_prop_if_present(enc, "preset", "low-latency-hq");
+    set_prop_if_present(enc, "rc-mode", "cbr");
+    g_object_set(enc, "bitrate", (guint)d.bitrate, NULL);
+    set_int_prop_if_present(enc, "bframes", 0);
+    set_prop_if_present(enc, "zerolatency", "true");
+    if (gop) set_int_prop_if_present(enc, "gop-size", gop);
+    if (d.intra_refresh != "off") g_printerr("%s has no intra refresh; using GOP %d instead\n", GST_ELEMENT_NAME(enc), gop);
+}
+
+static void set_omx_bitrate(GstElement *enc, gint kbps) { g_object_set(enc, "target-bitrate", kbps * 1000, NULL); }
+static void set_x26x_bitrate(GstElement *enc, gint kbps) { g_object_set(enc, "bitrate", kbps, NULL); }
+static void set_kbps_bitrate(GstElement *enc, gint kbps) { g_object_set(enc, "bitrate", (guint)kbps, NULL); }
+static void set_bps_bitrate(GstElement *enc, gint kbps) { g_object_set(enc, "bitrate", (guint)kbps * 1000, NULL); }
+
+// Applied at once while the device is open.
+static void set_v4l2_bitrate(GstElement *enc, gint kbps) {
+    GstStructure *controls = gst_structure_new("controls", "video_bitrate", G_TYPE_INT, kbps * 1000, NULL);
+    g_object_set(enc, "extra-controls", controls, NULL);
+    gst_structure_free(controls);
+}
+
+// Without --encoder or a --bench-encoders result the first installed one is
+// used, so the long-standing omx / x264 order stays first. h265 NULL = H.264 only.
+static const EncoderBackend encoder_backends[] = {
+    { "omx",      "omxh264enc",   "omxh265enc",   configure_omx_encoder,      set_omx_bitrate },
+    { "x264",     "x264enc",      "x265enc",      configure_x26x_encoder,     set_x26x_bitrate },
+    { "v4l2",     "v4l2h264enc",  "v4l2h265enc",  configure_v4l2_encoder,     set_v4l2_bitrate },
+    { "nvcodec",  "nvh264enc",    "nvh265enc",    configure_nvcodec_encoder,  set_kbps_bitrate },
+    { "vaapi",    "vaapih264enc", "vaapih265enc", configure_vaapi_encoder,    set_kbps_bitrate },
+    { "openh264", "openh264enc",  NULL,           configure_openh264_encoder, set_bps_bitrate },
+};
+
+static const EncoderBackend *find_encoder_backend(const gchar *name) {
+    for (const EncoderBackend &b : encoder_backends)
+        if (g_strcmp0(b.name, name) == 0) return &b;
+    return NULL;
+}
+
+// A backend lacking the codec names a factory nobody registers, so the codec
+// simply counts as not installed.
+static const char *backend_factory(const EncoderBackend *b, const CodecInfo *codec) {
+    const char *factory = g_str_equal(codec->name, "h265") ? b->h265 : b->h264;
+    return factory ? factory : "none";
+}
+
+// vp8enc/vp9enc in real-time mode: no lookahead, errors confined to one frame.
+static void configure_vpx_encoder(GstElement *enc, const PipelineDesc &d) {
+    gint gop = effective_gop(d);
+    g_object_set(enc, "target-bitrate", d.bitrate * 1000, "deadline", (gint64)1, "cpu-used", 8,
+                 "lag-in-frames", 0, NULL);
+    gst_util_set_object_arg(G_OBJECT(enc), "end-usage", "cbr");
+    gst_util_set_object_arg(G_OBJECT(enc), "error-resilient", "default");
+    if (gop) g_object_set(enc, "keyframe-max-dist", gop, NULL);
+}
+
+static void set_vpx_bitrate(GstElement *enc, gint kbps) { g_object_set(enc, "target-bitrate", kbps * 1000, NULL); }
+
+// av1enc (libaom) real-time usage.
+static void configure_av1_encoder(GstElement *enc, const PipelineDesc &d) {
+    gint gop = effective_gop(d);
+    gst_util_set_object_arg(G_OBJECT(enc), "usage-profile", "realtime");
+    gst_util_set_object_arg(G_OBJECT(enc), "end-usage", "cbr");
+    g_object_set(enc, "target-bitrate", (guint)d.bitrate, "cpu-used", 8, "lag-in-frames", 0, NULL);
+    if (gop) g_object_set(enc, "keyframe-max-dist", gop, NULL);
+}
+
+static void set_av1_bitrate(GstElement *enc, gint kbps) { g_object_set(enc, "target-bitrate", (guint)kbps, NULL); }
+
+static const CodecInfo codecs[] = {
+    { "h264", "H264", 96, "video/x-h264,profile=constrained-baseline",
+      "packetization-mode=(string)1,profile-level-id=(string)42e01f,level-asymmetry-allowed=(string)1",
+      NULL, "h264parse", "rtph264pay", NULL, NULL },
+    { "h265", "H265", 100, "video/x-h265", NULL, NULL, "h265parse", "rtph265pay", NULL, NULL },
+    { "vp8",  "VP8",  98, "video/x-vp8", NULL, "vp8enc", NULL, "rtpvp8pay", configure_vpx_encoder, set_vpx_bitrate },
+    { "vp9",  "VP9",  99, "video/x-vp9", NULL, "vp9enc", NULL, "rtpvp9pay", configure_vpx_encoder, set_vpx_bitrate },
+    { "av1",  "AV1", 101, "video/x-av1", NULL, "av1enc", "av1parse", "rtpav1pay", configure_av1_encoder, set_av1_bitrate },
+};
+
+static EncodeChain encode_chains[G_N_ELEMENTS(codecs)];     // one slot per codecs[] entry
+static const CodecInfo *offered_codecs[G_N_ELEMENTS(codecs)];
+static guint n_offered_codecs = 0;
+static GstCaps *codec_preferences = NULL;   // every offered codec, set on each video transceiver
+
+static const CodecInfo *find_codec(const gchar *name) {
+    for (const CodecInfo &c : codecs)
+        if (g_strcmp0(c.name, name) == 0) return &c;
+    return NULL;
+}
+
+// The codec whose frames have this media type, e.g. video/x-h265.
+static const CodecInfo *find_codec_by_media_type(const gchar *media_type) {
+    size_t n = strlen(media_type);
+    for (const CodecInfo &c : codecs)
+        if (strncmp(c.enc_caps, media_type, n) == 0 && (c.enc_caps[n] == '\0' || c.enc_caps[n] == ','))
+            return &c;
+    return NULL;
+}
+
+static const CodecInfo *find_offered_codec(gint payload) {
+    for (guint i = 0; i < n_offered_codecs; i++)
+        if (offered_codecs[i]->payload == payload) return offered_codecs[i];
+    return NULL;
+}
+
+// A compressed source already carries the preferred codec.
+static gboolean is_passthrough(const CodecInfo *c, const PipelineDesc &d) {
+    return d.source->compressed && c == find_codec(d.codec.c_str());
+}
+
+// NULL when the codec needs no encoder.
+static const char *encoder_factory(const CodecInfo *c, const PipelineDesc &d) {
+    if (is_passthrough(c, d)) return NULL;
+    if (c->sw_encoder) return c->sw_encoder;
+    return backend_factory(d.encoder, c);
+}
+
+// Encoded frames enter the payloader side here: the encoder, or the queue of
+// a passed-through chain.
+static GstElement *chain_frames(EncodeChain *c) { return c->enc ? c->enc : c->queue; }
+
+static void set_chain_bitrate(EncodeChain *c, gint kbps) {
+    if (c->codec->set_bitrate) c->codec->set_bitrate(c->enc, kbps);
+    else current_desc.encoder->set_bitrate(c->enc, kbps);
+    g_atomic_int_set(&c->kbps, kbps);
+}
+
+static PipelineDesc pipeline_desc_from_config() {
+    PipelineDesc d;
+    d.codec = config.codec;
+    d.source = find_source_kind(config.source);
+    d.input = config.input ? config.input : "";
+    d.device = config.device;
+    d.profile = find_latency_profile(config.profile);
+    d.encoder = find_encoder_backend(config.encoder);
+    d.width = config.width;
+    d.height = config.height;
+    d.fps = config.fps;
+    d.bitrate = config.bitrate;
+    d.gop = config.gop;
+    d.intra_refresh = config.intra_refresh;
+    d.max_frame_kb = config.max_frame_kb;
+    return d;
+}
+
+static GstElementFactory *cached_factory(const gchar *name) {
+    GstElementFactory *f = (GstElementFactory *)g_hash_table_lookup(factory_cache, name);
+    if (f) return f;
+    f = gst_element_factory_find(name);
+    if (!f) { g_printerr("Missing element: %s\n", name); return NULL; }
+    // Load the plugin now so the first create does not pay for it.
+    GstPluginFeature *loaded = gst_plugin_feature_load(GST_PLUGIN_FEATURE(f));
+    gst_object_unref(f);
+    if (!loaded) { g_printerr("Failed to load plugin for %s\n", name); return NULL; }
+    f = GST_ELEMENT_FACTORY(loaded);
+    g_hash_table_insert(factory_cache, g_strdup(name), f);
+    return f;
+}
+
+// After preload_factories() the cache is only read, so session workers may call this too.
+static GstElement *make_element(const gchar *factory, const gchar *name) {
+    GstElementFactory *f = cached_factory(factory);
+    return f ? gst_element_factory_create(f, name) : NULL;
+}
+
+// A codec is available when all of its elements are installed.
+static gboolean codec_available(const CodecInfo *c, const PipelineDesc &d) {
+    const char *names[] = { encoder_factory(c, d), c->parser, c->payloader };
+    for (const char *n : names) {
+        if (!n) continue;
+        GstElementFactory *f = gst_element_factory_find(n);
+        if (!f) return FALSE;
+        gst_object_unref(f);
+    }
+    return TRUE;
+}
+
+static gboolean offer_codec(const CodecInfo *c, const PipelineDesc &d) {
+    for (guint i = 0; i < n_offered_codecs; i++) if (offered_codecs[i] == c) return TRUE;
+    const char *names[] = { encoder_factory(c, d), c->parser, c->payloader };
+    for (const char *n : names) if (n && !cached_factory(n)) return FALSE;
+    offered_codecs[n_offered_codecs++] = c;
+    return TRUE;
+}
+
+// Offered codecs: --codecs as given, or the preferred codec followed by every
+// other one that is installed.
+static gboolean resolve_offered_codecs(const PipelineDesc &d) {
+    n_offered_codecs = 0;
+    if (!offer_codec(find_codec(d.codec.c_str()), d)) return FALSE;
+    if (config.codecs) {
+        gchar **names = g_strsplit(config.codecs, ",", -1);
+        gboolean ok = TRUE;
+        for (gchar **n = names; *n && ok; n++) ok = offer_codec(find_codec(g_strstrip(*n)), d);
+        g_strfreev(names);
+        return ok;
+    }
+    for (const CodecInfo &c : codecs)
+        if (codec_available(&c, d)) offer_codec(&c, d);
+    return TRUE;
+}
+
+// Resolve every factory the sender will need up front (the "registry" phase).
+static gboolean preload_factories(const PipelineDesc &d) {
+    const char *names[] = {
+        d.source->element, "capsfilter", "videoconvert", "queue", "tee",
+        "audiotestsrc", "audioconvert", "audioresample", "opusenc", "rtpopuspay",
+        "webrtcbin",
+    };
+    gboolean ok = TRUE;
+    for (const char *n : names) ok &= cached_factory(n) != NULL;
+    if (d.source->compressed) {
+        const char *more[] = { "parsebin", "decodebin", "fakesink" };
+        for (const char *n : more) ok &= cached_factory(n) != NULL;
+        if (g_str_equal(d.source->name, "file")) ok &= cached_factory("clocksync") != NULL;
+    }
+    if (g_str_equal(d.source->name, "replay")) ok &= cached_factory("clocksync") != NULL;
+    ok &= resolve_offered_codecs(d);
+    // Optional: bandwidth estimation needs rtpgccbwe from gst-plugins-rs.
+    bwe_available = config.bwe_probe_ms > 0 && cached_factory("rtpgccbwe") != NULL;
+    if (config.bwe_probe_ms > 0 && !bwe_available) g_printerr("Bandwidth probing disabled\n");
+    return ok;
+}
+
+// ===================== DTLS certificate =====================
+// One ECDSA P-256 certificate for every session, kept in $XDG_CONFIG_HOME/gpt/
+// so restarts reuse it. Each new DTLS transport gets the current one; a
+// rotation only changes what later sessions are handed.
+static GMutex dtls_lock;
+static gchar *dtls_pem;             // certificate then key, as dtlsdec's "pem" takes them
+static guint dtls_rotate_id;
+
+static gchar *dtls_pem_path() { return g_build_filename(g_get_user_config_dir(), "gpt", "dtls.pem", NULL); }
+
+static gint64 dtls_rotate_seconds() { return (gint64)config.dtls_rotate_hours * 3600; }
+
+static gchar *generate_dtls_pem() {
+    EVP_PKEY *key = NULL;
+    EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    gboolean ok = kctx && EVP_PKEY_keygen_init(kctx) > 0 &&
+                  EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) > 0 &&
+                  EVP_PKEY_keygen(kctx, &key) > 0;
+    EVP_PKEY_CTX_free(kctx);
+    if (!ok) return NULL;
+
+    // Browsers only check the fingerprint from the SDP; the validity just has
+    // to outlast the sessions started before the next rotation.
+    gint64 valid = MAX(dtls_rotate_seconds(), (gint64)24 * 3600) * 2;
+    X509 *x509 = X509_new();
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), (long)(g_random_int() >> 1));
+    X509_gmtime_adj(X509_getm_notBefore(x509), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(x509), (long)valid);
+    X509_set_pubkey(x509, key);
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"gpt", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+
+    gchar *pem = NULL;
+    BIO *bio = BIO_new(BIO_s_mem());
+    if (X509_sign(x509, key, EVP_sha256()) > 0 && PEM_write_bio_X509(bio, x509) &&
+        PEM_write_bio_PrivateKey(bio, key, NULL, NULL, 0, NULL, NULL)) {
+        char *data = NULL;
+        long len = BIO_get_mem_data(bio, &data);
+        pem = g_strndup(data, len);
+    }
+    BIO_free(bio);
+    X509_free(x509);
+    EVP_PKEY_free(key);
+    return pem;
+}
+
+// A saved certificate is reused while it is younger than the rotation period,
+// still valid, and comes with its key.
+static gchar *load_dtls_pem(const gchar *path) {
+    GStatBuf st;
+    if (g_stat(path, &st) != 0) return NULL;
+    if (dtls_rotate_seconds() && (gint64)time(NULL) - st.st_mtime >= dtls_rotate_seconds()) return NULL;
+    gchar *pem = NULL;
+    gsize len = 0;
+    if (!g_file_get_contents(path, &pem, &len, NULL)) return NULL;
+    BIO *bio = BIO_new_mem_buf(pem, (int)len);
+    X509 *x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    EVP_PKEY *key = x509 ? PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL) : NULL;
+    gboolean ok = key && X509_cmp_current_time(X509_get0_notAfter(x509)) > 0 && X509_check_private_key(x509, key);
+    EVP_PKEY_free(key);
+    X509_free(x509);
+    BIO_free(bio);
+    if (!ok) g_clear_pointer(&pem, g_free);
+    return pem;
+}
+
+static void save_dtls_pem(const gchar *path, const gchar *pem) {
+    gchar *dir = g_path_get_dirname(path);
+    GError *err = NULL;
+    if (g_mkdir_with_parents(dir, 0700) != 0 || !g_file_set_contents(path, pem, -1, &err) || g_chmod(path, 0600) != 0)
+        g_printerr("Could not save the DTLS certificate to %s: %s\n", path, err ? err->message : g_strerror(errno));
+    g_clear_error(&err);
+    g_free(dir);
+}
+
+// dtlsdec keeps one DTLS context per distinct pem, built the first time that
+// pem is set. Setting it on a throwaway dtlsdec builds it here rather than
+// inside a viewer's join; creating the dtlsdec also generates the default
+// certificate every dtlsdec makes once per process.
+static gboolean prime_dtls_pem(const gchar *pem) {
+    GstElement *dec = make_element("dtlsdec", NULL);
+    if (!dec) return FALSE;
+    gst_object_ref_sink(dec);
+    g_object_set(dec, "pem", pem, NULL);
+    gchar *check = NULL;
+    g_object_get(dec, "pem", &check, NULL);
+    gboolean ok = check != NULL;
+    g_free(check);
+    gst_object_unref(dec);
+    return ok;
+}
+
+static void set_dtls_pem(gchar *pem) {
+    g_mutex_lock(&dtls_lock);
+    g_free(dtls_pem);
+    dtls_pem = pem;
+    g_mutex_unlock(&dtls_lock);
+}
+
+// Main loop. Sessions already up keep the certificate they were offered with.
+static gboolean rotate_dtls_certificate(gpointer) {
+    gint64 t0 = g_get_monotonic_time();
+    gchar *pem = generate_dtls_pem();
+    if (!pem || !prime_dtls_pem(pem)) {
+        g_printerr("DTLS certificate rotation failed; keeping the current one\n");
+        g_free(pem);
+        return G_SOURCE_CONTINUE;
+    }
+    gchar *path = dtls_pem_path();
+    save_dtls_pem(path, pem);
+    g_free(path);
+    set_dtls_pem(pem);
+    g_print("DTLS certificate rotated in %.1f ms\n", ms_since(t0, g_get_monotonic_time()));
+    return G_SOURCE_CONTINUE;
+}
+
+// Loads or generates the shared certificate before any viewer joins. Without
+// it (--no-dtls-prewarm) every transport falls back to dtlsdec's own default,
+// generated inside the first join.
+static gboolean prewarm_dtls_certificate() {
+    gchar *path = dtls_pem_path();
+    gchar *pem = load_dtls_pem(path);
+    gboolean loaded = pem != NULL;
+    if (!pem && (pem = generate_dtls_pem())) save_dtls_pem(path, pem);
+    gboolean ok = pem && prime_dtls_pem(pem);
+    if (ok) {
+        g_print("DTLS certificate %s %s\n", loaded ? "loaded from" : "generated, saved to", path);
+        set_dtls_pem(pem);
+    } else {
+        g_free(pem);
+    }
+    g_free(path);
+    if (ok && config.dtls_rotate_hours)
+        dtls_rotate_id = g_timeout_add_seconds((guint)dtls_rotate_seconds(), rotate_dtls_certificate, NULL);
+    return ok;
+}
+
+// webrtcbin thread, as each DTLS transport is created and before the offer
+// reads its fingerprint.
+static void apply_dtls_certificate(GstWebRTCDTLSTransport *dtls) {
+    g_mutex_lock(&dtls_lock);
+    if (dtls_pem) g_object_set(dtls, "certificate", dtls_pem, NULL);
+    g_mutex_unlock(&dtls_lock);
+}
+
+// Raw for v4l2/test, the clip's own for replay, --app-format for pushed frames,
+// the --codec stream straight out of a UVC camera's encoder.
+static GstCaps *capture_caps(const PipelineDesc &d) {
+    if (g_str_equal(d.source->name, "replay"))
+        return gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "I420",
+            "width", G_TYPE_INT, replay.width, "height", G_TYPE_INT, replay.height,
+            "framerate", GST_TYPE_FRACTION, replay.fps_n, replay.fps_d, NULL);
+    if (g_str_equal(d.source->name, "app"))
+        return gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, config.app_format,
+            "width", G_TYPE_INT, d.width, "height", G_TYPE_INT, d.height,
+            "framerate", GST_TYPE_FRACTION, d.fps, 1, NULL);
+    const char *enc_caps = find_codec(d.codec.c_str())->enc_caps;
+    gchar *media_type = d.source->compressed ? g_strndup(enc_caps, strcspn(enc_caps, ",")) : g_strdup("video/x-raw");
+    GstCaps *caps = gst_caps_new_simple(media_type,
+        "width", G_TYPE_INT, d.width, "height", G_TYPE_INT, d.height,
+        "framerate", GST_TYPE_FRACTION, d.fps, 1, NULL);
+    g_free(media_type);
+    return caps;
+}
+
+// offer: with the codec's fmtp fields, for the transceiver's codec preferences.
+static GstStructure *rtp_video_structure(const CodecInfo *c, gboolean offer) {
+    GstStructure *st = gst_structure_new("application/x-rtp",
+        "media", G_TYPE_STRING, "video", "clock-rate", G_TYPE_INT, 90000,
+        "encoding-name", G_TYPE_STRING, c->encoding_name,
+        "payload", G_TYPE_INT, c->payload, NULL);
+    if (offer && c->fmtp) {
+        gchar *text = g_strdup_printf("x,%s", c->fmtp);
+        GstStructure *extra = gst_structure_from_string(text, NULL);
+        g_free(text);
+        if (extra) {
+            gst_structure_foreach(extra, [](GQuark field, const GValue *value, gpointer data) -> gboolean {
+                gst_structure_id_set_value((GstStructure *)data, field, value);
+                return TRUE;
+            }, st);
+            gst_structure_free(extra);
+        }
+    }
+    // The payloader adds transport-wide sequence numbers; the viewer's TWCC
+    // feedback drives the bandwidth estimator.
+    if (bwe_available) gst_structure_set(st, "extmap-1", G_TYPE_STRING, twcc_extension_uri, NULL);
+    return st;
+}
+
+static GstCaps *build_codec_preferences() {
+    GstCaps *caps = gst_caps_new_empty();
+    for (guint i = 0; i < n_offered_codecs; i++)
+        gst_caps_append_structure(caps, rtp_video_structure(offered_codecs[i], TRUE));
+    return caps;
+}
+
+static void configure_video_chain(const PipelineDesc &d) {
+    if (g_str_equal(d.source->name, "file")) {
+        g_object_set(vchain.src, "location", d.input.c_str(), NULL);
+        reset_file_loop();
+    } else if (g_str_equal(d.source->name, "rtsp")) {
+        // The camera leg's jitterbuffer; webrtcbin adds the viewer's own.
+        g_object_set(vchain.src, "location", d.input.c_str(), "latency", d.profile->webrtc_latency_ms, NULL);
+    } else if (g_str_equal(d.source->name, "replay")) {
+        // Two frames queued: enough to keep clocksync fed, little enough to stay in step
+        GstCaps *caps = capture_caps(d);
+        g_object_set(vchain.src, "is-live", TRUE, "format", GST_FORMAT_TIME, "caps", caps,
+                     "max-bytes", (guint64)replay.frame_size * 2, NULL);
+        g_object_set(vchain.srccaps, "caps", caps, NULL);
+        gst_caps_unref(caps);
+        replay.pushed = 0;
+    } else if (g_str_equal(d.source->name, "app")) {
+        // Stamped by the pusher; enough-data past app_queue_frames turns pushes away
+        GstCaps *caps = capture_caps(d);
+        g_object_set(vchain.src, "is-live", TRUE, "format", GST_FORMAT_TIME, "do-timestamp", FALSE, "caps", caps,
+                     "max-bytes", (guint64)GST_VIDEO_INFO_SIZE(&app_info) * app_queue_frames, NULL);
+        g_object_set(vchain.srccaps, "caps", caps, NULL);
+        gst_caps_unref(caps);
+    } else {
+        if (g_str_equal(d.source->element, "v4l2src")) g_object_set(vchain.src, "device", d.device.c_str(), NULL);
+        else g_object_set(vchain.src, "is-live", TRUE, NULL);
+        // Camera-encoded frames are paced by arrival, so they are always stamped.
+        g_object_set(vchain.src, "do-timestamp", d.source->compressed || d.profile->do_timestamp, NULL);
+        GstCaps *caps = capture_caps(d);
+        g_object_set(vchain.srccaps, "caps", caps, NULL);
+        gst_caps_unref(caps);
+    }
+    // SPS/PPS in front of every IDR, so a viewer joining mid-stream can decode
+    if (vchain.parse) g_object_set(vchain.parse, "config-interval", -1, NULL);
+}
+
+static void configure_encode_chain(EncodeChain *c, const PipelineDesc &d) {
+    const LatencyProfile *p = d.profile;
+    const CodecInfo *k = c->codec;
+    gst_util_set_object_arg(G_OBJECT(c->queue), "leaky", "downstream");
+    g_object_set(c->queue, "max-size-buffers", p->queue_buffers, NULL);
+
+    GstCaps *caps;
+    if (c->enc) {
+        if (k->configure) k->configure(c->enc, d);
+        else d.encoder->configure(c->enc, d);
+        caps = gst_caps_from_string(k->enc_caps);
+        g_object_set(c->enccaps, "caps", caps, NULL);
+        gst_caps_unref(caps);
+    }
+    g_atomic_int_set(&c->kbps, c->enc ? d.bitrate : 0);     // a passed-through rate is the source's
+
+    g_object_set(c->pay, "mtu", p->mtu, "pt", k->payload, NULL);
+    if (!k->sw_encoder) {       // rtph264pay / rtph265pay
+        g_object_set(c->pay, "config-interval", 1, NULL);
+        set_prop_if_present(c->pay, "aggregate-mode", p->aggregate_mode);
+    }
+    caps = gst_caps_new_full(rtp_video_structure(k, FALSE), NULL);
+    g_object_set(c->rtpcaps, "caps", caps, NULL);
+    gst_caps_unref(caps);
+}
+
+// ----- keyframe requests -----
+// Every viewer's PLI/FIR reaches its codec's shared encoder as an upstream
+// GstForceKeyUnit event, as do our own join/recovery requests. They are gated
+// at the encoder's tee: at most one goes through per keyframe_interval_ms, and
+// requests inside the window collapse into one sent when it ends, so every
+// requester gets a keyframe within the interval without an IDR per viewer.
+static GMutex kf_lock;
+static gint kf_requests = 0;                // all force-key-unit events seen
+static gint kf_local_requests = 0;          // of those, ours (join, ICE recovery)
+static gint kf_forwarded = 0;
+
+// Sent straight into the tee's upstream peer so it bypasses the gate.
+static gboolean send_pending_keyframe(gpointer data) {
+    EncodeChain *c = (EncodeChain *)data;
+    g_mutex_lock(&kf_lock);
+    c->kf_pending_id = 0;
+    c->kf_last_forwarded = g_get_monotonic_time();
+    g_mutex_unlock(&kf_lock);
+
+    GstPad *peer = NULL;
+    g_mutex_lock(&encoders_lock);
+    if (c->tee) {
+        GstPad *pad = gst_element_get_static_pad(c->tee, "sink");
+        peer = gst_pad_get_peer(pad);
+        gst_object_unref(pad);
+    }
+    g_mutex_unlock(&encoders_lock);
+    if (peer) {
+        gst_pad_send_event(peer, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+        g_atomic_int_inc(&kf_forwarded);
+        g_atomic_int_set(&skip_force_next, 1);
+        gst_object_unref(peer);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static GstPadProbeReturn on_keyframe_request(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer data) {
+    EncodeChain *c = (EncodeChain *)data;
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (!gst_video_event_is_force_key_unit(event)) return GST_PAD_PROBE_OK;
+
+    g_atomic_int_inc(&kf_requests);
+    gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&kf_lock);
+    gint64 wait_us = c->kf_last_forwarded + (gint64)config.keyframe_interval_ms * 1000 - now;
+    if (wait_us <= 0) {
+        c->kf_last_forwarded = now;
+        if (c->kf_pending_id) { g_source_remove(c->kf_pending_id); c->kf_pending_id = 0; }
+        g_mutex_unlock(&kf_lock);
+        g_atomic_int_inc(&kf_forwarded);
+        g_atomic_int_set(&skip_force_next, 1);
+        return GST_PAD_PROBE_OK;
+    }
+    if (!c->kf_pending_id) c->kf_pending_id = g_timeout_add((wait_us + 999) / 1000, send_pending_keyframe, c);
+    g_mutex_unlock(&kf_lock);
+    return GST_PAD_PROBE_DROP;
+}
+
+static GstPadProbeReturn on_encoded_frame(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer data) {
+    EncodeChain *c = (EncodeChain *)data;
+    g_atomic_int_inc(&c->frames);
+    if (!GST_BUFFER_FLAG_IS_SET(GST_PAD_PROBE_INFO_BUFFER(info), GST_BUFFER_FLAG_DELTA_UNIT))
+        g_atomic_int_inc(&c->keyframes);
+    return GST_PAD_PROBE_OK;
+}
+
+static void cancel_pending_keyframe(EncodeChain *c) {
+    g_mutex_lock(&kf_lock);
+    if (c->kf_pending_id) { g_source_remove(c->kf_pending_id); c->kf_pending_id = 0; }
+    g_mutex_unlock(&kf_lock);
+}
+
+static void print_keyframe_stats() {
+    gint req = g_atomic_int_get(&kf_requests), local = g_atomic_int_get(&kf_local_requests);
+    gint produced = 0;
+    for (EncodeChain &c : encode_chains) produced += g_atomic_int_get(&c.keyframes);
+    g_print("keyframes: %d requests (%d PLI/FIR, %d join/recovery), %d forwarded, %d produced, min interval %d ms\n",
+            req, MAX(0, req - local), local, g_atomic_int_get(&kf_forwarded),
+            produced, config.keyframe_interval_ms);
+}
+
+// ----- bitrate hints -----
+// Each viewer has a ceiling: its bandwidth estimate once probing is done
+// (--bitrate until then), lowered further by any hint it sent over its control
+// channel. An encoder is shared by its codec's viewers, so it runs at their
+// lowest ceiling, never above --max-bitrate; a viewer that leaves lets the rate
+// go back up.
+static gint session_ceiling_kbps(PeerSession *s) {
+    gint kbps = s->bwe_ceiling_kbps ? s->bwe_ceiling_kbps : current_desc.bitrate;
+    return s->bitrate_hint_kbps ? MIN(kbps, s->bitrate_hint_kbps) : kbps;
+}
+
+static gboolean apply_bitrate_hints(gpointer /*user_data*/) {
+    gint max_kbps = config.max_bitrate ? config.max_bitrate : current_desc.bitrate;
+    gint kbps[G_N_ELEMENTS(codecs)];
+    for (gint &k : kbps) k = G_MAXINT;
+    g_mutex_lock(&sessions_lock);
+    GHashTableIter it; gpointer value;
+    g_hash_table_iter_init(&it, sessions);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        PeerSession *s = (PeerSession *)value;
+        if (!s->chain) continue;
+        gint &k = kbps[s->chain - encode_chains];
+        k = MIN(k, session_ceiling_kbps(s));
+    }
+    g_mutex_unlock(&sessions_lock);
+
+    g_mutex_lock(&encoders_lock);
+    for (guint i = 0; i < G_N_ELEMENTS(encode_chains); i++) {
+        EncodeChain *c = &encode_chains[i];
+        gint k = kbps[i] == G_MAXINT ? current_desc.bitrate : MIN(kbps[i], max_kbps);
+        if (!c->enc || k == c->kbps) continue;
+        g_print("%s encoder bitrate %d -> %d kbps\n", c->codec->name, c->kbps, k);
+        set_chain_bitrate(c, k);
+    }
+    g_mutex_unlock(&encoders_lock);
+    return G_SOURCE_REMOVE;
+}
+
+// rtspsrc, parsebin and decodebin add pads at runtime: the first video pad
+// feeds next, anything else (audio, another track) goes to a fakesink.
+static void on_source_pad(GstElement * /*element*/, GstPad *pad, gpointer data) {
+    GstElement *next = (GstElement *)data;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps) caps = gst_pad_query_caps(pad, NULL);
+    const GstStructure *st = gst_caps_get_structure(caps, 0);
+    gboolean video = g_str_has_prefix(gst_structure_get_name(st), "video/") ||
+                     g_strcmp0(gst_structure_get_string(st, "media"), "video") == 0;
+
+    GstPad *sink = gst_element_get_static_pad(next, "sink");
+    if (video && !gst_pad_is_linked(sink)) {
+        if (gst_pad_link(pad, sink) != GST_PAD_LINK_OK) {
+            // An RTSP camera is only known once it streams; files are checked up front
+            if (next == vchain.parse)
+                g_printerr("Error: %s carries %s, not the --codec=%s stream expected\n", current_desc.input.c_str(),
+                           gst_structure_get_name(st), current_desc.codec.c_str());
+            else
+                g_printerr("Failed to link %s to %s\n", GST_PAD_NAME(pad), GST_ELEMENT_NAME(next));
+        }
+    } else {
+        GstElement *discard = make_element("fakesink", NULL);
+        g_object_set(discard, "async", FALSE, "sync", FALSE, NULL);
+        gst_bin_add(GST_BIN(pipeline), discard);
+        gst_element_sync_state_with_parent(discard);
+        GstPad *dpad = gst_element_get_static_pad(discard, "sink");
+        gst_pad_link(pad, dpad);
+        gst_object_unref(dpad);
+    }
+    gst_object_unref(sink);
+    gst_caps_unref(caps);
+}
+
+// ----- file source -----
+// A clip's timestamps start from its own zero, whenever it starts, and it
+// ends. Both are handled on parse's src pad. The first buffer after a start
+// or a resume sets an offset on pace's sink pad that lines the clip up with
+// the pipeline's running time. At the end the EOS is held back, parse is
+// seeked to the start, and that seek's flush is dropped there too, so ctee
+// and everything after it see one continuous stream. Each pass continues
+// from the running time the previous one reached.
+struct FileLoop {
+    GstSegment segment;             // parse's output segment, streaming thread only
+    gint64 offset;                  // added to the clip's running time on pace's sink pad
+    GstClockTime pass_end;          // clip running time reached in this pass
+    gint rebase;                    // atomic: next buffer re-anchors the offset to the clock
+    gint seeking;                   // atomic: the looping seek's flushes are dropped
+    gint passes;                    // atomic
+};
+static FileLoop file_loop;
+
+static void set_file_offset(gint64 offset) {
+    file_loop.offset = offset;
+    GstPad *pad = gst_element_get_static_pad(vchain.pace, "sink");
+    gst_pad_set_offset(pad, offset);
+    gst_object_unref(pad);
+}
+
+// Main loop
+static gboolean loop_file_source(gpointer /*user_data*/) {
+    GstPad *pad = gst_element_get_static_pad(vchain.parse, "src");
+    GstEvent *seek = gst_event_new_seek(1.0, GST_FORMAT_TIME, (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
+                                        GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+    gboolean ok = gst_pad_send_event(pad, seek);
+    gst_object_unref(pad);
+    if (!ok) {
+        g_printerr("%s cannot be seeked back to the start; stopping\n", current_desc.input.c_str());
+        g_main_loop_quit(loop);
+    } else {
+        g_print("%s: pass %d\n", current_desc.input.c_str(), g_atomic_int_add(&file_loop.passes, 1) + 2);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static GstPadProbeReturn on_file_probe(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer /*user_data*/) {
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (!GST_BUFFER_PTS_IS_VALID(buf)) return GST_PAD_PROBE_OK;
+        GstClockTime rt = gst_segment_to_running_time(&file_loop.segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+        if (!GST_CLOCK_TIME_IS_VALID(rt)) return GST_PAD_PROBE_OK;
+        if (g_atomic_int_get(&file_loop.rebase)) {
+            // Before PLAYING there is no running time yet; the next buffer tries again
+            GstClockTime now = gst_element_get_current_running_time(pipeline);
+            if (GST_CLOCK_TIME_IS_VALID(now)) {
+                set_file_offset((gint64)now - (gint64)rt);
+                g_atomic_int_set(&file_loop.rebase, FALSE);
+            }
+        }
+        GstClockTime end = rt + (GST_BUFFER_DURATION_IS_VALID(buf) ? GST_BUFFER_DURATION(buf) : 0);
+        file_loop.pass_end = MAX(file_loop.pass_end, end);
+        return GST_PAD_PROBE_OK;
+    }
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    switch (GST_EVENT_TYPE(event)) {
+        case GST_EVENT_SEGMENT:
+            gst_event_copy_segment(event, &file_loop.segment);
+            break;
+        case GST_EVENT_FLUSH_START:
+            if (g_atomic_int_get(&file_loop.seeking)) return GST_PAD_PROBE_DROP;
+            break;
+        case GST_EVENT_FLUSH_STOP:
+            if (!g_atomic_int_get(&file_loop.seeking)) break;
+            // The next pass starts from running time 0 again
+            set_file_offset(file_loop.offset + (gint64)file_loop.pass_end);
+            file_loop.pass_end = 0;
+            g_atomic_int_set(&file_loop.seeking, FALSE);
+            return GST_PAD_PROBE_DROP;
+        case GST_EVENT_EOS:
+            g_atomic_int_set(&file_loop.seeking, TRUE);
+            g_idle_add(loop_file_source, NULL);
+            return GST_PAD_PROBE_DROP;
+        default: break;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void reset_file_loop() {
+    gst_segment_init(&file_loop.segment, GST_FORMAT_TIME);
+    file_loop.pass_end = 0;
+    g_atomic_int_set(&file_loop.rebase, TRUE);
+    g_atomic_int_set(&file_loop.seeking, FALSE);
+    g_atomic_int_set(&file_loop.passes, 0);
+}
+
+// The video codec of a file, from the caps parsebin puts on its video pad;
+// NULL when the file cannot be read or holds no video. Runs before the
+// factory cache exists.
+static const CodecInfo *probe_file_codec(const gchar *path) {
+    GstElement *probe = gst_pipeline_new(NULL);
+    GstElement *src = gst_element_factory_make("filesrc", NULL);
+    GstElement *demux = gst_element_factory_make("parsebin", NULL);
+    if (!src || !demux) {
+        if (src) gst_object_unref(src);
+        if (demux) gst_object_unref(demux);
+        gst_object_unref(probe);
+        return NULL;
+    }
+    g_object_set(src, "location", path, NULL);
+    gst_bin_add_many(GST_BIN(probe), src, demux, NULL);
+    gst_element_link(src, demux);
+    const CodecInfo *found = NULL;
+    g_signal_connect(demux, "pad-added", G_CALLBACK(+[](GstElement *element, GstPad *pad, gpointer data) {
+        GstCaps *caps = gst_pad_query_caps(pad, NULL);
+        const gchar *media_type = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+        const CodecInfo **found = (const CodecInfo **)data;
+        if (!*found && g_str_has_prefix(media_type, "video/")) *found = find_codec_by_media_type(media_type);
+        gst_caps_unref(caps);
+        // Fed to a fakesink so the probe pipeline can preroll
+        GstElement *sink = gst_element_factory_make("fakesink", NULL);
+        gst_bin_add(GST_BIN(GST_ELEMENT_PARENT(element)), sink);
+        gst_element_sync_state_with_parent(sink);
+        GstPad *spad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_link(pad, spad);
+        gst_object_unref(spad);
+    }), &found);
+    gst_element_set_state(probe, GST_STATE_PAUSED);
+    GstBus *bus = gst_element_get_bus(probe);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 5 * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR));
+    if (msg) gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(probe, GST_STATE_NULL);
+    gst_object_unref(probe);
+    return found;
+}
+
+static gboolean create_video_chain(const PipelineDesc &d) {
+    vchain.src = make_element(d.source->element, NULL);
+    vchain.rawtee = make_element("tee", "rawtee");
+    if (!vchain.src || !vchain.rawtee) return FALSE;
+    set_thread_class(vchain.src, THREAD_CAPTURE);
+    g_object_set(vchain.rawtee, "allow-not-linked", TRUE, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), vchain.src, vchain.rawtee, NULL);
+    if (config.skip_static) {
+        // After videoconvert, whichever branch feeds rawtee
+        GstPad *pad = gst_element_get_static_pad(vchain.rawtee, "sink");
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                          on_skip_static, NULL, NULL);
+        gst_object_unref(pad);
+    }
+
+    if (!d.source->compressed) {
+        vchain.srccaps = make_element("capsfilter", NULL);
+        vchain.convert = make_element("videoconvert", NULL);
+        if (!vchain.srccaps || !vchain.convert) return FALSE;
+        gst_bin_add_many(GST_BIN(pipeline), vchain.srccaps, vchain.convert, NULL);
+        if (g_str_equal(d.source->name, "app")) {
+            GstCaps *caps = capture_caps(d);
+            gboolean ok = gst_video_info_from_caps(&app_info, caps);
+            gst_caps_unref(caps);
+            if (!ok) return FALSE;
+            g_signal_connect(vchain.src, "need-data", G_CALLBACK(on_app_need_data), NULL);
+            g_signal_connect(vchain.src, "enough-data", G_CALLBACK(on_app_enough_data), NULL);
+        }
+        if (!g_str_equal(d.source->name, "replay"))
+            return gst_element_link_many(vchain.src, vchain.srccaps, vchain.convert, vchain.rawtee, NULL);
+        // Replayed frames are stamped ahead of time; clocksync holds each until it is due
+        vchain.pace = make_element("clocksync", NULL);
+        if (!vchain.pace) return FALSE;
+        gst_bin_add(GST_BIN(pipeline), vchain.pace);
+        g_signal_connect(vchain.src, "need-data", G_CALLBACK(on_replay_need_data), NULL);
+        return gst_element_link_many(vchain.src, vchain.srccaps, vchain.pace, vchain.convert, vchain.rawtee, NULL);
+    }
+
+    // UVC hands us H.264 caps to pick; files and RTSP go through parsebin
+    // (demuxer or depayloader + parser). Files are paced to the clock and loop.
+    gboolean uvc = g_str_equal(d.source->element, "v4l2src");
+    if (uvc) vchain.srccaps = make_element("capsfilter", NULL);
+    else vchain.demux = make_element("parsebin", NULL);
+    set_thread_class(vchain.demux, THREAD_CAPTURE);
+    if (g_str_equal(d.source->name, "file")) vchain.pace = make_element("clocksync", NULL);
+    vchain.parse = make_element(find_codec(d.codec.c_str())->parser, NULL);
+    vchain.ctee = make_element("tee", "ctee");
+    if ((uvc ? !vchain.srccaps : !vchain.demux) || (g_str_equal(d.source->name, "file") && !vchain.pace) ||
+        !vchain.parse || !vchain.ctee)
+        return FALSE;
+    g_object_set(vchain.ctee, "allow-not-linked", TRUE, NULL);
+
+    GstElement *elems[] = { vchain.src, vchain.srccaps, vchain.demux, vchain.parse, vchain.pace, vchain.ctee };
+    GstElement *prev = NULL;
+    gboolean ok = TRUE;
+    for (GstElement *e : elems) {
+        if (!e) continue;
+        if (prev) {
+            gst_bin_add(GST_BIN(pipeline), e);
+            GstPad *src = gst_element_get_static_pad(prev, "src");
+            if (src) { ok &= gst_element_link(prev, e); gst_object_unref(src); }
+            else g_signal_connect(prev, "pad-added", G_CALLBACK(on_source_pad), e);
+        }
+        prev = e;
+    }
+    if (vchain.pace && !uvc) {
+        GstPad *pad = gst_element_get_static_pad(vchain.parse, "src");
+        gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+                                                 GST_PAD_PROBE_TYPE_EVENT_FLUSH), on_file_probe, NULL, NULL);
+        gst_object_unref(pad);
+    }
+    return ok;
+}
+
+// ----- transcoding -----
+// With a compressed source rawtee is only fed while some encoder hangs off it.
+// Called with encoders_lock held.
+static gboolean needs_decode() {
+    for (EncodeChain &c : encode_chains) if (c.tee && c.enc) return TRUE;
+    return FALSE;
+}
+
+static void stop_decode_branch() {
+    if (vchain.dqueue) unlink_from_tee(vchain.ctee, vchain.dqueue);
+    GstElement *elems[] = { vchain.dqueue, vchain.decode, vchain.convert };
+    for (GstElement *e : elems) {
+        if (!e) continue;
+        gst_element_set_state(e, GST_STATE_NULL);
+        if (GST_OBJECT_PARENT(e)) gst_bin_remove(GST_BIN(pipeline), e);
+        else gst_object_unref(e);
+    }
+    vchain.dqueue = vchain.decode = vchain.convert = NULL;
+}
+
+static gboolean start_decode_branch() {
+    vchain.dqueue = make_element("queue", NULL);
+    vchain.decode = make_element("decodebin", NULL);
+    vchain.convert = make_element("videoconvert", NULL);
+    if (!vchain.dqueue || !vchain.decode || !vchain.convert) {
+        stop_decode_branch();
+        return FALSE;
+    }
+    gst_util_set_object_arg(G_OBJECT(vchain.dqueue), "leaky", "downstream");
+    set_thread_class(vchain.dqueue, THREAD_ENCODE);
+    set_thread_class(vchain.decode, THREAD_ENCODE);
+    gst_bin_add_many(GST_BIN(pipeline), vchain.dqueue, vchain.decode, vchain.convert, NULL);
+    g_signal_connect(vchain.decode, "pad-added", G_CALLBACK(on_source_pad), vchain.convert);
+    if (!gst_element_link(vchain.dqueue, vchain.decode) || !gst_element_link(vchain.convert, vchain.rawtee) ||
+        !link_tee_to(vchain.ctee, vchain.dqueue)) {
+        stop_decode_branch();
+        return FALSE;
+    }
+    gst_element_sync_state_with_parent(vchain.convert);
+    gst_element_sync_state_with_parent(vchain.decode);
+    gst_element_sync_state_with_parent(vchain.dqueue);
+    return TRUE;
+}
+
+// ----- shared encoders -----
+// An encoder starts when the first viewer's answer picks its codec and stops
+// when the last of them leaves. Called with encoders_lock held.
+static void stop_encode_chain(EncodeChain *c) {
+    cancel_pending_keyframe(c);
+    if (c->queue) unlink_from_tee(c->enc || !vchain.ctee ? vchain.rawtee : vchain.ctee, c->queue);
+    GstElement *elems[] = { c->queue, c->enc, c->enccaps, c->parse, c->pay, c->rtpcaps, c->tee };
+    for (GstElement *e : elems) {
+        if (!e) continue;
+        gst_element_set_state(e, GST_STATE_NULL);
+        if (GST_OBJECT_PARENT(e)) gst_bin_remove(GST_BIN(pipeline), e);
+        else gst_object_unref(e);
+    }
+    c->queue = c->enc = c->enccaps = c->parse = c->pay = c->rtpcaps = c->tee = NULL;
+    if (vchain.decode && !needs_decode()) {
+        stop_decode_branch();
+        g_print("Transcoding stopped\n");
+    }
+}
+
+static gboolean start_encode_chain(EncodeChain *c) {
+    const CodecInfo *k = c->codec;
+    // A passed-through codec is parsed once in the capture chain; the rest encode.
+    gboolean encode = !is_passthrough(k, current_desc);
+    c->queue = make_element("queue", NULL);
+    if (encode) {
+        c->enc = make_element(encoder_factory(k, current_desc), NULL);
+        c->enccaps = make_element("capsfilter", NULL);
+        c->parse = k->parser ? make_element(k->parser, NULL) : NULL;
+    }
+    c->pay = make_element(k->payloader, NULL);
+    c->rtpcaps = make_element("capsfilter", NULL);
+    c->tee = make_element("tee", NULL);
+    if (!c->queue || (encode && (!c->enc || !c->enccaps || (k->parser && !c->parse))) ||
+        !c->pay || !c->rtpcaps || !c->tee) {
+        stop_encode_chain(c);
+        return FALSE;
+    }
+    g_object_set(c->tee, "allow-not-linked", TRUE, NULL);
+    set_thread_class(c->queue, THREAD_ENCODE);
+    configure_encode_chain(c, current_desc);
+
+    // Link order; parse may be absent.
+    GstElement *elems[] = { c->queue, c->enc, c->enccaps, c->parse, c->pay, c->rtpcaps, c->tee };
+    GstElement *prev = NULL;
+    gboolean ok = TRUE;
+    for (GstElement *e : elems) {
+        if (!e) continue;
+        gst_bin_add(GST_BIN(pipeline), e);
+        if (prev) ok &= gst_element_link(prev, e);
+        prev = e;
+    }
+    ok &= link_tee_to(encode || !vchain.ctee ? vchain.rawtee : vchain.ctee, c->queue);
+    if (ok && encode && vchain.ctee && !vchain.decode) {
+        ok = start_decode_branch();
+        if (ok) g_print("Transcoding %s for %s viewers\n", current_desc.codec.c_str(), k->name);
+    }
+    if (!ok) {
+        g_printerr("Failed to link %s encoder\n", k->name);
+        stop_encode_chain(c);
+        return FALSE;
+    }
+
+    GstPad *pad = gst_element_get_static_pad(chain_frames(c), "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_encoded_frame, c, NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(c->tee, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, on_keyframe_request, c, NULL);
+    gst_object_unref(pad);
+
+    // Downstream first, so nothing pushes into a pad that is not ready yet.
+    for (gint i = G_N_ELEMENTS(elems) - 1; i >= 0; i--)
+        if (elems[i]) gst_element_sync_state_with_parent(elems[i]);
+    return TRUE;
+}
+
+// ----- idle suspend -----
+// With no viewers the capture chain and the audio source are put in PAUSED
+// after idle_suspend_ms, with their state locked so pipeline-wide changes
+// leave them there. The camera stays open and negotiated, and the last
+// encoder stays configured ("parked") instead of being torn down, so the next
+// viewer only costs a state change. A request-offer wakes capture early, while
+// the viewer is still negotiating. Called with encoders_lock held.
+static gboolean capture_suspended = FALSE;
+static gboolean resume_timing = FALSE;      // the next first-RTP report is a resume
+static guint idle_suspend_id = 0;
+static gint64 suspended_at = 0;
+
+static gint total_viewers() {
+    gint n = 0;
+    for (EncodeChain &c : encode_chains) n += c.viewers;
+    return n;
+}
+
+static void set_capture_suspended(gboolean suspend) {
+    GPtrArray *elems = g_ptr_array_new();
+    if (audio_src) g_ptr_array_add(elems, audio_src);
+    collect_capture_elements(elems);
+    // Upstream first on the way down, downstream first on the way up.
+    for (guint i = 0; i < elems->len; i++) {
+        GstElement *e = (GstElement *)g_ptr_array_index(elems, suspend ? i : elems->len - 1 - i);
+        gst_element_set_locked_state(e, suspend);
+        if (suspend) gst_element_set_state(e, GST_STATE_PAUSED);
+        else gst_element_sync_state_with_parent(e);
+    }
+    g_ptr_array_unref(elems);
+    capture_suspended = suspend;
+}
+
+static gboolean on_idle_suspend(gpointer /*user_data*/) {
+    g_mutex_lock(&encoders_lock);
+    idle_suspend_id = 0;
+    if (pipeline && !capture_suspended && total_viewers() == 0) {
+        set_capture_suspended(TRUE);
+        suspended_at = g_get_monotonic_time();
+        g_print("Idle: capture suspended\n");
+    }
+    g_mutex_unlock(&encoders_lock);
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_idle_suspend(guint delay_ms) {
+    if (!config.idle_suspend_ms || idle_suspend_id) return;
+    idle_suspend_id = g_timeout_add(delay_ms, on_idle_suspend, NULL);
+}
+
+// Resume time is measured to the first encoded frame and RTP packet of the
+// chain that will serve the viewer (the parked one until an answer says otherwise).
+static void resume_capture(EncodeChain *serving) {
+    if (!capture_suspended) return;
+    set_capture_suspended(FALSE);
+    // Replayed frames are stamped from the running time at their first push
+    if (g_str_equal(current_desc.source->name, "replay")) replay.pushed = 0;
+    // and a paused file from the running time it resumes at
+    if (g_str_equal(current_desc.source->name, "file")) g_atomic_int_set(&file_loop.rebase, TRUE);
+    g_print("Idle: capture resumed after %.1f s\n", ms_since(suspended_at, g_get_monotonic_time()) / 1000.0);
+    if (!serving)
+        for (EncodeChain &c : encode_chains) if (c.tee) { serving = &c; break; }
+    if (serving) {
+        startup.built = g_get_monotonic_time();
+        resume_timing = TRUE;
+        arm_first_buffer_probes(serving);
+    }
+}
+
+// Any thread. A viewer is on its way: wake capture now, and suspend again if
+// it never gets as far as an encoder.
+static void wake_capture() {
+    g_mutex_lock(&encoders_lock);
+    if (pipeline && capture_suspended) {
+        resume_capture(NULL);
+        schedule_idle_suspend(config.idle_suspend_ms + config.negotiation_timeout_ms);
+    }
+    g_mutex_unlock(&encoders_lock);
+}
+
+// A parked encoder of another codec is not coming back.
+static void stop_parked_encoders(EncodeChain *keep) {
+    for (EncodeChain &c : encode_chains) {
+        if (&c == keep || !c.tee || c.viewers > 0) continue;
+        stop_encode_chain(&c);
+        g_print("%s encoder stopped\n", c.codec->name);
+    }
+}
+
+// Idle from the start: the preferred codec's encoder is configured up front
+// and parked, so even the first viewer finds it ready.
+static void park_preferred_encoder() {
+    EncodeChain *c = &encode_chains[find_codec(current_desc.codec.c_str()) - codecs];
+    g_mutex_lock(&encoders_lock);
+    if (start_encode_chain(c)) {
+        g_print("%s encoder started (%s), parked\n", c->codec->name,
+                c->enc ? GST_OBJECT_NAME(gst_element_get_factory(c->enc)) : "passthrough");
+        schedule_idle_suspend(config.idle_suspend_ms);
+    }
+    g_mutex_unlock(&encoders_lock);
+}
+
+// Any thread. NULL if the encoder could not be started.
+static EncodeChain *acquire_encoder(const CodecInfo *codec) {
+    EncodeChain *c = &encode_chains[codec - codecs];
+    g_mutex_lock(&encoders_lock);
+    resume_capture(c);
+    stop_parked_encoders(c);
+    if (!c->tee) {
+        if (!start_encode_chain(c)) { g_mutex_unlock(&encoders_lock); return NULL; }
+        g_print("%s encoder started (%s)\n", codec->name,
+                c->enc ? GST_OBJECT_NAME(gst_element_get_factory(c->enc)) : "passthrough");
+    }
+    c->viewers++;
+    g_mutex_unlock(&encoders_lock);
+    return c;
+}
+
+static void release_encoder(EncodeChain *c) {
+    g_mutex_lock(&encoders_lock);
+    if (--c->viewers == 0 && c->tee) {
+        if (config.idle_suspend_ms && total_viewers() == 0) {
+            g_print("%s encoder parked\n", c->codec->name);
+            schedule_idle_suspend(config.idle_suspend_ms);
+        } else {
+            stop_encode_chain(c);
+            g_print("%s encoder stopped\n", c->codec->name);
+        }
+    }
+    g_mutex_unlock(&encoders_lock);
+}
+
+static gboolean create_audio_chain() {
+    GstElement *src = make_element("audiotestsrc", NULL);
+    GstElement *conv = make_element("audioconvert", NULL);
+    GstElement *resample = make_element("audioresample", NULL);
+    GstElement *queue = make_element("queue", NULL);
+    GstElement *enc = make_element("opusenc", NULL);
+    GstElement *pay = make_element("rtpopuspay", NULL);
+    GstElement *caps = make_element("capsfilter", NULL);
+    if (!src || !conv || !resample || !queue || !enc || !pay || !caps) return FALSE;
+    audio_src = src;
+    set_thread_class(src, THREAD_CAPTURE);
+    set_thread_class(queue, THREAD_ENCODE);
+
+    g_object_set(src, "is-live", TRUE, NULL);
+    gst_util_set_object_arg(G_OBJECT(src), "wave", "silence");
+    g_object_set(pay, "pt", 97, NULL);
+    GstCaps *c = gst_caps_new_simple("application/x-rtp",
+        "media", G_TYPE_STRING, "audio", "encoding-name", G_TYPE_STRING, "OPUS",
+        "payload", G_TYPE_INT, 97, NULL);
+    g_object_set(caps, "caps", c, NULL);
+    gst_caps_unref(c);
+
+    gst_bin_add_many(GST_BIN(pipeline), src, conv, resample, queue, enc, pay, caps, NULL);
+    return gst_element_link_many(src, conv, resample, queue, enc, pay, caps, audio_tee, NULL);
+}
+
+// ----- multicast -----
+// --multicast=GROUP:PORT sends the preferred codec's RTP once more to a LAN
+// multicast group: video on PORT, audio on PORT+2, SRTP with --multicast-srtp.
+// It comes from the same encoder as the WebRTC viewers, so it runs at their
+// lowest rate (--bitrate with none), and costs the same however many displays
+// tune in. The branch holds the encoder like a viewer (capture never idles).
+// With no way for receivers to ask for keyframes, one is requested every
+// multicast_idr_ms through the usual gate. The SDP is built from the
+// negotiated caps, written to --multicast-sdp and served at /stream.sdp on
+// --multicast-http. No RTCP.
+struct MulticastStats { gint packets; gint64 bytes; };
+
+struct MulticastOutput {
+    EncodeChain *chain;
+    GstElement *vqueue, *aqueue;
+    guint idr_id;
+    GstCaps *caps[2];               // video, audio RTP caps as negotiated; guarded by mcast_lock
+    gchar *sdp;                     // guarded by mcast_lock
+    guint8 key[30];                 // SRTP master key and salt
+    SoupServer *http;
+    MulticastStats stats;
+};
+
+static GMutex mcast_lock;
+static MulticastOutput mcast;
+
+static GstBuffer *multicast_key_buffer() {
+    GstBuffer *key = gst_buffer_new_allocate(NULL, sizeof(mcast.key), NULL);
+    gst_buffer_fill(key, 0, mcast.key, sizeof(mcast.key));
+    return key;
+}
+
+// a=key-mgmt value for sdpdemux, which does not read a=crypto. srtpenc's
+// default suites, keyed for the stream's SSRC when the payloader set one.
+static gchar *multicast_mikey(const GstCaps *rtp_caps) {
+    GstBuffer *key = multicast_key_buffer();
+    GstCaps *caps = gst_caps_new_simple("application/x-srtp", "srtp-key", GST_TYPE_BUFFER, key,
+                                        "srtp-cipher", G_TYPE_STRING, "aes-128-icm", "srtp-auth", G_TYPE_STRING, "hmac-sha1-80",
+                                        "srtcp-cipher", G_TYPE_STRING, "aes-128-icm", "srtcp-auth", G_TYPE_STRING, "hmac-sha1-80", NULL);
+    gst_buffer_unref(key);
+    GstMIKEYMessage *msg = gst_mikey_message_new_from_caps(caps);
+    gst_caps_unref(caps);
+    if (!msg) return NULL;
+    guint ssrc;
+    if (gst_structure_get_uint(gst_caps_get_structure(rtp_caps, 0), "ssrc", &ssrc))
+        gst_mikey_message_add_cs_srtp(msg, 0, ssrc, 0);
+    gchar *encoded = gst_mikey_message_base64_encode(msg);
+    gst_mikey_message_unref(msg);
+    gchar *value = encoded ? g_strdup_printf("mikey %s", encoded) : NULL;
+    g_free(encoded);
+    return value;
+}
+
+static gchar *multicast_sdp_text() {
+    gboolean v6 = strchr(config.multicast_group, ':') != NULL;
+    const gchar *family = v6 ? "IP6" : "IP4";
+    GstSDPMessage *msg;
+    gst_sdp_message_new(&msg);
+    gst_sdp_message_set_version(msg, "0");
+    gchar *session_id = g_strdup_printf("%u", g_random_int());
+    gst_sdp_message_set_origin(msg, "-", session_id, "1", "IN", family, g_get_host_name());
+    g_free(session_id);
+    gst_sdp_message_set_session_name(msg, "gpt");
+    // IPv6 groups carry no TTL in c=
+    gst_sdp_message_set_connection(msg, "IN", family, config.multicast_group, v6 ? 0 : config.multicast_ttl, 1);
+    gst_sdp_message_add_time(msg, "0", "0", NULL);
+    gchar *key = config.multicast_srtp ? g_base64_encode(mcast.key, sizeof(mcast.key)) : NULL;
+    for (guint i = 0; i < G_N_ELEMENTS(mcast.caps); i++) {
+        GstSDPMedia *media;
+        gst_sdp_media_new(&media);
+        gst_sdp_media_set_media_from_caps(mcast.caps[i], media);
+        gst_sdp_media_set_port_info(media, config.multicast_port + 2 * i, 1);
+        gst_sdp_media_set_proto(media, key ? "RTP/SAVP" : "RTP/AVP");
+        gst_sdp_media_add_attribute(media, "sendonly", NULL);
+        if (key) {
+            gchar *crypto = g_strdup_printf("1 AES_CM_128_HMAC_SHA1_80 inline:%s", key);
+            gst_sdp_media_add_attribute(media, "crypto", crypto);
+            g_free(crypto);
+            gchar *mikey = multicast_mikey(mcast.caps[i]);
+            if (mikey) gst_sdp_media_add_attribute(media, "key-mgmt", mikey);
+            g_free(mikey);
+        }
+        gst_sdp_message_add_media(msg, media);
+        gst_sdp_media_free(media);
+    }
+    g_free(key);
+    gchar *text = gst_sdp_message_as_text(msg);
+    gst_sdp_message_free(msg);
+    return text;
+}
+
+// Caps arrive per stream on its streaming thread; once both are known the SDP is (re)built.
+static GstPadProbeReturn on_multicast_caps(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer data) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS) return GST_PAD_PROBE_OK;
+    GstCaps *caps = NULL;
+    gst_event_parse_caps(event, &caps);
+    guint index = GPOINTER_TO_UINT(data);
+    g_mutex_lock(&mcast_lock);
+    if (mcast.caps[index] && gst_caps_is_equal(mcast.caps[index], caps)) {
+        g_mutex_unlock(&mcast_lock);
+        return GST_PAD_PROBE_OK;
+    }
+    gst_caps_replace(&mcast.caps[index], caps);
+    gchar *text = mcast.caps[0] && mcast.caps[1] ? multicast_sdp_text() : NULL;
+    if (text) { g_free(mcast.sdp); mcast.sdp = text; }
+    g_mutex_unlock(&mcast_lock);
+    if (!text) return GST_PAD_PROBE_OK;
+
+    GError *error = NULL;
+    if (config.multicast_sdp && !g_file_set_contents(config.multicast_sdp, text, -1, &error)) {
+        g_printerr("Failed to write %s: %s\n", config.multicast_sdp, error->message);
+        g_error_free(error);
+    } else if (config.multicast_sdp) {
+        g_print("Multicast SDP written to %s\n", config.multicast_sdp);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn on_multicast_packet(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer /*data*/) {
+    g_atomic_int_inc(&mcast.stats.packets);
+    g_mutex_lock(&mcast_lock);
+    mcast.stats.bytes += gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+    g_mutex_unlock(&mcast_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static void on_sdp_request(SoupServer * /*server*/, SoupMessage *msg, const char * /*path*/, GHashTable * /*query*/,
+                           SoupClientContext * /*client*/, gpointer /*data*/) {
+    g_mutex_lock(&mcast_lock);
+    if (mcast.sdp) {
+        soup_message_set_status(msg, SOUP_STATUS_OK);
+        soup_message_set_response(msg, "application/sdp", SOUP_MEMORY_COPY, mcast.sdp, strlen(mcast.sdp));
+    } else {
+        soup_message_set_status(msg, SOUP_STATUS_SERVICE_UNAVAILABLE);     // caps not negotiated yet
+    }
+    g_mutex_unlock(&mcast_lock);
+}
+
+static gboolean on_multicast_idr(gpointer /*user_data*/) {
+    g_atomic_int_inc(&kf_local_requests);
+    gst_element_send_event(mcast.vqueue, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+    return G_SOURCE_CONTINUE;
+}
+
+// tee ! queue [! srtpenc] ! udpsink
+static GstElement *add_multicast_branch(GstElement *tee, gint port, guint index) {
+    GstElement *queue = make_element("queue", NULL);
+    GstElement *srtp = config.multicast_srtp ? make_element("srtpenc", NULL) : NULL;
+    GstElement *sink = make_element("udpsink", NULL);
+    GstElement *elems[] = { queue, srtp, sink };
+    gboolean ok = queue && sink && (srtp || !config.multicast_srtp);
+    for (GstElement *e : elems) if (e) gst_bin_add(GST_BIN(pipeline), e);
+    if (!ok) return NULL;
+
+    gst_util_set_object_arg(G_OBJECT(queue), "leaky", "downstream");
+    set_thread_class(queue, THREAD_NETWORK);
+    g_object_set(sink, "host", config.multicast_group, "port", port, "auto-multicast", TRUE,
+                 "ttl-mc", config.multicast_ttl, "sync", FALSE, "async", FALSE, NULL);
+    if (config.multicast_iface) g_object_set(sink, "multicast-iface", config.multicast_iface, NULL);
+    if (srtp) {
+        // Default suites: AES_CM_128 with HMAC_SHA1_80, as the SDP says
+        GstBuffer *key = multicast_key_buffer();
+        g_object_set(srtp, "key", key, NULL);
+        gst_buffer_unref(key);
+        ok = gst_element_link(queue, srtp) && gst_element_link(srtp, sink);
+    } else {
+        ok = gst_element_link(queue, sink);
+    }
+
+    GstPad *pad = gst_element_get_static_pad(queue, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, on_multicast_caps, GUINT_TO_POINTER(index), NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_multicast_packet, NULL, NULL);
+    gst_object_unref(pad);
+    for (gint i = G_N_ELEMENTS(elems) - 1; i >= 0; i--)
+        if (elems[i]) gst_element_sync_state_with_parent(elems[i]);
+    return ok && link_tee_to(tee, queue) ? queue : NULL;
+}
+
+static gboolean start_multicast() {
+    if (config.multicast_srtp && getrandom(mcast.key, sizeof(mcast.key), 0) != sizeof(mcast.key)) {
+        g_printerr("No random bytes for the SRTP key: %s\n", g_strerror(errno));
+        return FALSE;
+    }
+    mcast.chain = acquire_encoder(find_codec(current_desc.codec.c_str()));
+    if (!mcast.chain) return FALSE;
+    mcast.vqueue = add_multicast_branch(mcast.chain->tee, config.multicast_port, 0);
+    mcast.aqueue = add_multicast_branch(audio_tee, config.multicast_port + 2, 1);
+    if (!mcast.vqueue || !mcast.aqueue) {
+        g_printerr("Failed to link the multicast output\n");
+        return FALSE;
+    }
+    if (config.multicast_idr_ms) mcast.idr_id = g_timeout_add(config.multicast_idr_ms, on_multicast_idr, NULL);
+
+    if (config.multicast_http_port && !mcast.http) {
+        GError *error = NULL;
+        mcast.http = soup_server_new(SOUP_SERVER_SERVER_HEADER, "gpt", NULL);
+        soup_server_add_handler(mcast.http, "/stream.sdp", on_sdp_request, NULL, NULL);
+        if (!soup_server_listen_all(mcast.http, config.multicast_http_port, (SoupServerListenOptions)0, &error)) {
+            g_printerr("Failed to serve the multicast SDP on port %d: %s\n", config.multicast_http_port, error->message);
+            g_error_free(error);
+            g_clear_object(&mcast.http);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// The elements go with the pipeline.
+static void stop_multicast() {
+    if (mcast.idr_id) g_source_remove(mcast.idr_id);
+    g_mutex_lock(&mcast_lock);
+    for (GstCaps *&caps : mcast.caps) gst_caps_replace(&caps, NULL);
+    g_clear_pointer(&mcast.sdp, g_free);
+    g_mutex_unlock(&mcast_lock);
+    if (mcast.http) {
+        soup_server_disconnect(mcast.http);
+        g_clear_object(&mcast.http);
+    }
+    mcast.chain = NULL;
+    mcast.vqueue = mcast.aqueue = NULL;
+    mcast.idr_id = 0;
+}
+
+static void print_multicast_stats() {
+    g_mutex_lock(&mcast_lock);
+    g_print("multicast: %d packets, %.1f MB sent to %s:%d/%d\n", g_atomic_int_get(&mcast.stats.packets),
+            mcast.stats.bytes / 1e6, config.multicast_group, config.multicast_port, config.multicast_port + 2);
+    g_mutex_unlock(&mcast_lock);
+}
+
+// ----- startup timing -----
+static void log_startup_phases() {
+    if (resume_timing) {
+        g_print("resume: first-frame %.1f, first-rtp %.1f ms\n",
+                ms_since(startup.built, startup.first_frame), ms_since(startup.built, startup.first_rtp));
+        resume_timing = FALSE;
+        return;
+    }
+    gint64 start = startup_reported ? startup.built : startup.start;
+    if (!startup_reported) {
+        g_print("startup: init %.1f, registry %.1f, dtls %.1f, build %.1f, playing %.1f, "
+                "first-frame %.1f, first-rtp %.1f ms (total %.1f ms)\n",
+                ms_since(startup.start, startup.init),
+                ms_since(startup.init, startup.registry),
+                ms_since(startup.registry, startup.dtls),
+                ms_since(startup.dtls, startup.built),
+                ms_since(startup.built, MAX(startup.playing, startup.built)),
+                ms_since(MAX(startup.playing, startup.built), startup.first_frame),
+                ms_since(startup.first_frame, startup.first_rtp),
+                ms_since(start, startup.first_rtp));
+    } else {
+        g_print("restart: first-frame %.1f, first-rtp %.1f ms (total %.1f ms)\n",
+                ms_since(start, startup.first_frame),
+                ms_since(startup.first_frame, startup.first_rtp),
+                ms_since(start, startup.first_rtp));
+    }
+    startup_reported = TRUE;
+}
+
+// ----- quality benchmark -----
+// --bench-quality: the bench encoder's RTP also feeds a local receiver,
+// queue ! decodebin ! videoconvert ! appsink, and each decoded frame is
+// compared with the replay frame it was made from. Frame n of the run is
+// stamped start + n * duration, so the PTS finds it even when frames were
+// dropped or reordered on the way. PSNR over Y and over all planes, SSIM over
+// Y (frame_metrics.h). No network in between: loss is not part of the number.
+struct QualityStats {
+    guint frames, mismatched;       // compared; decoded at another size
+    gdouble psnr_y, psnr_yuv, ssim, ssim_min;   // sums over frames, except the min
+    gint64 metrics_us;
+};
+
+static GMutex quality_lock;
+static QualityStats quality;
+
+static GstFlowReturn on_quality_sample(GstElement *sink, gpointer /*data*/) {
+    GstSample *sample = NULL;
+    g_signal_emit_by_name(sink, "pull-sample", &sample);
+    if (!sample) return GST_FLOW_ERROR;
+    GstBuffer *buf = gst_sample_get_buffer(sample);
+    GstVideoInfo info;
+    GstVideoFrame frame;
+    if (!GST_CLOCK_TIME_IS_VALID(buf->pts) || buf->pts < replay.start ||
+        !gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) ||
+        !gst_video_frame_map(&frame, &info, buf, GST_MAP_READ)) {
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+    gint width = replay.width, height = replay.height, cw = (width + 1) / 2, ch = (height + 1) / 2;
+    if (GST_VIDEO_INFO_WIDTH(&info) != width || GST_VIDEO_INFO_HEIGHT(&info) != height) {
+        gst_video_frame_unmap(&frame);
+        gst_sample_unref(sample);
+        g_mutex_lock(&quality_lock);
+        quality.mismatched++;
+        g_mutex_unlock(&quality_lock);
+        return GST_FLOW_OK;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    guint64 n = gst_util_uint64_scale_round(buf->pts - replay.start, replay.fps_n, replay.fps_d * GST_SECOND);
+    const guint8 *ref = (const guint8 *)g_bytes_get_data(replay.data, NULL) +
+                        g_array_index(replay.frames, gsize, n % replay.frames->len);
+    // Replay planes are packed: Y, then U and V at half size
+    const guint8 *ref_planes[3] = { ref, ref + (gsize)width * height, ref + (gsize)width * height + (gsize)cw * ch };
+    gint ref_strides[3] = { width, cw, cw };
+    guint64 sse[3];
+    for (guint p = 0; p < 3; p++)
+        sse[p] = plane_sse(row_sse_simd, ref_planes[p], ref_strides[p], (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&frame, p),
+                           GST_VIDEO_FRAME_PLANE_STRIDE(&frame, p), p ? cw : width, p ? ch : height);
+    gdouble ssim = plane_ssim(ssim_window_simd, ref, width, (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0),
+                              GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0), width, height);
+    gdouble psnr_y = psnr_from_sse(sse[0], (guint64)width * height);
+    gdouble psnr_yuv = psnr_from_sse(sse[0] + sse[1] + sse[2], (guint64)width * height + 2 * (guint64)cw * ch);
+    gst_video_frame_unmap(&frame);
+    gst_sample_unref(sample);
+
+    g_mutex_lock(&quality_lock);
+    quality.ssim_min = quality.frames ? MIN(quality.ssim_min, ssim) : ssim;
+    quality.frames++;
+    quality.psnr_y += psnr_y;
+    quality.psnr_yuv += psnr_yuv;
+    quality.ssim += ssim;
+    quality.metrics_us += g_get_monotonic_time() - start;
+    g_mutex_unlock(&quality_lock);
+    return GST_FLOW_OK;
+}
+
+// Hangs the receiver off c's RTP tee; it lives in the pipeline until it goes.
+static gboolean attach_quality_receiver(EncodeChain *c) {
+    GstElement *queue = make_element("queue", NULL);
+    GstElement *decode = make_element("decodebin", NULL);
+    GstElement *convert = make_element("videoconvert", NULL);
+    GstElement *caps = make_element("capsfilter", NULL);
+    GstElement *sink = make_element("appsink", NULL);
+    if (!queue || !decode || !convert || !caps || !sink) return FALSE;
+    GstCaps *i420 = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "I420", NULL);
+    g_object_set(caps, "caps", i420, NULL);
+    gst_caps_unref(i420);
+    // Every frame is compared, so the receiver holds the encoder back rather than dropping
+    g_object_set(sink, "sync", FALSE, "emit-signals", TRUE, NULL);
+    g_signal_connect(sink, "new-sample", G_CALLBACK(on_quality_sample), NULL);
+    set_thread_class(queue, THREAD_ENCODE);
+    gst_bin_add_many(GST_BIN(pipeline), queue, decode, convert, caps, sink, NULL);
+    g_signal_connect(decode, "pad-added", G_CALLBACK(on_source_pad), convert);
+    return gst_element_link(queue, decode) && gst_element_link_many(convert, caps, sink, NULL) &&
+           link_tee_to(c->tee, queue);
+}
+
+static void print_quality_stats() {
+    g_mutex_lock(&quality_lock);
+    guint n = quality.frames;
+    if (n) {
+        g_print("profile %s quality: %u frames, psnr y %.2f, yuv %.2f dB; ssim y %.4f (min %.4f); "
+                "metrics %.2f ms/frame (%s)\n",
+                current_desc.profile->name, n, quality.psnr_y / n, quality.psnr_yuv / n, quality.ssim / n,
+                quality.ssim_min, quality.metrics_us / 1000.0 / n, frame_diff_kernel_name());
+    } else {
+        g_print("profile %s quality: no decoded frames\n", current_desc.profile->name);
+    }
+    if (quality.mismatched) g_print("profile %s quality: %u frames decoded at another size, not compared\n",
+                                    current_desc.profile->name, quality.mismatched);
+    g_mutex_unlock(&quality_lock);
+}
+
+// ----- profile benchmark -----
+// Capture-to-packet latency (running time at the payloader minus the frame's
+// PTS) and output bitrate, measured for bench_seconds after the first packet.
+// Receiver-side jitterbuffer and decode time are not included. Encoded frame
+// sizes show the keyframe spikes that GOP / intra refresh settings trade off.
+static GMutex bench_lock;
+static GArray *bench_latency_ms = NULL;     // gdouble per RTP packet
+static GArray *bench_frame_bytes = NULL;    // gdouble per encoded frame
+static GArray *bench_capture_ms = NULL;     // gdouble between consecutive captured frames
+static gint64 bench_last_capture = 0;
+static guint bench_keyframes = 0;
+static guint64 bench_bytes = 0;
+static gint64 bench_started = 0;
+
+// Arrival spacing at the source's pad: scheduling jitter on the capture thread shows up here.
+static GstPadProbeReturn on_bench_capture(GstPad * /*pad*/, GstPadProbeInfo * /*info*/, gpointer /*data*/) {
+    gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&bench_lock);
+    if (bench_last_capture) {
+        gdouble ms = ms_since(bench_last_capture, now);
+        g_array_append_val(bench_capture_ms, ms);
+    }
+    bench_last_capture = now;
+    g_mutex_unlock(&bench_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn on_bench_frame(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer /*data*/) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gdouble size = gst_buffer_get_size(buf);
+    g_mutex_lock(&bench_lock);
+    g_array_append_val(bench_frame_bytes, size);
+    if (!GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT)) bench_keyframes++;
+    g_mutex_unlock(&bench_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn on_bench_rtp(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer /*data*/) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClock *clock = gst_element_get_clock(pipeline);
+    if (!clock || !GST_CLOCK_TIME_IS_VALID(buf->pts)) { if (clock) gst_object_unref(clock); return GST_PAD_PROBE_OK; }
+    GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(pipeline);
+    gst_object_unref(clock);
+
+    gdouble ms = ((gint64)now - (gint64)buf->pts) / 1e6;
+    g_mutex_lock(&bench_lock);
+    g_array_append_val(bench_latency_ms, ms);
+    bench_bytes += gst_buffer_get_size(buf);
+    g_mutex_unlock(&bench_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b) {
+    gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+    return (x > y) - (x < y);
+}
+
+static gboolean on_bench_done(gpointer /*user_data*/) {
+    g_mutex_lock(&bench_lock);
+    gdouble secs = ms_since(bench_started, g_get_monotonic_time()) / 1000.0;
+    guint n = bench_latency_ms->len;
+    g_array_sort(bench_latency_ms, compare_double);
+    gdouble *v = (gdouble *)(void *)bench_latency_ms->data;
+    if (n) {
+        g_print("profile %s: latency p50 %.1f, p95 %.1f, p99 %.1f, max %.1f ms; bitrate %.0f kbps; %u packets in %.1f s\n",
+                current_desc.profile->name, v[n / 2], v[MIN(n - 1, n * 95 / 100)], v[MIN(n - 1, n * 99 / 100)], v[n - 1],
+                bench_bytes * 8 / secs / 1000.0, n, secs);
+    } else {
+        g_print("profile %s: no packets\n", current_desc.profile->name);
+    }
+    guint frames = bench_frame_bytes->len;
+    if (frames) {
+        gdouble *f = (gdouble *)(void *)bench_frame_bytes->data;
+        gdouble sum = 0, sq = 0, max = 0;
+        for (guint i = 0; i < frames; i++) { sum += f[i]; sq += f[i] * f[i]; max = MAX(max, f[i]); }
+        gdouble mean = sum / frames, sd = sqrt(MAX(0.0, sq / frames - mean * mean));
+        g_print("profile %s frames: %u, mean %.1f KB, stddev %.1f KB, max %.1f KB (%.1fx mean), keyframes %u\n",
+                current_desc.profile->name, frames, mean / 1024, sd / 1024, max / 1024, max / mean, bench_keyframes);
+    }
+    guint intervals = bench_capture_ms->len;
+    if (intervals) {
+        gdouble *c = (gdouble *)(void *)bench_capture_ms->data;
+        gdouble sum = 0, sq = 0;
+        for (guint i = 0; i < intervals; i++) { sum += c[i]; sq += c[i] * c[i]; }
+        gdouble mean = sum / intervals, sd = sqrt(MAX(0.0, sq / intervals - mean * mean));
+        g_array_sort(bench_capture_ms, compare_double);
+        g_print("profile %s capture: interval mean %.2f, p50 %.2f, p99 %.2f, max %.2f ms, jitter (stddev) %.2f ms\n",
+                current_desc.profile->name, mean, c[intervals / 2], c[MIN(intervals - 1, intervals * 99 / 100)],
+                c[intervals - 1], sd);
+    }
+    g_mutex_unlock(&bench_lock);
+    print_threads_placed();
+    if (g_str_equal(current_desc.source->name, "app")) print_app_stats();
+    if (config.skip_static) print_skip_stats();
+    if (config.bench_quality) print_quality_stats();
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+static void start_profile_bench() {
+    bench_latency_ms = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    bench_frame_bytes = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    bench_capture_ms = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    bench_started = g_get_monotonic_time();
+    GstPad *pad = gst_element_get_static_pad(bench_chain->pay, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_bench_rtp, NULL, NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(chain_frames(bench_chain), "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_bench_frame, NULL, NULL);
+    gst_object_unref(pad);
+    // rtspsrc has no static pad; its arrival spacing is the network's anyway
+    pad = gst_element_get_static_pad(vchain.src, "src");
+    if (pad) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_bench_capture, NULL, NULL);
+        gst_object_unref(pad);
+    }
+    if (g_str_equal(current_desc.source->name, "app")) {
+        pad = gst_element_get_static_pad(bench_chain->enc, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_app_encoder_input, NULL, NULL);
+        gst_object_unref(pad);
+    }
+    g_timeout_add_seconds(config.bench_seconds, on_bench_done, NULL);
+}
+
+static gboolean on_first_rtp(gpointer /*user_data*/) {
+    gboolean first = !startup_reported;
+    log_startup_phases();
+    pipeline_restarts = 0;
+    if (config.bench_startup) g_main_loop_quit(loop);
+    else if (config.bench_seconds && first) start_profile_bench();
+    return G_SOURCE_REMOVE;
+}
+
+// One-shot probes: the first buffer out of the encoder and out of the payloader.
+static GstPadProbeReturn on_first_buffer(GstPad * /*pad*/, GstPadProbeInfo * /*info*/, gpointer data) {
+    gint64 *slot = (gint64 *)data;
+    *slot = g_get_monotonic_time();
+    if (slot == &startup.first_rtp) g_idle_add(on_first_rtp, NULL);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void arm_first_buffer_probes(EncodeChain *c) {
+    startup.first_frame = startup.first_rtp = 0;
+    GstPad *pad = gst_element_get_static_pad(chain_frames(c), "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_first_buffer, &startup.first_frame, NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(c->pay, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_first_buffer, &startup.first_rtp, NULL);
+    gst_object_unref(pad);
+}
+
+static void print_configuration(const PipelineDesc &d) {
+    g_print("\n=== Configuration ===\n");
+    g_print("Codecs:    ");
+    for (guint i = 0; i < n_offered_codecs; i++)
+        g_print(" %s (%s)", offered_codecs[i]->name,
+                encoder_factory(offered_codecs[i], d) ? encoder_factory(offered_codecs[i], d) : "passthrough");
+    g_print("\n");
+    g_print("Encoder:    %s backend, started per codec on demand\n", d.encoder->name);
+    g_print("Profile:    %s\n", d.profile->name);
+    g_print("GOP:        %d frames, intra refresh %s\n", effective_gop(d), d.intra_refresh.c_str());
+    g_print("Resolution: %dx%d\n", d.width, d.height);
+    g_print("Framerate:  %d fps\n", d.fps);
+    g_print("Bitrate:    %d kbps\n", d.bitrate);
+    if (config.idle_suspend_ms) g_print("Idle:       capture suspended %d ms after the last viewer\n", config.idle_suspend_ms);
+    if (config.skip_static)
+        g_print("Static:     frames with no 16x16 block changed by %d/px dropped, at least %d fps kept (%s)\n",
+                config.skip_static, config.skip_min_fps, frame_diff_kernel_name());
+    print_thread_placement();
+    if (config.multicast_group)
+        g_print("Multicast:  %s to %s, video :%d, audio :%d, ttl %d%s%s%s\n", config.multicast_srtp ? "SRTP" : "RTP",
+                config.multicast_group, config.multicast_port, config.multicast_port + 2, config.multicast_ttl,
+                config.multicast_sdp ? ", SDP in " : "", config.multicast_sdp ? config.multicast_sdp : "",
+                config.multicast_http_port ? ", SDP over HTTP" : "");
+    if (d.source->compressed)
+        g_print("Source:     %s %s, %s passed through\n", d.source->name,
+                d.input.empty() ? d.device.c_str() : d.input.c_str(), d.codec.c_str());
+    else if (g_str_equal(d.source->name, "app"))
+        g_print("Source:     app, %s frames pushed by the caller\n", config.app_format);
+    else if (g_str_equal(d.source->name, "replay"))
+        g_print("Source:     replay %s, %u frames at %d/%d fps, looped, %s\n", d.input.c_str(),
+                replay.frames->len, replay.fps_n, replay.fps_d, config.replay_load);
+    else
+        g_print("Source:     %s\n", g_str_equal(d.source->name, "v4l2") ? d.device.c_str() : d.source->element);
+    g_print("Viewers:    up to %d in room '%s'\n", config.max_viewers, config.room);
+    g_print("====================\n\n");
+}
+
+static gboolean build_and_start_pipeline() {
+    current_desc = pipeline_desc_from_config();
+    print_configuration(current_desc);
+    for (guint i = 0; i < G_N_ELEMENTS(codecs); i++) encode_chains[i].codec = &codecs[i];
+    codec_preferences = build_codec_preferences();
+
+    pipeline = gst_pipeline_new("sender");
+    audio_tee = make_element("tee", "audiotee");
+    if (!audio_tee) {
+        g_printerr("Failed to create tees\n");
+        stop_and_destroy_pipeline();
+        return FALSE;
+    }
+    g_object_set(audio_tee, "allow-not-linked", TRUE, NULL);
+    // Keep our own ref; the bin holds the other.
+    gst_bin_add(GST_BIN(pipeline), GST_ELEMENT(gst_object_ref(audio_tee)));
+
+    if (!create_video_chain(current_desc) || !create_audio_chain()) {
+        g_printerr("Failed to create pipeline elements\n");
+        stop_and_destroy_pipeline();
+        return FALSE;
+    }
+    configure_video_chain(current_desc);
+    // Benchmarks have no viewer to start an encoder, so they hold one themselves.
+    if (config.bench_startup || config.bench_seconds) {
+        bench_chain = acquire_encoder(find_codec(current_desc.codec.c_str()));
+        if (!bench_chain) {
+            g_printerr("Failed to start the %s encoder\n", current_desc.codec.c_str());
+            stop_and_destroy_pipeline();
+            return FALSE;
+        }
+        arm_first_buffer_probes(bench_chain);
+        // From the start, so the decoder sees the first keyframe
+        if (config.bench_quality && !attach_quality_receiver(bench_chain)) {
+            g_printerr("Failed to create the quality receiver\n");
+            stop_and_destroy_pipeline();
+            return FALSE;
+        }
+    } else if (config.idle_suspend_ms && !config.multicast_group) {
+        park_preferred_encoder();
+    }
+    if (config.multicast_group && !start_multicast()) {
+        stop_and_destroy_pipeline();
+        return FALSE;
+    }
+    startup.built = g_get_monotonic_time();
+
+    // The watch holds a bus ref; stop_and_destroy_pipeline removes it so the
+    // bus goes with the pipeline.
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_add_watch(bus, on_bus_message, NULL);
+    if (placement_enabled) gst_bus_set_sync_handler(bus, on_bus_sync_message, NULL, NULL);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    g_print("Pipeline started\n");
+    return TRUE;
+}
+
+// Capture side in link order, transcode branch included. Called with encoders_lock held.
+static void collect_capture_elements(GPtrArray *out) {
+    GstElement *capture[] = { vchain.src, vchain.srccaps, vchain.demux, vchain.parse, vchain.pace, vchain.ctee,
+                              vchain.dqueue, vchain.decode, vchain.convert, vchain.rawtee };
+    for (GstElement *e : capture) if (e) g_ptr_array_add(out, e);
+}
+
+// Capture and every running encoder. Called with encoders_lock held.
+static void set_video_chain_state(GstState state) {
+    GPtrArray *elems = g_ptr_array_new();
+    collect_capture_elements(elems);
+    for (EncodeChain &c : encode_chains) {
+        GstElement *chain[] = { c.queue, c.enc, c.enccaps, c.parse, c.pay, c.rtpcaps, c.tee };
+        for (GstElement *e : chain) if (e) g_ptr_array_add(elems, e);
+    }
+    // Upstream first on the way down, downstream first on the way up.
+    if (state == GST_STATE_NULL) {
+        for (guint i = 0; i < elems->len; i++) gst_element_set_state((GstElement *)g_ptr_array_index(elems, i), GST_STATE_NULL);
+    } else {
+        for (gint i = elems->len - 1; i >= 0; i--) gst_element_sync_state_with_parent((GstElement *)g_ptr_array_index(elems, i));
+    }
+    g_ptr_array_unref(elems);
+}
+
+// Restart capture and the running encoders in place. The tees, the audio
+// branch and the session branches stay linked, so viewers only see a gap.
+static gboolean restart_pipeline() {
+    g_print("Restarting video chain\n");
+    startup.built = g_get_monotonic_time();
+
+    g_mutex_lock(&encoders_lock);
+    // Capture restarts unlocked; with nobody watching it suspends again
+    if (capture_suspended) {
+        set_capture_suspended(FALSE);
+        schedule_idle_suspend(config.idle_suspend_ms);
+    }
+    set_video_chain_state(GST_STATE_NULL);
+    configure_video_chain(current_desc);
+    EncodeChain *first = NULL;
+    for (EncodeChain &c : encode_chains) {
+        if (!c.tee) continue;
+        configure_encode_chain(&c, current_desc);
+        if (!first) first = &c;
+    }
+    if (first) arm_first_buffer_probes(first);
+    else pipeline_restarts = 0;         // nothing encodes, so no first RTP to wait for
+    set_video_chain_state(GST_STATE_PLAYING);
+    g_mutex_unlock(&encoders_lock);
+    apply_bitrate_hints(NULL);
+    return TRUE;
+}
+
+static void stop_and_destroy_pipeline() {
+    if (!pipeline) return;
+    g_print("Stopping pipeline...\n");
+    // Locked elements would not follow the pipeline down
+    g_mutex_lock(&encoders_lock);
+    if (capture_suspended) set_capture_suspended(FALSE);
+    if (idle_suspend_id) { g_source_remove(idle_suspend_id); idle_suspend_id = 0; }
+    g_mutex_unlock(&encoders_lock);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    stop_multicast();
+    if (audio_tee) { gst_object_unref(audio_tee); audio_tee = NULL; }
+    audio_src = NULL;
+    // The bin owns the encoder elements; the chain slots just forget them.
+    g_mutex_lock(&encoders_lock);
+    for (EncodeChain &c : encode_chains) {
+        cancel_pending_keyframe(&c);
+        c.queue = c.enc = c.enccaps = c.parse = c.pay = c.rtpcaps = c.tee = NULL;
+        c.viewers = 0;
+    }
+    bench_chain = NULL;
+    g_mutex_unlock(&encoders_lock);
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_remove_watch(bus);
+    gst_object_unref(bus);
+    gst_object_unref(pipeline); pipeline = NULL;
+    memset(&vchain, 0, sizeof(vchain));
+    g_print("Pipeline destroyed\n");
+}
+
+static gboolean is_video_chain_element(GstObject *obj) {
+    gboolean found = FALSE;
+    g_mutex_lock(&encoders_lock);
+    GPtrArray *capture = g_ptr_array_new();
+    collect_capture_elements(capture);
+    for (guint i = 0; i < capture->len; i++)
+        if (gst_object_has_as_ancestor(obj, GST_OBJECT(g_ptr_array_index(capture, i)))) found = TRUE;
+    g_ptr_array_unref(capture);
+    for (EncodeChain &c : encode_chains) {
+        GstElement *chain[] = { c.queue, c.enc, c.enccaps, c.parse, c.pay, c.rtpcaps, c.tee };
+        for (GstElement *e : chain) if (e && GST_OBJECT(e) == obj) found = TRUE;
+    }
+    g_mutex_unlock(&encoders_lock);
+    return found;
+}
+
+// ===================== ICE recovery =====================
+// A DISCONNECTED viewer gets ice_grace_ms to come back on its own. After that
+// the session sends an ice-restart offer on the same webrtcbin, so DTLS and
+// the shared encoder stay up; only a FAILED restart tears the session down.
+static void cancel_ice_timer(PeerSession *s) {
+    if (!s->ice_timer) return;
+    g_source_destroy(s->ice_timer);
+    g_source_unref(s->ice_timer);
+    s->ice_timer = NULL;
+}
+
+static void arm_ice_timer(PeerSession *s, guint ms, GSourceFunc func) {
+    cancel_ice_timer(s);
+    s->ice_timer = g_timeout_source_new(ms);
+    g_source_set_callback(s->ice_timer, func, s, NULL);     // cancelled before the session ends
+    g_source_attach(s->ice_timer, s->context);
+}
+
+static gboolean on_ice_restart_expired(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    g_source_unref(s->ice_timer); s->ice_timer = NULL;
+    g_printerr("[%s] ICE restart did not recover within %u ms\n", s->id, ice_restart_timeout_ms);
+    g_main_loop_quit(s->loop);
+    return G_SOURCE_REMOVE;
+}
+
+static void start_ice_restart(PeerSession *s) {
+    g_print("[%s] Restarting ICE\n", s->id);
+    s->ice_restarting = TRUE;
+    s->neg_retries = 0;
+    s->t_request = 0;
+    set_neg_state(s, NEG_IDLE);          // a stale offer must not block the restart
+    force_renegotiate(s, TRUE);
+    arm_ice_timer(s, ice_restart_timeout_ms, on_ice_restart_expired);
+}
+
+static gboolean on_ice_grace_expired(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    g_source_unref(s->ice_timer); s->ice_timer = NULL;
+    g_print("[%s] Still disconnected after %d ms\n", s->id, config.ice_grace_ms);
+    start_ice_restart(s);
+    return G_SOURCE_REMOVE;
+}
+
+// ===================== Session branch =====================
+// The encoder is shared, so a (re)joined viewer needs its own IDR to start decoding.
+static void request_keyframe(PeerSession *s) {
+    g_atomic_int_inc(&kf_local_requests);
+    gst_element_send_event(s->vqueue, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+}
+
+static gboolean on_session_pc_state(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    if (s->closed) return G_SOURCE_REMOVE;
+
+    GstWebRTCPeerConnectionState st; g_object_get(s->webrtc, "connection-state", &st, NULL);
+    if (st == GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED) {
+        if (!s->t_dtls_connected) s->t_dtls_connected = g_get_monotonic_time();
+        check_connected(s);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_session_gathering_state(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    if (s->closed) return G_SOURCE_REMOVE;
+    GstWebRTCICEGatheringState st; g_object_get(s->webrtc, "ice-gathering-state", &st, NULL);
+    const char* str = (st==GST_WEBRTC_ICE_GATHERING_STATE_NEW)?"new":
+                      (st==GST_WEBRTC_ICE_GATHERING_STATE_GATHERING)?"gathering":
+                      (st==GST_WEBRTC_ICE_GATHERING_STATE_COMPLETE)?"complete":"unknown";
+    g_print("[%s] ICE gathering state: %s\n", s->id, str);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_session_ice_state(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    if (s->closed) return G_SOURCE_REMOVE;
+
+    GstWebRTCICEConnectionState st; g_object_get(s->webrtc, "ice-connection-state", &st, NULL);
+    const char* str = (st==GST_WEBRTC_ICE_CONNECTION_STATE_NEW)?"new":
+                      (st==GST_WEBRTC_ICE_CONNECTION_STATE_CHECKING)?"checking":
+                      (st==GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED)?"connected":
+                      (st==GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED)?"completed":
+                      (st==GST_WEBRTC_ICE_CONNECTION_STATE_FAILED)?"failed":
+                      (st==GST_WEBRTC_ICE_CONNECTION_STATE_DISCONNECTED)?"disconnected":
+                      (st==GST_WEBRTC_ICE_CONNECTION_STATE_CLOSED)?"closed":"unknown";
+    g_print("[%s] ICE connection state: %s\n", s->id, str);
+
+    gint64 now = g_get_monotonic_time();
+    switch (st) {
+        case GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED:
+        case GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED:
+            if (!s->t_ice_connected) s->t_ice_connected = now;
+            if (s->t_disconnected) {
+                g_print("[%s] ✓ ICE recovered in %.1f ms (%s)\n", s->id, ms_since(s->t_disconnected, now),
+                        s->ice_restarting ? "ice-restart" : "no restart");
+                cancel_ice_timer(s);
+                s->t_disconnected = 0;
+                s->ice_restarting = FALSE;
+                request_keyframe(s);
+            }
+            check_connected(s);
+            break;
+        case GST_WEBRTC_ICE_CONNECTION_STATE_DISCONNECTED:
+            if (!s->t_disconnected) {
+                s->t_disconnected = now;
+                arm_ice_timer(s, config.ice_grace_ms, on_ice_grace_expired);
+            }
+            break;
+        case GST_WEBRTC_ICE_CONNECTION_STATE_FAILED:
+            if (s->ice_restarting) {
+                g_printerr("[%s] ✗ ICE restart failed\n", s->id);
+                g_main_loop_quit(s->loop);
+            } else {
+                if (!s->t_disconnected) s->t_disconnected = now;
+                start_ice_restart(s);
+            }
+            break;
+        case GST_WEBRTC_ICE_CONNECTION_STATE_CLOSED:
+            g_main_loop_quit(s->loop);
+            break;
+        default: break;
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void connect_webrtc_signals(PeerSession *s) {
+    g_assert(s->webrtc != NULL);
+    g_signal_connect(s->webrtc, "on-negotiation-needed",  G_CALLBACK(on_negotiation_needed), s);
+    g_signal_connect(s->webrtc, "on-ice-candidate",       G_CALLBACK(on_ice_candidate), s);
+    g_signal_connect(s->webrtc, "pad-added",              G_CALLBACK(on_incoming_stream), s);
+    // Also where each DTLS transport gets the shared certificate
+    if (bwe_available || dtls_pem)
+        g_signal_connect(s->webrtc, "request-aux-sender", G_CALLBACK(on_request_aux_sender), s);
+    // Emitted on webrtcbin threads; s->id may only be read on the session context.
+    g_signal_connect(s->webrtc, "notify::ice-gathering-state",
+                     G_CALLBACK(+[](GstElement*, GParamSpec*, gpointer data){
+                         session_invoke((PeerSession*)data, on_session_gathering_state);
+                     }), s);
+    g_signal_connect(s->webrtc, "notify::ice-connection-state",
+                     G_CALLBACK(+[](GstElement*, GParamSpec*, gpointer data){
+                         session_invoke((PeerSession*)data, on_session_ice_state);
+                     }), s);
+    // connection-state only reaches CONNECTED once DTLS is up as well.
+    g_signal_connect(s->webrtc, "notify::connection-state",
+                     G_CALLBACK(+[](GstElement*, GParamSpec*, gpointer data){
+                         session_invoke((PeerSession*)data, on_session_pc_state);
+                     }), s);
+}
+
+// caps: codec preferences for the new transceiver, NULL = take them from the stream.
+static gboolean link_to_webrtc(GstElement *queue, GstElement *webrtc, GstCaps *caps) {
+    GstPad *src = gst_element_get_static_pad(queue, "src");
+    GstPad *sink = gst_element_get_request_pad(webrtc, "sink_%u");
+    if (caps) {
+        GstWebRTCRTPTransceiver *trans = NULL;
+        g_object_get(sink, "transceiver", &trans, NULL);
+        if (trans) { g_object_set(trans, "codec-preferences", caps, NULL); gst_object_unref(trans); }
+    }
+    gboolean ok = gst_pad_link(src, sink) == GST_PAD_LINK_OK;
+    gst_object_unref(src); gst_object_unref(sink);
+    return ok;
+}
+
+static gboolean link_tee_to(GstElement *tee, GstElement *queue) {
+    GstPad *src = gst_element_get_request_pad(tee, "src_%u");
+    GstPad *sink = gst_element_get_static_pad(queue, "sink");
+    gboolean ok = gst_pad_link(src, sink) == GST_PAD_LINK_OK;
+    gst_object_unref(src); gst_object_unref(sink);
+    return ok;
+}
+
+static void unlink_from_tee(GstElement *tee, GstElement *queue) {
+    GstPad *sink = gst_element_get_static_pad(queue, "sink");
+    GstPad *src = gst_pad_get_peer(sink);
+    if (src) {
+        gst_pad_unlink(src, sink);
+        gst_element_release_request_pad(tee, src);
+        gst_object_unref(src);
+    }
+    gst_object_unref(sink);
+}
+
+// Runs on the session worker.
+static gboolean attach_session_branch(PeerSession *s) {
+    gchar *name = g_strdup_printf("webrtc-%s", s->id);
+    s->webrtc = make_element("webrtcbin", name);
+    g_free(name);
+    s->vqueue = make_element("queue", NULL);
+    s->aqueue = make_element("queue", NULL);
+    if (!s->webrtc || !s->vqueue || !s->aqueue) {
+        g_printerr("[%s] Failed to create session elements\n", s->id);
+        return FALSE;
+    }
+    set_thread_class(s->webrtc, THREAD_NETWORK);
+    set_thread_class(s->vqueue, THREAD_NETWORK);
+    set_thread_class(s->aqueue, THREAD_NETWORK);
+    gst_util_set_object_arg(G_OBJECT(s->webrtc), "bundle-policy", "max-bundle");
+    const LatencyProfile *p = current_desc.profile;
+    g_object_set(s->webrtc, "latency", p->webrtc_latency_ms, "stun-server", "stun://stun.l.google.com:19302", NULL);
+    // A slow viewer must not back-pressure the shared tees.
+    gst_util_set_object_arg(G_OBJECT(s->vqueue), "leaky", "downstream");
+    gst_util_set_object_arg(G_OBJECT(s->aqueue), "leaky", "downstream");
+    if (p->session_queue_ms) {
+        // Bound by time only: a congested viewer drops frames instead of falling behind.
+        GstElement *queues[] = { s->vqueue, s->aqueue };
+        for (GstElement *q : queues)
+            g_object_set(q, "max-size-time", (guint64)p->session_queue_ms * GST_MSECOND,
+                         "max-size-buffers", 0, "max-size-bytes", 0, NULL);
+    }
+
+    gst_bin_add_many(GST_BIN(pipeline), s->vqueue, s->aqueue, s->webrtc, NULL);
+    connect_webrtc_signals(s);
+
+    // webrtcbin numbers m-lines by request order: video 0, audio 1. Video offers
+    // every codec and is fed by that codec's encoder once the answer picked one.
+    if (!link_to_webrtc(s->vqueue, s->webrtc, codec_preferences) ||
+        !link_to_webrtc(s->aqueue, s->webrtc, NULL) || !link_tee_to(audio_tee, s->aqueue)) {
+        g_printerr("[%s] Failed to link session branch\n", s->id);
+        return FALSE;
+    }
+    gst_element_sync_state_with_parent(s->webrtc);
+    gst_element_sync_state_with_parent(s->vqueue);
+    gst_element_sync_state_with_parent(s->aqueue);
+    open_data_channels(s);      // before the first offer, so it carries the SCTP m-line
+    return TRUE;
+}
+
+// Session context, once an answer picked the codec; a renegotiation that keeps
+// it changes nothing.
+static void attach_to_encoder(PeerSession *s, const CodecInfo *codec) {
+    if (s->chain && s->chain->codec == codec) return;
+    detach_from_encoder(s);
+    EncodeChain *c = acquire_encoder(codec);
+    if (!c || !link_tee_to(c->tee, s->vqueue)) {
+        g_printerr("[%s] Failed to attach to the %s encoder\n", s->id, codec->name);
+        if (c) release_encoder(c);
+        return;
+    }
+    g_mutex_lock(&sessions_lock);
+    s->chain = c;
+    g_mutex_unlock(&sessions_lock);
+    g_print("[%s] Video: %s\n", s->id, codec->name);
+    g_main_context_invoke(NULL, apply_bitrate_hints, NULL);
+    request_keyframe(s);
+}
+
+static void detach_from_encoder(PeerSession *s) {
+    EncodeChain *c = s->chain;
+    if (!c) return;
+    unlink_from_tee(c->tee, s->vqueue);
+    g_mutex_lock(&sessions_lock);
+    s->chain = NULL;
+    g_mutex_unlock(&sessions_lock);
+    release_encoder(c);
+}
+
+static void detach_session_branch(PeerSession *s) {
+    close_data_channels(s);
+    if (s->webrtc) g_signal_handlers_disconnect_by_data(s->webrtc, s);
+    if (s->vqueue) detach_from_encoder(s);
+    if (s->aqueue) unlink_from_tee(audio_tee, s->aqueue);
+
+    GstElement *elems[] = { s->webrtc, s->vqueue, s->aqueue };
+    for (GstElement *e : elems) {
+        if (!e) continue;
+        gst_element_set_state(e, GST_STATE_NULL);
+        if (GST_OBJECT_PARENT(e)) gst_bin_remove(GST_BIN(pipeline), e);
+        else gst_object_unref(e);
+    }
+    s->webrtc = s->vqueue = s->aqueue = NULL;
+}
+
+// ===================== Data channels =====================
+// Two SCTP channels per viewer, negotiated with the media. "control" carries
+// viewer commands (ping, keyframe, bitrate) without the signaling relay hop;
+// "telemetry" carries sender stats that are useless once late, so it is
+// unordered with no retransmits. The same control messages are accepted over
+// the WebSocket ({"type":"control"} relayed by the server) for comparison.
+static void send_on_channel(GstWebRTCDataChannel *channel, JsonObject *msg) {
+    GstWebRTCDataChannelState state;
+    g_object_get(channel, "ready-state", &state, NULL);
+    if (state != GST_WEBRTC_DATA_CHANNEL_STATE_OPEN) return;
+    JsonNode *root = json_node_new(JSON_NODE_OBJECT);
+    json_node_set_object(root, msg);
+    gchar *text = json_to_string(root, FALSE);
+    json_node_free(root);
+    gst_webrtc_data_channel_send_string(channel, text);
+    g_free(text);
+}
+
+// Replies go back the way the command came.
+static void send_control_reply(PeerSession *s, JsonObject *msg, gboolean via_dc) {
+    json_object_set_string_member(msg, "type", "control");
+    if (via_dc) {
+        if (s->control) send_on_channel(s->control, msg);
+        return;
+    }
+    json_object_set_string_member(msg, "to", s->id);
+    send_json_message(msg);
+}
+
+// Session context.
+static void handle_control_message(PeerSession *s, JsonObject *object) {
+    const gchar *cmd = json_object_get_string_member(object, "cmd");
+    gboolean via_dc = json_object_get_boolean_member_with_default(object, "dc", FALSE);
+
+    if (g_strcmp0(cmd, "ping") == 0) {
+        JsonObject *reply = json_object_new();
+        json_object_set_string_member(reply, "cmd", "pong");
+        if (json_object_has_member(object, "t"))
+            json_object_set_member(reply, "t", json_node_copy(json_object_get_member(object, "t")));
+        send_control_reply(s, reply, via_dc);
+        json_object_unref(reply);
+
+    } else if (g_strcmp0(cmd, "keyframe") == 0) {
+        g_print("[%s] Keyframe requested (%s)\n", s->id, via_dc ? "data channel" : "signaling");
+        request_keyframe(s);
+
+    } else if (g_strcmp0(cmd, "bitrate") == 0) {
+        // The encoder is shared, so one viewer may not starve the rest: a
+        // hint lies in [bwe_min_kbps, --max-bitrate], 0 clears it.
+        gint64 kbps = json_object_get_int_member_with_default(object, "kbps", 0);
+        gint max_kbps = config.max_bitrate ? config.max_bitrate : current_desc.bitrate;
+        if (kbps < 0 || (kbps > 0 && kbps < bwe_min_kbps)) {
+            g_printerr("[%s] Bitrate hint %" G_GINT64_FORMAT " kbps out of range, ignored\n", s->id, kbps);
+            return;
+        }
+        if (kbps > max_kbps) {
+            g_print("[%s] Bitrate hint %" G_GINT64_FORMAT " kbps capped at %d\n", s->id, kbps, max_kbps);
+            kbps = max_kbps;
+        }
+        g_print("[%s] Bitrate hint: %d kbps\n", s->id, (gint)kbps);
+        g_mutex_lock(&sessions_lock);
+        s->bitrate_hint_kbps = (gint)kbps;
+        g_mutex_unlock(&sessions_lock);
+        g_main_context_invoke(NULL, apply_bitrate_hints, NULL);
+    }
+}
+
+static gboolean send_telemetry(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    JsonObject *msg = json_object_new();
+    json_object_set_string_member(msg, "type", "telemetry");
+    json_object_set_int_member(msg, "t", g_get_real_time() / 1000);     // sender wall clock, ms
+    if (s->chain) {
+        json_object_set_string_member(msg, "codec", s->chain->codec->name);
+        json_object_set_int_member(msg, "frames", g_atomic_int_get(&s->chain->frames));
+        json_object_set_int_member(msg, "keyframes", g_atomic_int_get(&s->chain->keyframes));
+        json_object_set_int_member(msg, "kbps", g_atomic_int_get(&s->chain->kbps));
+    }
+    g_mutex_lock(&sessions_lock);
+    json_object_set_int_member(msg, "viewers", g_hash_table_size(sessions));
+    g_mutex_unlock(&sessions_lock);
+    send_on_channel(s->telemetry, msg);
+    json_object_unref(msg);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean start_telemetry(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    if (s->closed || s->telemetry_timer || !s->telemetry) return G_SOURCE_REMOVE;
+    g_print("[%s] Data channels open\n", s->id);
+    s->telemetry_timer = g_timeout_source_new(telemetry_interval_ms);
+    g_source_set_callback(s->telemetry_timer, send_telemetry, s, NULL);
+    g_source_attach(s->telemetry_timer, s->context);
+    return G_SOURCE_REMOVE;
+}
+
+// SCTP thread: hand the command to the session like any signaling message.
+static void on_control_message(GstWebRTCDataChannel * /*channel*/, gchar *text, gpointer data) {
+    JsonParser *parser = json_parser_new();
+    if (text && json_parser_load_from_data(parser, text, -1, NULL) &&
+        JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+        JsonNode *node = json_node_copy(json_parser_get_root(parser));
+        JsonObject *object = json_node_get_object(node);
+        json_object_set_string_member(object, "type", "control");
+        json_object_set_boolean_member(object, "dc", TRUE);
+        session_post((PeerSession *)data, node, g_get_monotonic_time());
+    }
+    g_object_unref(parser);
+}
+
+static void open_data_channels(PeerSession *s) {
+    GstStructure *opts = gst_structure_new("control", "ordered", G_TYPE_BOOLEAN, TRUE, NULL);
+    g_signal_emit_by_name(s->webrtc, "create-data-channel", "control", opts, &s->control);
+    gst_structure_free(opts);
+    opts = gst_structure_new("telemetry", "ordered", G_TYPE_BOOLEAN, FALSE,
+                             "max-retransmits", G_TYPE_INT, 0, NULL);
+    g_signal_emit_by_name(s->webrtc, "create-data-channel", "telemetry", opts, &s->telemetry);
+    gst_structure_free(opts);
+    if (!s->control || !s->telemetry) {
+        g_printerr("[%s] Failed to create data channels\n", s->id);
+        close_data_channels(s);
+        return;
+    }
+    g_signal_connect(s->control, "on-message-string", G_CALLBACK(on_control_message), s);
+    g_signal_connect(s->telemetry, "on-open",
+                     G_CALLBACK(+[](GstWebRTCDataChannel*, gpointer data){
+                         session_invoke((PeerSession*)data, start_telemetry);
+                     }), s);
+}
+
+static void close_data_channels(PeerSession *s) {
+    if (s->telemetry_timer) {
+        g_source_destroy(s->telemetry_timer);
+        g_source_unref(s->telemetry_timer);
+        s->telemetry_timer = NULL;
+    }
+    GstWebRTCDataChannel **channels[] = { &s->control, &s->telemetry };
+    for (GstWebRTCDataChannel **ch : channels) {
+        if (!*ch) continue;
+        g_signal_handlers_disconnect_by_data(*ch, s);
+        g_object_unref(*ch);
+        *ch = NULL;
+    }
+}
+
+// ===================== Bandwidth probing =====================
+// rtpgccbwe (Google congestion control on TWCC feedback) sits in front of each
+// viewer's DTLS transport and paces the stream while it ramps its estimate up
+// from --bitrate toward --max-bitrate, backing off fast on delay or loss. For
+// bwe_probe_ms after connect the estimate is only watched; then it becomes the
+// viewer's ceiling and keeps following the estimate in >10% steps.
+static gboolean on_bwe_probe_done(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    g_source_unref(s->probe_timer); s->probe_timer = NULL;
+    gint kbps = MAX(bwe_min_kbps, g_atomic_int_get(&s->bwe_kbps));
+    g_print("[%s] Bandwidth probe: %d kbps after %d ms\n", s->id, kbps, config.bwe_probe_ms);
+    g_mutex_lock(&sessions_lock);
+    s->bwe_ceiling_kbps = kbps;
+    g_mutex_unlock(&sessions_lock);
+    g_main_context_invoke(NULL, apply_bitrate_hints, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+// Session context, after every estimate change.
+static gboolean on_bwe_estimate(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    if (s->closed || !s->t_probe_start) return G_SOURCE_REMOVE;
+    gint kbps = g_atomic_int_get(&s->bwe_kbps);
+    gint64 now = g_get_monotonic_time();
+
+    if (ABS(kbps - s->stable_ref_kbps) * 10 > s->stable_ref_kbps) {
+        s->stable_ref_kbps = kbps;
+        s->t_stable_since = now;
+    } else if (!s->bwe_stable_reported && now - s->t_stable_since >= (gint64)bwe_stable_ms * 1000) {
+        s->bwe_stable_reported = TRUE;
+        g_print("[%s] Bandwidth stable at %d kbps, %.0f ms after connect\n",
+                s->id, s->stable_ref_kbps, ms_since(s->t_probe_start, s->t_stable_since));
+    }
+
+    if (s->probe_timer) return G_SOURCE_REMOVE;
+    kbps = MAX(bwe_min_kbps, kbps);
+    g_mutex_lock(&sessions_lock);
+    gboolean changed = ABS(kbps - s->bwe_ceiling_kbps) * 10 > s->bwe_ceiling_kbps;
+    if (changed) s->bwe_ceiling_kbps = kbps;
+    g_mutex_unlock(&sessions_lock);
+    if (changed) g_main_context_invoke(NULL, apply_bitrate_hints, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_estimated_bitrate(GObject *bwe, GParamSpec * /*pspec*/, gpointer data) {
+    guint bps = 0;
+    g_object_get(bwe, "estimated-bitrate", &bps, NULL);
+    g_atomic_int_set(&((PeerSession *)data)->bwe_kbps, (gint)(bps / 1000));
+    session_invoke((PeerSession *)data, on_bwe_estimate);
+}
+
+// webrtcbin thread, once per DTLS transport (one with max-bundle).
+static GstElement *on_request_aux_sender(GstElement * /*webrtc*/, GstWebRTCDTLSTransport *dtls, gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    apply_dtls_certificate(dtls);
+    if (!bwe_available) return NULL;
+    GstElement *bwe = make_element("rtpgccbwe", NULL);
+    if (!bwe) return NULL;
+    gint max_kbps = config.max_bitrate ? config.max_bitrate : config.bitrate;
+    g_object_set(bwe, "min-bitrate", (guint)bwe_min_kbps * 1000, "max-bitrate", (guint)max_kbps * 1000,
+                 "estimated-bitrate", (guint)config.bitrate * 1000, NULL);
+    g_atomic_int_set(&s->bwe_kbps, config.bitrate);
+    s->bwe = GST_ELEMENT(gst_object_ref(bwe));
+    g_signal_connect(bwe, "notify::estimated-bitrate", G_CALLBACK(on_estimated_bitrate), s);
+    return bwe;
+}
+
+static void start_bwe_probe(PeerSession *s) {
+    if (!s->bwe || s->t_probe_start) return;    // once per session; ICE restarts keep the estimate
+    s->t_probe_start = s->t_stable_since = g_get_monotonic_time();
+    s->stable_ref_kbps = g_atomic_int_get(&s->bwe_kbps);
+    s->probe_timer = g_timeout_source_new(config.bwe_probe_ms);
+    g_source_set_callback(s->probe_timer, on_bwe_probe_done, s, NULL);
+    g_source_attach(s->probe_timer, s->context);
+}
+
+static void stop_bwe(PeerSession *s) {
+    if (s->probe_timer) {
+        g_source_destroy(s->probe_timer);
+        g_source_unref(s->probe_timer);
+        s->probe_timer = NULL;
+    }
+    if (s->bwe) {
+        g_signal_handlers_disconnect_by_data(s->bwe, s);
+        gst_object_unref(s->bwe);
+        s->bwe = NULL;
+    }
+}
+
+// ===================== Session worker =====================
+static void handle_session_message(PeerSession *s, JsonObject *object, gint64 received) {
+    const gchar *msg_type = json_object_get_string_member(object, "type");
+
+    if (g_strcmp0(msg_type, "local-candidate") == 0) {
+        handle_local_candidate(s, json_object_get_object_member(object, "candidate"));
+
+    } else if (g_strcmp0(msg_type, "request-offer") == 0 && s->from_pool) {
+        const gchar *viewer = json_object_get_string_member(object, "from");
+        g_print("[%s] Claimed by %s\n", s->id, viewer);
+        g_free(s->id);
+        s->id = g_strdup(viewer);
+        s->from_pool = FALSE;
+        cancel_ice_timer(s);                 // the pool idle deadline
+        s->t_request = received;
+        s->t_offer_sent = 0;
+        s->warm_claim = TRUE;
+        // Offer ready: send it now; otherwise on_local_description_set sends it.
+        if (s->t_local_set) send_offer(s);
+
+    } else if (g_strcmp0(msg_type, "request-offer") == 0) {
+        g_print("[%s] request-offer\n", s->id);
+        s->t_request = received;
+        s->t_offer_sent = 0;
+        s->neg_retries = 0;
+        set_neg_state(s, NEG_IDLE);          // the viewer starts over; drop any stale offer
+        force_renegotiate(s, FALSE);
+
+    } else if (g_strcmp0(msg_type, "answer") == 0) {
+        apply_answer(s, json_object_get_string_member(object, "sdp"), received);
+
+    } else if (g_strcmp0(msg_type, "ice-candidate") == 0) {
+        if (!json_object_has_member(object, "candidate")) return;
+        JsonObject *cand = json_object_get_object_member(object, "candidate");
+        const gchar *candidate_str = json_object_get_string_member(cand, "candidate");
+        if (!candidate_str || !*candidate_str) return;
+        guint sdp_mline_index = json_object_get_int_member(cand, "sdpMLineIndex");
+        g_print("[%s] ✓ Adding ICE candidate [%u]: %s\n", s->id, sdp_mline_index, candidate_str);
+        g_signal_emit_by_name(s->webrtc, "add-ice-candidate", sdp_mline_index, candidate_str);
+
+    } else if (g_strcmp0(msg_type, "control") == 0) {
+        handle_control_message(s, object);
+
+    } else if (g_strcmp0(msg_type, "peer-left") == 0) {
+        g_print("[%s] Peer left\n", s->id);
+        g_main_loop_quit(s->loop);
+    }
+}
+
+static gboolean drain_session_inbox(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    InboxMessage *m;
+    while ((m = (InboxMessage *)g_async_queue_try_pop(s->inbox))) {
+        if (!s->closed) handle_session_message(s, json_node_get_object(m->node), m->received);
+        inbox_message_free(m);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// GThreadPool worker: owns the session's context for the session's lifetime.
+static void session_thread(gpointer data, gpointer /*pool_data*/) {
+    PeerSession *s = (PeerSession *)data;
+    g_main_context_push_thread_default(s->context);
+    g_print("[%s] Session started\n", s->id);
+    if (placement_enabled) apply_thread_placement(THREAD_NETWORK);
+
+    if (attach_session_branch(s)) {
+        if (s->from_pool) {
+            force_renegotiate(s, FALSE);
+            arm_ice_timer(s, warm_pool_max_idle_ms, on_warm_idle_expired);
+        }
+        g_main_loop_run(s->loop);
+    }
+    end_session(s);
+
+    g_main_context_pop_thread_default(s->context);
+    peer_session_unref(s);
+}
+
+static gboolean is_session(gpointer /*key*/, gpointer value, gpointer data) { return value == data; }
+
+static void end_session(PeerSession *s) {
+    guint remaining;
+    g_mutex_lock(&sessions_lock);
+    // A claimed pool session may still carry its pool name, so match by value.
+    g_hash_table_foreach_remove(sessions, is_session, s);
+    if (s->pooled) { g_queue_remove(&warm_pool, s); s->pooled = FALSE; peer_session_unref(s); }
+    remaining = g_hash_table_size(sessions);
+    refill_warm_pool();
+    g_mutex_unlock(&sessions_lock);
+
+    cancel_ice_timer(s);
+    cancel_neg_timer(s);
+    detach_session_branch(s);
+    stop_bwe(s);
+    g_main_context_invoke(NULL, apply_bitrate_hints, NULL);
+
+    // Nothing can be routed here any more; run what is still queued as no-ops
+    // so their session refs are released.
+    s->closed = TRUE;
+    while (g_main_context_iteration(s->context, FALSE)) {}
+    g_print("[%s] Session ended (%u active)\n", s->id, remaining);
+}
+
+// WebSocket thread: hand a message to the viewer's session, creating it on request-offer.
+// A request-offer for a session that already had media comes from a new peer
+// connection (the old one failed, or its sender was given up on): that session
+// cannot be renegotiated into it, so it ends and a fresh one takes the id.
+static void route_to_session(const gchar *viewer, JsonNode *root, gboolean create) {
+    if (!viewer) return;
+    g_mutex_lock(&sessions_lock);
+    PeerSession *s = (PeerSession *)g_hash_table_lookup(sessions, viewer);
+    if (s && create && g_atomic_int_get(&s->media_up)) {
+        g_print("[%s] New peer connection, replacing the session\n", viewer);
+        session_invoke(s, session_quit);
+        g_hash_table_remove(sessions, viewer);      // its thread keeps its own ref until it ends
+        s = NULL;
+    }
+    if (!s && create) {
+        if ((gint)g_hash_table_size(sessions) >= config.max_viewers) {
+            g_printerr("Viewer limit (%d) reached, ignoring %s\n", config.max_viewers, viewer);
+        } else if ((s = (PeerSession *)g_queue_pop_head(&warm_pool))) {
+            s->pooled = FALSE;              // the pool's ref moves to the table
+            g_hash_table_insert(sessions, g_strdup(viewer), s);
+            refill_warm_pool();
+        } else {
+            s = peer_session_new(viewer);
+            g_hash_table_insert(sessions, g_strdup(viewer), s);
+            g_thread_pool_push(session_pool, peer_session_ref(s), NULL);
+        }
+    }
+    if (s) session_post(s, json_node_copy(root), g_get_monotonic_time());
+    g_mutex_unlock(&sessions_lock);
+}
+
+static void end_all_sessions() {
+    g_mutex_lock(&sessions_lock);
+    GHashTableIter it; gpointer value;
+    g_hash_table_iter_init(&it, sessions);
+    while (g_hash_table_iter_next(&it, NULL, &value)) session_invoke((PeerSession *)value, session_quit);
+    for (GList *l = warm_pool.head; l; l = l->next) session_invoke((PeerSession *)l->data, session_quit);
+    g_mutex_unlock(&sessions_lock);
+}
+
+// ----- warm pool -----
+// Called with sessions_lock held. Keeps pool_size idle sessions ready, as long
+// as pool plus viewers stay within max_viewers.
+static void refill_warm_pool() {
+    if (!warm_pool_enabled) return;
+    while ((gint)warm_pool.length < config.pool_size &&
+           (gint)(warm_pool.length + g_hash_table_size(sessions)) < config.max_viewers) {
+        gchar *name = g_strdup_printf("pool-%u", ++warm_pool_seq);
+        PeerSession *s = peer_session_new(name);
+        g_free(name);
+        s->from_pool = TRUE;
+        s->pooled = TRUE;
+        g_queue_push_tail(&warm_pool, s);
+        g_thread_pool_push(session_pool, peer_session_ref(s), NULL);
+    }
+}
+
+// An unclaimed warm session is recycled; a claim that is already on its way wins.
+static gboolean on_warm_idle_expired(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    g_source_unref(s->ice_timer); s->ice_timer = NULL;
+    g_mutex_lock(&sessions_lock);
+    gboolean idle = s->pooled;
+    g_mutex_unlock(&sessions_lock);
+    if (idle) {
+        g_print("[%s] Idle in pool for %u ms, recycling\n", s->id, warm_pool_max_idle_ms);
+        g_main_loop_quit(s->loop);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// ===================== Signaling handlers =====================
+static void on_message(SoupWebsocketConnection *conn, SoupWebsocketDataType type,
+                       GBytes *message, gpointer user_data) {
+    if (type != SOUP_WEBSOCKET_DATA_TEXT) return;
+
+    gsize size;
+    const gchar *data = (const gchar *)g_bytes_get_data(message, &size);
+    gchar *text = g_strndup(data, size);
+    g_print("[ws<-] %s\n", text);
+
+    JsonParser *parser = json_parser_new();
+    if (!json_parser_load_from_data(parser, text, -1, NULL)) {
+        g_printerr("Failed to parse JSON\n");
+        g_free(text); g_object_unref(parser); return;
+    }
+    JsonNode *root = json_parser_get_root(parser);
+    JsonObject *object = json_node_get_object(root);
+    const gchar *msg_type = json_object_get_string_member(object, "type");
+    const gchar *from_id = json_object_has_member(object,"from") ? json_object_get_string_member(object,"from") : NULL;
+
+    if (g_strcmp0(msg_type, "registered") == 0) {
+        g_free(my_id);
+        my_id = g_strdup(json_object_get_string_member(object, "id"));
+        g_free(my_token);
+        my_token = json_object_has_member(object, "token") ? g_strdup(json_object_get_string_member(object, "token")) : NULL;
+        g_print("Registered with ID: %s\n", my_id);
+
+    } else if (g_strcmp0(msg_type, "request-offer") == 0) {
+        if (from_id) g_print("Received request-offer from %s\n", from_id);
+        wake_capture();
+        route_to_session(from_id, root, TRUE);
+
+    } else if (g_strcmp0(msg_type, "answer") == 0 ||
+               g_strcmp0(msg_type, "ice-candidate") == 0 ||
+               g_strcmp0(msg_type, "control") == 0) {
+        route_to_session(from_id, root, FALSE);
+
+    } else if (g_strcmp0(msg_type, "peer-left") == 0) {
+        const gchar *left_id = json_object_has_member(object,"id") ? json_object_get_string_member(object,"id") : NULL;
+        g_print("Peer left notification: %s\n", left_id ? left_id : "(unknown)");
+        route_to_session(left_id, root, FALSE);
+    }
+
+    g_free(text);
+    g_object_unref(parser);
+}
+
+// ===================== ICE / offer =====================
+static void send_ice_candidate_message(PeerSession *s, JsonObject *ice) {
+    JsonObject *msg = json_object_new();
+    json_object_set_string_member(msg, "type", "ice-candidate");
+    json_object_set_object_member(msg, "candidate", json_object_ref(ice));
+    json_object_set_string_member(msg, "to", s->id);
+    send_json_message(msg);
+    json_object_unref(msg);
+}
+
+// Session context: a candidate may only follow the offer it belongs to, and a
+// pre-warmed session has nobody to send it to yet.
+static void handle_local_candidate(PeerSession *s, JsonObject *ice) {
+    g_print("[%s] Generated ICE candidate: %s\n", s->id, json_object_get_string_member(ice, "candidate"));
+    if (s->from_pool || s->neg_state == NEG_CREATING_OFFER || s->neg_state == NEG_SETTING_LOCAL)
+        g_ptr_array_add(s->held_candidates, json_object_ref(ice));
+    else
+        send_ice_candidate_message(s, ice);
+}
+
+// webrtcbin thread: hand the candidate to the session context.
+static void on_ice_candidate(GstElement * /*webrtc*/, guint mlineindex,
+                             gchar *candidate, gpointer user_data) {
+    PeerSession *s = (PeerSession *)user_data;
+    JsonObject *ice = json_object_new();
+    json_object_set_string_member(ice, "candidate", candidate);
+    json_object_set_int_member(ice, "sdpMLineIndex", mlineindex);
+    // NOTE: do NOT set sdpMid (mids change across renegotiations)
+
+    JsonObject *msg = json_object_new();
+    json_object_set_string_member(msg, "type", "local-candidate");
+    json_object_set_object_member(msg, "candidate", ice);
+    JsonNode *node = json_node_new(JSON_NODE_OBJECT);
+    json_node_take_object(node, msg);
+    session_post(s, node, g_get_monotonic_time());
+}
+
+static void on_negotiation_needed(GstElement * /*element*/, gpointer /*user_data*/) {
+    g_print("Negotiation needed signal received\n");
+    // We only create an offer when the viewer asks (request-offer).
+}
+
+static void on_incoming_stream(GstElement * /*webrtc*/, GstPad * /*pad*/, gpointer /*user_data*/) {
+    g_print("Received incoming stream (unexpected for sender)\n");
+}
+
+// ===================== Negotiation =====================
+// webrtcbin replies to promises on its own threads. SessionPromise carries the
+// reply onto the session context and drops it if a newer offer superseded it.
+typedef void (*SessionPromiseHandler)(PeerSession *s, GstPromise *promise);
+
+struct SessionPromise {
+    gint refcount;
+    PeerSession *session;
+    SessionPromiseHandler handler;
+    guint generation;
+    GstPromise *promise;            // held only while the reply is queued
+};
+
+static void session_promise_unref(gpointer data) {
+    SessionPromise *sp = (SessionPromise *)data;
+    if (!g_atomic_int_dec_and_test(&sp->refcount)) return;
+    peer_session_unref(sp->session);
+    g_free(sp);
+}
+
+static gboolean dispatch_session_promise(gpointer data) {
+    SessionPromise *sp = (SessionPromise *)data;
+    PeerSession *s = sp->session;
+    GstPromise *promise = sp->promise; sp->promise = NULL;
+    if (!s->closed && sp->generation == s->neg_generation) sp->handler(s, promise);
+    gst_promise_unref(promise);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_session_promise_changed(GstPromise *promise, gpointer data) {
+    SessionPromise *sp = (SessionPromise *)data;
+    g_atomic_int_inc(&sp->refcount);
+    sp->promise = gst_promise_ref(promise);
+    g_main_context_invoke_full(sp->session->context, G_PRIORITY_DEFAULT,
+                               dispatch_session_promise, sp, session_promise_unref);
+}
+
+static GstPromise *session_promise_new(PeerSession *s, SessionPromiseHandler handler) {
+    SessionPromise *sp = g_new0(SessionPromise, 1);
+    sp->refcount = 1;
+    sp->session = peer_session_ref(s);
+    sp->handler = handler;
+    sp->generation = s->neg_generation;
+    return gst_promise_new_with_change_func(on_session_promise_changed, sp, session_promise_unref);
+}
+
+// A replied promise without an "error" field counts as success.
+static gboolean promise_succeeded(PeerSession *s, GstPromise *promise, const gchar *what) {
+    if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+        g_printerr("[%s] %s was interrupted\n", s->id, what);
+        return FALSE;
+    }
+    const GstStructure *reply = gst_promise_get_reply(promise);
+    if (reply && gst_structure_has_field(reply, "error")) {
+        GError *err = NULL;
+        gst_structure_get(reply, "error", G_TYPE_ERROR, &err, NULL);
+        g_printerr("[%s] %s failed: %s\n", s->id, what, err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void cancel_neg_timer(PeerSession *s) {
+    if (!s->neg_timer) return;
+    g_source_destroy(s->neg_timer);
+    g_source_unref(s->neg_timer);
+    s->neg_timer = NULL;
+}
+
+static void negotiation_failed(PeerSession *s) {
+    if (s->neg_retries >= negotiation_max_retries) {
+        g_printerr("[%s] ✗ Negotiation failed after %u retries, dropping viewer\n", s->id, s->neg_retries);
+        g_main_loop_quit(s->loop);
+        return;
+    }
+    s->neg_retries++;
+    g_print("[%s] Retrying negotiation (%u/%u)\n", s->id, s->neg_retries, negotiation_max_retries);
+    // Once an answer was applied the ICE credentials are in use; a retry must restart ICE.
+    gboolean ice_restart = s->neg_ice_restart || s->have_remote;
+    set_neg_state(s, NEG_IDLE);
+    force_renegotiate(s, ice_restart);
+}
+
+static gboolean on_negotiation_timeout(gpointer data) {
+    PeerSession *s = (PeerSession *)data;
+    g_source_unref(s->neg_timer); s->neg_timer = NULL;
+    g_printerr("[%s] Negotiation timed out in %s after %d ms\n", s->id,
+               neg_state_names[s->neg_state], config.negotiation_timeout_ms);
+    negotiation_failed(s);
+    return G_SOURCE_REMOVE;
+}
+
+static void set_neg_state(PeerSession *s, NegotiationState st) {
+    if (s->neg_state != st)
+        g_print("[%s] negotiation: %s -> %s\n", s->id, neg_state_names[s->neg_state], neg_state_names[st]);
+    s->neg_state = st;
+    cancel_neg_timer(s);
+    if (st == NEG_IDLE || st == NEG_CONNECTED) return;
+    s->neg_timer = g_timeout_source_new(config.negotiation_timeout_ms);
+    g_source_set_callback(s->neg_timer, on_negotiation_timeout, s, NULL);   // cancelled before the session ends
+    g_source_attach(s->neg_timer, s->context);
+}
+
+static void log_setup_phases(PeerSession *s) {
+    if (s->warm_claim) {
+        // Offer and local description were done before the viewer asked.
+        g_print("[%s] setup (pooled): offer-out %.1f, answer %.1f, remote-desc %.1f, "
+                "ice %.1f, dtls %.1f ms (total %.1f ms)\n", s->id,
+                ms_since(s->t_request, s->t_offer_sent),
+                ms_since(s->t_offer_sent, s->t_answer),
+                ms_since(s->t_answer, s->t_remote_set),
+                ms_since(s->t_remote_set, MAX(s->t_ice_connected, s->t_remote_set)),
+                ms_since(MAX(s->t_ice_connected, s->t_remote_set), MAX(s->t_dtls_connected, s->t_ice_connected)),
+                ms_since(s->t_request, MAX(s->t_dtls_connected, s->t_ice_connected)));
+        return;
+    }
+    gint64 start = s->t_request ? s->t_request : s->t_attempt;
+    g_print("[%s] setup: queue %.1f, offer %.1f, local-desc %.1f, answer %.1f, remote-desc %.1f, "
+            "ice %.1f, dtls %.1f ms (total %.1f ms%s)\n", s->id,
+            ms_since(start, s->t_attempt),
+            ms_since(s->t_attempt, s->t_offer_created),
+            ms_since(s->t_offer_created, s->t_local_set),
+            ms_since(s->t_local_set, s->t_answer),
+            ms_since(s->t_answer, s->t_remote_set),
+            ms_since(s->t_remote_set, MAX(s->t_ice_connected, s->t_remote_set)),
+            ms_since(MAX(s->t_ice_connected, s->t_remote_set), MAX(s->t_dtls_connected, s->t_ice_connected)),
+            ms_since(start, MAX(s->t_dtls_connected, s->t_ice_connected)),
+            s->neg_ice_restart ? ", ice-restart" : "");
+}
+
+// Both ICE and DTLS must be up before the offer counts as done.
+static void check_connected(PeerSession *s) {
+    if (s->neg_state != NEG_CONNECTING) return;
+    GstWebRTCICEConnectionState ice; GstWebRTCPeerConnectionState pc;
+    g_object_get(s->webrtc, "ice-connection-state", &ice, "connection-state", &pc, NULL);
+    if (ice != GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED && ice != GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED) return;
+    if (pc != GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED) return;
+
+    gint64 now = g_get_monotonic_time();
+    if (!s->t_ice_connected) s->t_ice_connected = now;
+    if (!s->t_dtls_connected) s->t_dtls_connected = now;
+    set_neg_state(s, NEG_CONNECTED);
+    g_atomic_int_set(&s->media_up, 1);
+    s->neg_retries = 0;
+    log_setup_phases(s);
+    request_keyframe(s);
+    start_bwe_probe(s);
+}
+
+static void on_remote_description_set(PeerSession *s, GstPromise *promise) {
+    if (!promise_succeeded(s, promise, "set-remote-description")) { negotiation_failed(s); return; }
+    s->t_remote_set = g_get_monotonic_time();
+    s->have_remote = TRUE;
+    attach_to_encoder(s, s->answer_codec);
+    set_neg_state(s, NEG_CONNECTING);
+    check_connected(s);                  // a renegotiation may not change the transport at all
+}
+
+// The answerer lists the formats it accepts in its order of preference.
+static const CodecInfo *answer_video_codec(const GstSDPMessage *sdp) {
+    for (guint i = 0; i < gst_sdp_message_medias_len(sdp); i++) {
+        const GstSDPMedia *media = gst_sdp_message_get_media(sdp, i);
+        if (g_strcmp0(gst_sdp_media_get_media(media), "video") != 0 || gst_sdp_media_get_port(media) == 0) continue;
+        for (guint f = 0; f < gst_sdp_media_formats_len(media); f++) {
+            const CodecInfo *c = find_offered_codec(atoi(gst_sdp_media_get_format(media, f)));
+            if (c) return c;
+        }
+    }
+    return NULL;
+}
+
+static void apply_answer(PeerSession *s, const gchar *sdp_text, gint64 received) {
+    if (s->neg_state != NEG_AWAITING_ANSWER) {
+        g_print("[%s] Ignoring answer in state %s\n", s->id, neg_state_names[s->neg_state]);
+        return;
+    }
+    GstSDPMessage *sdp; gst_sdp_message_new(&sdp);
+    if (!sdp_text || gst_sdp_message_parse_buffer((guint8 *)sdp_text, strlen(sdp_text), sdp) != GST_SDP_OK) {
+        g_printerr("[%s] Could not parse answer\n", s->id);
+        gst_sdp_message_free(sdp);
+        negotiation_failed(s);
+        return;
+    }
+    s->answer_codec = answer_video_codec(sdp);
+    if (!s->answer_codec) {
+        g_printerr("[%s] Answer accepts none of the offered video codecs\n", s->id);
+        gst_sdp_message_free(sdp);
+        negotiation_failed(s);
+        return;
+    }
+    s->t_answer = received;
+    set_neg_state(s, NEG_SETTING_REMOTE);
+    auto *answer = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER, sdp);
+    g_signal_emit_by_name(s->webrtc, "set-remote-description", answer,
+                          session_promise_new(s, on_remote_description_set));
+    gst_webrtc_session_description_free(answer);
+}
+
+// Send the current offer, then the candidates that were held back for it.
+static void send_offer(PeerSession *s) {
+    JsonObject *msg = json_object_new();
+    json_object_set_string_member(msg, "type", "offer");
+    json_object_set_string_member(msg, "sdp", s->local_sdp);
+    json_object_set_string_member(msg, "to", s->id);
+    send_json_message(msg);
+    json_object_unref(msg);
+
+    for (guint i = 0; i < s->held_candidates->len; i++)
+        send_ice_candidate_message(s, (JsonObject *)g_ptr_array_index(s->held_candidates, i));
+    g_ptr_array_set_size(s->held_candidates, 0);
+
+    if (s->t_request && !s->t_offer_sent) {
+        s->t_offer_sent = g_get_monotonic_time();
+        record_join_to_offer(s->t_offer_sent - s->t_request);
+    }
+    set_neg_state(s, NEG_AWAITING_ANSWER);
+}
+
+static void on_local_description_set(PeerSession *s, GstPromise *promise) {
+    if (!promise_succeeded(s, promise, "set-local-description")) { negotiation_failed(s); return; }
+    s->t_local_set = g_get_monotonic_time();
+    if (s->from_pool) {
+        // Nobody to send it to yet; the claiming request-offer does.
+        cancel_neg_timer(s);
+        g_print("[%s] Warm offer ready\n", s->id);
+        return;
+    }
+    send_offer(s);
+}
+
+static void on_offer_created(PeerSession *s, GstPromise *promise) {
+    GstWebRTCSessionDescription *offer = NULL;
+    const GstStructure *reply = promise_succeeded(s, promise, "create-offer") ? gst_promise_get_reply(promise) : NULL;
+    if (reply) gst_structure_get(reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+    if (!offer) { negotiation_failed(s); return; }
+    s->t_offer_created = g_get_monotonic_time();
+
+    g_print("[%s] Offer created, setting local description\n", s->id);
+    g_free(s->local_sdp);
+    s->local_sdp = gst_sdp_message_as_text(offer->sdp);
+    set_neg_state(s, NEG_SETTING_LOCAL);
+    g_signal_emit_by_name(s->webrtc, "set-local-description", offer,
+                          session_promise_new(s, on_local_description_set));
+    gst_webrtc_session_description_free(offer);
+}
+
+static void force_renegotiate(PeerSession *s, gboolean ice_restart) {
+    if (!s->webrtc) { g_printerr("[%s] Cannot renegotiate: webrtc not available\n", s->id); return; }
+    if (s->neg_state != NEG_IDLE && s->neg_state != NEG_CONNECTED) {
+        g_print("[%s] Offer already in progress (%s), skipping\n", s->id, neg_state_names[s->neg_state]);
+        return;
+    }
+    g_print("[%s] Creating new offer%s\n", s->id, ice_restart ? " (ice-restart)" : "");
+    s->neg_generation++;
+    s->neg_ice_restart = ice_restart;
+    s->warm_claim = FALSE;
+    // Candidates of the old ICE credentials are useless after a restart.
+    if (ice_restart) g_ptr_array_set_size(s->held_candidates, 0);
+    s->t_attempt = g_get_monotonic_time();
+    s->t_offer_created = s->t_local_set = s->t_answer = s->t_remote_set = 0;
+    s->t_ice_connected = s->t_dtls_connected = 0;
+    set_neg_state(s, NEG_CREATING_OFFER);
+
+    GstStructure *options = ice_restart ?
+        gst_structure_new("offer-options", "ice-restart", G_TYPE_BOOLEAN, TRUE, NULL) : NULL;
+    g_signal_emit_by_name(s->webrtc, "create-offer", options, session_promise_new(s, on_offer_created));
+    if (options) gst_structure_free(options);
+}
+
+// ===================== Bus =====================
+static gboolean on_bus_message(GstBus * /*bus*/, GstMessage *message, gpointer /*user_data*/) {
+    switch (GST_MESSAGE_TYPE(message)) {
+        case GST_MESSAGE_ERROR: {
+            GError *err; gchar *dbg;
+            gst_message_parse_error(message, &err, &dbg);
+            g_printerr("Error: %s\n", err->message);
+            g_printerr("Debug: %s\n", dbg);
+            g_error_free(err); g_free(dbg);
+            // Capture/encode errors restart the video chain in place; anything else is fatal.
+            if (is_video_chain_element(GST_MESSAGE_SRC(message)) && pipeline_restarts < pipeline_max_restarts) {
+                pipeline_restarts++;
+                if (restart_pipeline()) break;
+            }
+            g_main_loop_quit(loop);
+            break;
+        }
+        case GST_MESSAGE_STATE_CHANGED: {
+            if (GST_MESSAGE_SRC(message) != GST_OBJECT(pipeline) || startup.playing) break;
+            GstState old_state, new_state;
+            gst_message_parse_state_changed(message, &old_state, &new_state, NULL);
+            if (new_state == GST_STATE_PLAYING) startup.playing = g_get_monotonic_time();
+            break;
+        }
+        case GST_MESSAGE_WARNING: {
+            GError *err; gchar *dbg;
+            gst_message_parse_warning(message, &err, &dbg);
+            g_printerr("Warning: %s\n", err->message);
+            g_error_free(err); g_free(dbg);
+            break;
+        }
+        case GST_MESSAGE_EOS:
+            // Files loop instead (on_file_probe); this is a stream that really ended
+            g_print("End of stream\n");
+            g_main_loop_quit(loop);
+            break;
+        default: break;
+    }
+    return TRUE;
+}
+
+// ===================== WS connect =====================
+// Without signaling nobody can join, so capture suspends the way idle suspend
+// does it: locked elements only, camera and encoder left open. Anything still
+// taking the encoders' output (a session, the multicast output, a benchmark)
+// keeps it running, and so does --source=app, whose caller keeps pushing.
+// Back on the server, capture resumes unless idle suspend wants it off anyway.
+static gboolean signaling_suspended = FALSE;    // guarded by encoders_lock
+
+static void set_pipeline_idle(gboolean idle) {
+    if (!pipeline || g_str_equal(current_desc.source->name, "app")) return;
+    if (idle) {
+        g_mutex_lock(&sessions_lock);
+        guint n = g_hash_table_size(sessions);
+        g_mutex_unlock(&sessions_lock);
+        if (n > 0) return;
+    }
+    g_mutex_lock(&encoders_lock);
+    if (idle && !capture_suspended && total_viewers() == 0) {
+        set_capture_suspended(TRUE);
+        suspended_at = g_get_monotonic_time();
+        signaling_suspended = TRUE;
+        g_print("Signaling lost: capture suspended\n");
+    } else if (!idle && signaling_suspended) {
+        signaling_suspended = FALSE;
+        if (!config.idle_suspend_ms) resume_capture(NULL);
+    }
+    g_mutex_unlock(&encoders_lock);
+}
+
+static gboolean on_ws_reconnect(gpointer /*user_data*/) {
+    ws_reconnect_id = 0;
+    connect_signaling();
+    return G_SOURCE_REMOVE;
+}
+
+// Exponential backoff with jitter in [backoff/2, backoff], so a restarted server
+// is not hit by every sender at once.
+static void schedule_ws_reconnect() {
+    if (ws_stopping || ws_reconnect_id) return;
+    ws_backoff_ms = ws_backoff_ms ? MIN(ws_backoff_ms * 2, ws_backoff_max_ms) : ws_backoff_min_ms;
+    guint delay = g_random_int_range(ws_backoff_ms / 2, ws_backoff_ms + 1);
+    g_print("Reconnecting to signaling server in %u ms\n", delay);
+    ws_reconnect_id = g_timeout_add(delay, on_ws_reconnect, NULL);
+}
+
+static void on_websocket_closed(SoupWebsocketConnection * /*conn*/, gpointer /*user_data*/) {
+    g_print("WebSocket closed\n");
+    g_clear_object(&ws_conn);
+    if (ws_stopping) return;
+    set_pipeline_idle(TRUE);
+    schedule_ws_reconnect();
+}
+
+static void on_websocket_connected(GObject *session, GAsyncResult *res, gpointer user_data) {
+    GError *error = NULL;
+    ws_conn = soup_session_websocket_connect_finish(SOUP_SESSION(session), res, &error);
+    if (error) {
+        g_printerr("WebSocket connection failed: %s\n", error->message);
+        g_error_free(error);
+        set_pipeline_idle(TRUE);
+        schedule_ws_reconnect();
+        return;
+    }
+    g_print("✓ WebSocket connected to signaling server\n");
+    ws_backoff_ms = 0;
+    set_pipeline_idle(FALSE);
+
+    g_signal_connect(ws_conn, "message", G_CALLBACK(on_message), NULL);
+    g_signal_connect(ws_conn, "closed", G_CALLBACK(on_websocket_closed), NULL);
+
+    // The server only routes request-offer and peer-left from our room to us
+    JsonObject* join = json_object_new();
+    json_object_set_string_member(join, "type", "join");
+    json_object_set_string_member(join, "room", config.room);
+    json_object_set_string_member(join, "clientType", "sender");
+    send_json_message(join);
+    json_object_unref(join);
+
+    // Anything sessions queued while we were away
+    flush_ws_outbox(NULL);
+}
+
+// Reconnects ask for the previous id, proven by its resume token, so answers
+// and candidates from viewers that kept their peer connection still reach us.
+static void connect_signaling() {
+    gchar *url = my_id && my_token ? g_strdup_printf("%s/?id=%s&token=%s", config.server, my_id, my_token)
+                                   : g_strdup(config.server);
+    SoupMessage *msg = soup_message_new("GET", url);
+    g_print("Connecting to signaling server: %s\n", url);
+    soup_session_websocket_connect_async(soup_session, msg, NULL, NULL, NULL, on_websocket_connected, NULL);
+    g_object_unref(msg);
+    g_free(url);
+}
+
+// ===================== Encoder benchmark =====================
+// --bench-encoders: every backend with an encoder for --codec installed gets
+// the same videotestsrc workload at --width x --height, set up as it would be
+// for streaming (--profile, --bitrate, GOP, the codec's output caps). Each
+// encodes it twice:
+//   throughput: bench_encoder_frames, unpaced: fps and CPU per frame
+//   paced:      live at --fps for bench_paced_seconds: per-frame encode
+//               latency, CPU use and how close the output lands to --bitrate
+// A backend works if both runs reach EOS with every frame encoded. Results
+// are kept per codec and geometry in encoder_cache_path(); a later start
+// without --encoder takes the fastest working backend recorded for its own.
+static const guint bench_encoder_frames = 300;
+static const guint bench_paced_seconds = 5;
+
+struct EncoderRun {
+    GMutex lock;
+    GArray *pending;                // EncoderInput, in PTS order (no B-frames)
+    GArray *latency_ms;             // gdouble per encoded frame
+    guint frames_in, frames_out;
+    guint64 bytes;
+    gdouble wall_s, cpu_s;
+    gchar *error;
+};
+
+struct EncoderInput { GstClockTime pts; gint64 at; };
+
+struct EncoderResult {
+    gboolean ok;
+    gdouble fps, cpu_ms_per_frame;                  // throughput run
+    gdouble latency_p50, latency_p99, cpu_percent, kbps;    // paced run
+};
+
+static gchar *encoder_cache_path() { return g_build_filename(g_get_user_cache_dir(), "gpt", "encoders.ini", NULL); }
+
+// Keyed on the codec actually benchmarked, not --codec, which may have no backend choice.
+static gchar *encoder_cache_group(const CodecInfo *codec) {
+    return g_strdup_printf("%s %dx%d %dfps", codec->name, config.width, config.height, config.fps);
+}
+
+
+static gboolean factory_installed(const char *name) {
+    GstElementFactory *f = gst_element_factory_find(name);
+    if (f) gst_object_unref(f);
+    return f != NULL;
+}
+
+static gdouble process_cpu_seconds() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static GstPadProbeReturn on_encoder_input(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer data) {
+    EncoderRun *run = (EncoderRun *)data;
+    EncoderInput in = { GST_PAD_PROBE_INFO_BUFFER(info)->pts, g_get_monotonic_time() };
+    g_mutex_lock(&run->lock);
+    g_array_append_val(run->pending, in);
+    run->frames_in++;
+    g_mutex_unlock(&run->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn on_encoder_output(GstPad * /*pad*/, GstPadProbeInfo *info, gpointer data) {
+    EncoderRun *run = (EncoderRun *)data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&run->lock);
+    // Inputs older than this output were dropped by the encoder
+    guint i = 0;
+    while (i < run->pending->len && g_array_index(run->pending, EncoderInput, i).pts < buf->pts) i++;
+    if (i < run->pending->len && g_array_index(run->pending, EncoderInput, i).pts == buf->pts) {
+        gdouble ms = ms_since(g_array_index(run->pending, EncoderInput, i).at, now);
+        g_array_append_val(run->latency_ms, ms);
+        i++;
+    }
+    g_array_remove_range(run->pending, 0, i);
+    run->frames_out++;
+    run->bytes += gst_buffer_get_size(buf);
+    g_mutex_unlock(&run->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+// videotestsrc ! capsfilter ! enc ! capsfilter ! fakesink, until EOS or error.
+// b NULL: an encoder gpt has no backend for, run with its defaults.
+static gboolean run_encoder(const EncoderBackend *b, const char *factory, const CodecInfo *codec, gboolean paced,
+                            EncoderRun *run) {
+    PipelineDesc d = pipeline_desc_from_config();
+    if (b) d.encoder = b;
+    GstElement *bench = gst_pipeline_new("encoder-bench");
+    GstElement *src = make_element("videotestsrc", NULL);
+    GstElement *srccaps = make_element("capsfilter", NULL);
+    GstElement *enc = make_element(factory, NULL);
+    GstElement *enccaps = make_element("capsfilter", NULL);
+    GstElement *sink = make_element("fakesink", NULL);
+    GstElement *elems[] = { src, srccaps, enc, enccaps, sink };
+    gboolean ok = TRUE;
+    for (GstElement *e : elems) {
+        if (e) gst_bin_add(GST_BIN(bench), e);
+        else ok = FALSE;
+    }
+    if (!ok || !gst_element_link_many(src, srccaps, enc, enccaps, sink, NULL)) {
+        run->error = g_strdup("could not build the pipeline");
+        gst_object_unref(bench);
+        return FALSE;
+    }
+
+    guint frames = paced ? bench_paced_seconds * d.fps : bench_encoder_frames;
+    g_object_set(src, "is-live", paced, "num-buffers", (gint)frames, NULL);
+    set_int_prop_if_present(src, "horizontal-speed", 4);    // some motion to search
+    GstCaps *caps = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "I420", "width", G_TYPE_INT, d.width,
+                                        "height", G_TYPE_INT, d.height, "framerate", GST_TYPE_FRACTION, d.fps, 1, NULL);
+    g_object_set(srccaps, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    if (b) b->configure(enc, d);
+    caps = gst_caps_from_string(codec->enc_caps);
+    g_object_set(enccaps, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    g_object_set(sink, "sync", FALSE, NULL);
+
+    GstPad *pad = gst_element_get_static_pad(enc, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_encoder_input, run, NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(enc, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_encoder_output, run, NULL);
+    gst_object_unref(pad);
+
+    gint64 wall = g_get_monotonic_time();
+    gdouble cpu = process_cpu_seconds();
+    gst_element_set_state(bench, GST_STATE_PLAYING);
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(bench));
+    GstClockTime timeout = (paced ? 2 * bench_paced_seconds + 10 : 120) * GST_SECOND;
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, timeout, (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    run->wall_s = ms_since(wall, g_get_monotonic_time()) / 1000.0;
+    run->cpu_s = process_cpu_seconds() - cpu;
+    gst_element_set_state(bench, GST_STATE_NULL);
+
+    if (!msg) {
+        run->error = g_strdup("timed out");
+    } else if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        GError *err = NULL;
+        gst_message_parse_error(msg, &err, NULL);
+        run->error = g_strdup(err->message);
+        g_error_free(err);
+    } else if (run->frames_out < frames) {
+        run->error = g_strdup_printf("%u of %u frames encoded", run->frames_out, frames);
+    }
+    if (msg) gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_object_unref(bench);
+    return run->error == NULL;
+}
+
+static gboolean bench_encoder(const EncoderBackend *b, const char *factory, const CodecInfo *codec, EncoderResult *r) {
+    const char *name = b ? b->name : "unconfigured";
+    memset(r, 0, sizeof(*r));
+    if (!factory_installed(factory)) {
+        g_print("encoder %s (%s): not installed\n", name, factory);
+        return FALSE;
+    }
+    EncoderRun runs[2];
+    for (guint i = 0; i < 2; i++) {
+        EncoderRun *run = &runs[i];
+        memset(run, 0, sizeof(*run));
+        g_mutex_init(&run->lock);
+        run->pending = g_array_new(FALSE, FALSE, sizeof(EncoderInput));
+        run->latency_ms = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    }
+    r->ok = run_encoder(b, factory, codec, FALSE, &runs[0]) && run_encoder(b, factory, codec, TRUE, &runs[1]);
+    if (r->ok) {
+        r->fps = runs[0].frames_out / MAX(runs[0].wall_s, 1e-3);
+        r->cpu_ms_per_frame = runs[0].cpu_s * 1000.0 / runs[0].frames_out;
+        GArray *lat = runs[1].latency_ms;
+        g_array_sort(lat, compare_double);
+        gdouble *v = (gdouble *)(void *)lat->data;
+        r->latency_p50 = lat->len ? v[lat->len / 2] : 0;
+        r->latency_p99 = lat->len ? v[MIN(lat->len - 1, lat->len * 99 / 100)] : 0;
+        r->cpu_percent = 100.0 * runs[1].cpu_s / MAX(runs[1].wall_s, 1e-3);
+        r->kbps = runs[1].bytes * 8.0 / 1000.0 / ((gdouble)runs[1].frames_out / config.fps);
+        g_print("encoder %s (%s): %.1f fps, %.2f ms CPU/frame; at %d fps: latency p50 %.1f, p99 %.1f ms, "
+                "CPU %.0f%% of a core, %.0f kbps (%+.1f%% of target)\n",
+                name, factory, r->fps, r->cpu_ms_per_frame, config.fps, r->latency_p50, r->latency_p99,
+                r->cpu_percent, r->kbps, 100.0 * (r->kbps - config.bitrate) / config.bitrate);
+    } else {
+        EncoderRun *failed = runs[0].error ? &runs[0] : &runs[1];
+        g_print("encoder %s (%s): failed in the %s run: %s\n", name, factory,
+                failed == &runs[0] ? "throughput" : "paced", failed->error);
+    }
+    for (EncoderRun &run : runs) {
+        g_array_free(run.pending, TRUE);
+        g_array_free(run.latency_ms, TRUE);
+        g_free(run.error);
+        g_mutex_clear(&run.lock);
+    }
+    return r->ok;
+}
+
+// Every other installed encoder producing the codec runs too, with its
+// defaults, so one gpt has no backend for still shows up. Recorded as
+// unconfigured-<factory>-fps, never picked as best: without a configure hook
+// its rate, GOP and B-frames are whatever the element defaults to.
+static void bench_unconfigured_encoders(const CodecInfo *codec, GKeyFile *cache, const gchar *group) {
+    GList *all = gst_element_factory_list_get_elements(GST_ELEMENT_FACTORY_TYPE_VIDEO_ENCODER, GST_RANK_NONE);
+    GstCaps *caps = gst_caps_from_string(codec->enc_caps);
+    GstStructure *st = gst_caps_get_structure(caps, 0);
+    GstCaps *media = gst_caps_new_empty_simple(gst_structure_get_name(st));
+    GList *matching = gst_element_factory_list_filter(all, media, GST_PAD_SRC, FALSE);
+    for (GList *l = matching; l; l = l->next) {
+        const gchar *factory = GST_OBJECT_NAME(l->data);
+        gboolean known = FALSE;
+        for (const EncoderBackend &b : encoder_backends) known |= g_str_equal(backend_factory(&b, codec), factory);
+        if (known) continue;
+        EncoderResult r;
+        if (!bench_encoder(NULL, factory, codec, &r)) continue;
+        gchar *key = g_strdup_printf("unconfigured-%s-fps", factory);
+        g_key_file_set_double(cache, group, key, r.fps);
+        g_free(key);
+    }
+    gst_plugin_feature_list_free(matching);
+    gst_plugin_feature_list_free(all);
+    gst_caps_unref(media);
+    gst_caps_unref(caps);
+}
+
+// Runs every backend, records the results and quits the loop.
+static gboolean on_bench_encoders(gpointer /*user_data*/) {
+    const CodecInfo *codec = find_codec(config.codec);
+    g_print("Benchmarking %s encoders at %dx%d, %d fps, %d kbps, profile %s\n",
+            codec->name, config.width, config.height, config.fps, config.bitrate, config.profile);
+    gchar *path = encoder_cache_path(), *group = encoder_cache_group(codec), *version = gst_version_string();
+    GKeyFile *cache = g_key_file_new();
+    g_key_file_load_from_file(cache, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    g_key_file_remove_group(cache, group, NULL);
+    g_key_file_set_string(cache, group, "gstreamer", version);
+
+    const EncoderBackend *best = NULL;
+    gdouble best_fps = 0;
+    for (const EncoderBackend &b : encoder_backends) {
+        EncoderResult r;
+        if (!bench_encoder(&b, backend_factory(&b, codec), codec, &r)) continue;
+        gchar *key;
+        key = g_strdup_printf("%s-fps", b.name); g_key_file_set_double(cache, group, key, r.fps); g_free(key);
+        key = g_strdup_printf("%s-latency-ms", b.name); g_key_file_set_double(cache, group, key, r.latency_p50); g_free(key);
+        key = g_strdup_printf("%s-cpu-percent", b.name); g_key_file_set_double(cache, group, key, r.cpu_percent); g_free(key);
+        key = g_strdup_printf("%s-kbps", b.name); g_key_file_set_double(cache, group, key, r.kbps); g_free(key);
+        if (r.fps > best_fps) { best = &b; best_fps = r.fps; }
+    }
+
+    bench_unconfigured_encoders(codec, cache, group);
+
+    if (best) {
+        g_key_file_set_string(cache, group, "best", best->name);
+        g_print("fastest: %s", best->name);
+        if (best_fps < config.fps) g_print(" (below %d fps at this size)", config.fps);
+        gchar *dir = g_path_get_dirname(path);
+        GError *error = NULL;
+        if (g_mkdir_with_parents(dir, 0755) == 0 && g_key_file_save_to_file(cache, path, &error)) {
+            g_print(", recorded in %s [%s]\n", path, group);
+        } else {
+            g_print("\n");
+            g_printerr("Failed to write %s: %s\n", path, error ? error->message : g_strerror(errno));
+        }
+        if (error) g_error_free(error);
+        g_free(dir);
+    } else {
+        g_print("no working %s encoder\n", codec->name);
+    }
+    g_key_file_free(cache);
+    g_free(version); g_free(group); g_free(path);
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+// No --encoder: the backend --bench-encoders found fastest for this codec and
+// geometry on this GStreamer, else the first one installed.
+static void choose_encoder_backend() {
+    const CodecInfo *codec = find_codec(config.codec);
+    if (!g_str_equal(codec->name, "h264") && !g_str_equal(codec->name, "h265")) codec = find_codec("h264");
+    gchar *path = encoder_cache_path(), *group = encoder_cache_group(codec), *version = gst_version_string();
+    GKeyFile *cache = g_key_file_new();
+    const EncoderBackend *b = NULL;
+    if (g_key_file_load_from_file(cache, path, G_KEY_FILE_NONE, NULL) && g_key_file_has_group(cache, group)) {
+        gchar *recorded = g_key_file_get_string(cache, group, "gstreamer", NULL);
+        gchar *best = g_key_file_get_string(cache, group, "best", NULL);
+        if (g_strcmp0(recorded, version) != 0)
+            g_print("Encoder benchmark in %s is from %s; rerun --bench-encoders\n", path, recorded ? recorded : "another GStreamer");
+        else if ((b = find_encoder_backend(best)) && !factory_installed(backend_factory(b, codec)))
+            b = NULL;
+        if (b) g_print("Encoder: %s, fastest for %s in %s\n", b->name, group, path);
+        g_free(recorded);
+        g_free(best);
+    }
+    for (guint i = 0; !b && i < G_N_ELEMENTS(encoder_backends); i++)
+        if (factory_installed(backend_factory(&encoder_backends[i], codec))) b = &encoder_backends[i];
+    config.encoder = g_strdup(b ? b->name : encoder_backends[0].name);
+    g_key_file_free(cache);
+    g_free(version); g_free(group); g_free(path);
+}
+
+// ===================== Args / main =====================
+static void print_usage(const char *prog) {
+    g_print("Usage: %s [OPTIONS]\n\n", prog);
+    g_print("  --codec=CODEC       preferred codec: h264, h265, vp8, vp9 or av1 (default: h264)\n");
+    g_print("  --codecs=LIST       codecs offered after the preferred one, e.g. h265,vp8 (default: all installed)\n");
+    g_print("  --bitrate=KBPS      bitrate kbps (default: 2000)\n");
+    g_print("  --fps=FPS           framerate (default: 30)\n");
+    g_print("  --width=WIDTH       width (default: 1280)\n");
+    g_print("  --height=HEIGHT     height (default: 720)\n");
+    g_print("  --device=PATH       camera device (default: /dev/video0)\n");
+    g_print("  --max-viewers=N     concurrent viewer sessions / worker threads (default: 16)\n");
+    g_print("  --server=URL        signaling server (default: %s)\n", default_server_url);
+    g_print("  --room=NAME         signaling room to serve (default: default)\n");
+    g_print("  --ice-grace=MS      wait before ICE restart on disconnect (default: 3000)\n");
+    g_print("  --negotiation-timeout=MS  deadline per negotiation phase (default: 10000)\n");
+    g_print("  --profile=NAME      ultra-low-latency, balanced or quality (default: balanced)\n");
+    g_print("  --encoder=NAME      omx, x264, v4l2, nvcodec, vaapi or openh264 (H.264 only) (default: fastest\n");
+    g_print("                      recorded by --bench-encoders, else the first installed, in that order)\n");
+    g_print("  --gop=FRAMES        frames between IDRs (default: from profile / encoder)\n");
+    g_print("  --intra-refresh=M   off, columns or rows: rolling intra refresh instead of periodic IDRs\n");
+    g_print("  --max-frame-kb=KB   cap on a single encoded frame, where the encoder supports it\n");
+    g_print("  --keyframe-interval=MS  minimum gap between keyframes forced by PLI/FIR and joins (default: 500)\n");
+    g_print("  --max-bitrate=KBPS  upper bound for bandwidth estimation (default: --bitrate)\n");
+    g_print("  --bwe-probe=MS      bandwidth probing window after connect, 0 = off (default: 2000)\n");
+    g_print("  --source=KIND       v4l2, test, file, rtsp, uvc-h264, replay or app (default: v4l2)\n");
+    g_print("  --input=PATH|URL    file or rtsp:// URL for --source=file / rtsp; for replay a .y4m\n");
+    g_print("                      clip, or raw I420 at --width/--height/--fps. A file loops, and sets\n");
+    g_print("                      --codec from the stream it holds\n");
+    g_print("  --replay-load=M     memory (copy, default) or mmap (pre-faulted) for the replay clip\n");
+    g_print("  --app-format=FMT    raw format of frames pushed through the library API (default: I420)\n");
+    g_print("  --test-source       same as --source=test\n");
+    g_print("  --bench-profile=S   measure capture-to-packet latency and bitrate for S seconds, then exit\n");
+    g_print("  --bench-quality     with --bench-profile and --source=replay: decode the output and report\n");
+    g_print("                      PSNR / SSIM against the clip\n");
+    g_print("  --pool-size=N       pre-warmed webrtcbin branches kept ready for joins (default: 2)\n");
+    g_print("  --idle-suspend=MS   pause capture this long after the last viewer leaves, 0 = never (default: 3000)\n");
+    g_print("  --cpus-capture=LIST pin capture threads to CPUs, e.g. 3 or 2-3 (default: any)\n");
+    g_print("  --cpus-encode=LIST  pin encoder threads to CPUs\n");
+    g_print("  --cpus-network=LIST pin webrtcbin, libnice and session threads to CPUs\n");
+    g_print("  --rt-priority=N     SCHED_FIFO N for capture, N-1 for encode threads, 0 = off (needs CAP_SYS_NICE)\n");
+    g_print("  --network-nice=N    nice level for network threads (default: 0)\n");
+    g_print("  --skip-static=N     drop frames where no 16x16 luma block changed by N per pixel on average,\n");
+    g_print("                      e.g. 4; 0 = encode every frame (default: 0)\n");
+    g_print("  --skip-min-fps=N    frames still encoded per second in a static scene (default: 1)\n");
+    g_print("  --multicast=GROUP:PORT  also send the stream as RTP to a LAN multicast group, e.g.\n");
+    g_print("                      239.255.0.1:5004 (video on PORT, audio on PORT+2)\n");
+    g_print("  --multicast-ttl=N   multicast TTL (default: 1, this segment only)\n");
+    g_print("  --multicast-iface=IF  interface to send multicast on (default: from the routing table)\n");
+    g_print("  --multicast-sdp=PATH  write the multicast SDP to PATH\n");
+    g_print("  --multicast-http=PORT serve the multicast SDP at http://HOST:PORT/stream.sdp\n");
+    g_print("  --multicast-srtp    encrypt the multicast stream; the key travels in the SDP\n");
+    g_print("  --multicast-idr=MS  keyframe every MS for receivers joining late, 0 = off (default: 2000)\n");
+    g_print("  --no-dtls-prewarm   no shared certificate: dtlsdec generates its own on the first join\n");
+    g_print("  --dtls-rotate=HOURS new DTLS certificate for new sessions this often, 0 = never (default: 24);\n");
+    g_print("                      the current one is kept in $XDG_CONFIG_HOME/gpt/dtls.pem\n");
+    g_print("  --bench-startup     print startup phase timings and exit after the first RTP packet\n");
+    g_print("  --bench-encoders    time every installed h264/h265 backend for --codec at this size and\n");
+    g_print("                      record the fastest for later starts, then exit; other installed\n");
+    g_print("                      encoders for the codec run with their defaults as \"unconfigured\"\n");
+    g_print("  --help              show this help\n");
+}
+
+static gboolean parse_arguments(int argc, char *argv[]) {
+    config.codec = g_strdup("h264");
+    config.bitrate = 2000;
+    config.fps = 30;
+    config.width = 1280;
+    config.height = 720;
+    config.device = g_strdup("/dev/video0");
+    config.max_viewers = 16;
+    config.ice_grace_ms = 3000;
+    config.negotiation_timeout_ms = 10000;
+    config.keyframe_interval_ms = 500;
+    config.bwe_probe_ms = 2000;
+    config.dtls_prewarm = TRUE;
+    config.dtls_rotate_hours = 24;
+    config.pool_size = 2;
+    config.idle_suspend_ms = 3000;
+    config.skip_min_fps = 1;
+    config.multicast_ttl = 1;
+    config.multicast_idr_ms = 2000;
+    config.profile = g_strdup("balanced");
+    config.intra_refresh = g_strdup("off");
+    config.server = g_strdup(default_server_url);
+    config.room = g_strdup("default");
+    config.source = g_strdup("v4l2");
+    config.replay_load = g_strdup("memory");
+    config.app_format = g_strdup("I420");
+
+    struct option long_options[] = {
+        {"codec",  required_argument, 0, 'c'},
+        {"bitrate",required_argument, 0, 'b'},
+        {"fps",    required_argument, 0, 'f'},
+        {"width",  required_argument, 0, 'w'},
+        {"height", required_argument, 0, 'H'},
+        {"device", required_argument, 0, 'd'},
+        {"max-viewers", required_argument, 0, 'm'},
+        {"ice-grace", required_argument, 0, 'g'},
+        {"negotiation-timeout", required_argument, 0, 'n'},
+        {"pool-size", required_argument, 0, 'p'},
+        {"idle-suspend", required_argument, 0, 'U'},
+        {"cpus-capture", required_argument, 0, 'j'},
+        {"cpus-encode", required_argument, 0, 'k'},
+        {"cpus-network", required_argument, 0, 'N'},
+        {"rt-priority", required_argument, 0, 'F'},
+        {"network-nice", required_argument, 0, 'Y'},
+        {"skip-static", required_argument, 0, 'Z'},
+        {"skip-min-fps", required_argument, 0, 'z'},
+        {"multicast", required_argument, 0, 'O'},
+        {"multicast-ttl", required_argument, 0, 'J'},
+        {"multicast-iface", required_argument, 0, 'o'},
+        {"multicast-sdp", required_argument, 0, 'V'},
+        {"multicast-http", required_argument, 0, 'A'},
+        {"multicast-srtp", no_argument, 0, 'x'},
+        {"multicast-idr", required_argument, 0, 'q'},
+        {"profile", required_argument, 0, 'P'},
+        {"encoder", required_argument, 0, 'e'},
+        {"gop", required_argument, 0, 'G'},
+        {"intra-refresh", required_argument, 0, 'I'},
+        {"max-frame-kb", required_argument, 0, 'M'},
+        {"keyframe-interval", required_argument, 0, 'K'},
+        {"max-bitrate", required_argument, 0, 'X'},
+        {"bwe-probe", required_argument, 0, 'W'},
+        {"codecs", required_argument, 0, 'C'},
+        {"server", required_argument, 0, 'S'},
+        {"room", required_argument, 0, 'R'},
+        {"source", required_argument, 0, 's'},
+        {"input", required_argument, 0, 'i'},
+        {"replay-load", required_argument, 0, 'l'},
+        {"app-format", required_argument, 0, 'a'},
+        {"test-source", no_argument, 0, 'T'},
+        {"bench-profile", required_argument, 0, 'L'},
+        {"bench-quality", no_argument, 0, 'Q'},
+        {"no-dtls-prewarm", no_argument, 0, 'D'},
+        {"dtls-rotate", required_argument, 0, 'r'},
+        {"bench-startup", no_argument, 0, 'B'},
+        {"bench-encoders", no_argument, 0, 'E'},
+        {"help",   no_argument,       0, '?'},
+        {0,0,0,0}
+    };
+    int c, idx=0;
+    gboolean codec_given = FALSE;
+    while ((c = getopt_long(argc, argv, "c:C:b:f:w:H:d:m:g:n:p:U:j:k:N:F:Y:Z:z:O:J:o:V:A:xq:P:e:G:I:M:K:X:W:S:R:s:i:l:a:TL:QDBEr:?", long_options, &idx)) != -1) {
+        switch (c) {
+            case 'c':
+                codec_given = TRUE;
+                g_free(config.codec); config.codec = g_strdup(optarg);
+                if (!find_codec(config.codec)) {
+                    g_printerr("Error: codec must be h264, h265, vp8, vp9 or av1\n"); return FALSE;
+                }
+                break;
+            case 'b': config.bitrate = atoi(optarg); if (config.bitrate<=0) { g_printerr("bitrate>0\n"); return FALSE; } break;
+            case 'f': config.fps = atoi(optarg); if (config.fps<=0||config.fps>120) { g_printerr("fps 1..120\n"); return FALSE; } break;
+            case 'w': config.width = atoi(optarg); if (config.width<=0){ g_printerr("width>0\n"); return FALSE; } break;
+            case 'H': config.height= atoi(optarg); if (config.height<=0){ g_printerr("height>0\n"); return FALSE; } break;
+            case 'd': g_free(config.device); config.device = g_strdup(optarg); break;
+            case 'm': config.max_viewers = atoi(optarg); if (config.max_viewers<=0){ g_printerr("max-viewers>0\n"); return FALSE; } break;
+            case 'g': config.ice_grace_ms = atoi(optarg); if (config.ice_grace_ms<0){ g_printerr("ice-grace>=0\n"); return FALSE; } break;
+            case 'n': config.negotiation_timeout_ms = atoi(optarg); if (config.negotiation_timeout_ms<=0){ g_printerr("negotiation-timeout>0\n"); return FALSE; } break;
+            case 'p': config.pool_size = atoi(optarg); if (config.pool_size<0){ g_printerr("pool-size>=0\n"); return FALSE; } break;
+            case 'U': config.idle_suspend_ms = atoi(optarg); if (config.idle_suspend_ms<0){ g_printerr("idle-suspend>=0\n"); return FALSE; } break;
+            case 'j': g_free(config.cpus[THREAD_CAPTURE]); config.cpus[THREAD_CAPTURE] = g_strdup(optarg); break;
+            case 'k': g_free(config.cpus[THREAD_ENCODE]); config.cpus[THREAD_ENCODE] = g_strdup(optarg); break;
+            case 'N': g_free(config.cpus[THREAD_NETWORK]); config.cpus[THREAD_NETWORK] = g_strdup(optarg); break;
+            case 'F':
+                config.rt_priority = atoi(optarg);
+                if (config.rt_priority<0 || config.rt_priority>99) { g_printerr("rt-priority 0..99\n"); return FALSE; }
+                break;
+            case 'Y':
+                config.network_nice = atoi(optarg);
+                if (config.network_nice<-20 || config.network_nice>19) { g_printerr("network-nice -20..19\n"); return FALSE; }
+                break;
+            case 'Z': config.skip_static = atoi(optarg); if (config.skip_static<0||config.skip_static>255){ g_printerr("skip-static 0..255\n"); return FALSE; } break;
+            case 'z': config.skip_min_fps = atoi(optarg); if (config.skip_min_fps<=0){ g_printerr("skip-min-fps>0\n"); return FALSE; } break;
+            case 'O': {
+                // GROUP:PORT, [GROUP]:PORT for IPv6
+                const gchar *colon = strrchr(optarg, ':');
+                gchar *group = colon ? g_strndup(optarg, colon - optarg) : NULL;
+                if (group && group[0] == '[' && g_str_has_suffix(group, "]")) {
+                    gchar *inner = g_strndup(group + 1, strlen(group) - 2);
+                    g_free(group); group = inner;
+                }
+                GInetAddress *addr = group ? g_inet_address_new_from_string(group) : NULL;
+                config.multicast_port = colon ? atoi(colon + 1) : 0;
+                gboolean ok = addr && g_inet_address_get_is_multicast(addr) &&
+                              config.multicast_port > 0 && config.multicast_port <= 65533;
+                if (addr) g_object_unref(addr);
+                if (!ok) {
+                    g_free(group);
+                    g_printerr("Error: multicast must be GROUP:PORT with a multicast group, e.g. 239.255.0.1:5004\n"); return FALSE;
+                }
+                g_free(config.multicast_group); config.multicast_group = group;
+                break;
+            }
+            case 'J': config.multicast_ttl = atoi(optarg); if (config.multicast_ttl<1||config.multicast_ttl>255){ g_printerr("multicast-ttl 1..255\n"); return FALSE; } break;
+            case 'o': g_free(config.multicast_iface); config.multicast_iface = g_strdup(optarg); break;
+            case 'V': g_free(config.multicast_sdp); config.multicast_sdp = g_strdup(optarg); break;
+            case 'A':
+                config.multicast_http_port = atoi(optarg);
+                if (config.multicast_http_port<=0||config.multicast_http_port>65535) { g_printerr("multicast-http 1..65535\n"); return FALSE; }
+                break;
+            case 'x': config.multicast_srtp = TRUE; break;
+            case 'q': config.multicast_idr_ms = atoi(optarg); if (config.multicast_idr_ms<0){ g_printerr("multicast-idr>=0\n"); return FALSE; } break;
+            case 'P':
+                g_free(config.profile); config.profile = g_strdup(optarg);
+                if (!find_latency_profile(config.profile)) {
+                    g_printerr("Error: profile must be ultra-low-latency, balanced or quality\n"); return FALSE;
+                }
+                break;
+            case 'e':
+                g_free(config.encoder); config.encoder = g_strdup(optarg);
+                if (!find_encoder_backend(config.encoder)) { g_printerr("Error: encoder must be omx, x264, v4l2, nvcodec, vaapi or openh264\n"); return FALSE; }
+                break;
+            case 'G': config.gop = atoi(optarg); if (config.gop<0){ g_printerr("gop>=0\n"); return FALSE; } break;
+            case 'I':
+                g_free(config.intra_refresh); config.intra_refresh = g_strdup(optarg);
+                if (g_strcmp0(optarg,"off")!=0 && g_strcmp0(optarg,"columns")!=0 && g_strcmp0(optarg,"rows")!=0) {
+                    g_printerr("Error: intra-refresh must be off, columns or rows\n"); return FALSE;
+                }
+                break;
+            case 'M': config.max_frame_kb = atoi(optarg); if (config.max_frame_kb<0){ g_printerr("max-frame-kb>=0\n"); return FALSE; } break;
+            case 'K': config.keyframe_interval_ms = atoi(optarg); if (config.keyframe_interval_ms<0){ g_printerr("keyframe-interval>=0\n"); return FALSE; } break;
+            case 'X': config.max_bitrate = atoi(optarg); if (config.max_bitrate<0){ g_printerr("max-bitrate>=0\n"); return FALSE; } break;
+            case 'W': config.bwe_probe_ms = atoi(optarg); if (config.bwe_probe_ms<0){ g_printerr("bwe-probe>=0\n"); return FALSE; } break;
+            case 'C': {
+                g_free(config.codecs); config.codecs = g_strdup(optarg);
+                gchar **names = g_strsplit(optarg, ",", -1);
+                gboolean ok = TRUE;
+                for (gchar **n = names; *n && ok; n++)
+                    if (!(ok = find_codec(g_strstrip(*n)) != NULL)) g_printerr("Error: unknown codec '%s'\n", *n);
+                g_strfreev(names);
+                if (!ok) return FALSE;
+                break;
+            }
+            case 'S': g_free(config.server); config.server = g_strdup(optarg); break;
+            case 'R': g_free(config.room); config.room = g_strdup(optarg); break;
+            case 's':
+                g_free(config.source); config.source = g_strdup(optarg);
+                if (!find_source_kind(config.source)) {
+                    g_printerr("Error: source must be v4l2, test, file, rtsp, uvc-h264, replay or app\n"); return FALSE;
+                }
+                break;
+            case 'i': g_free(config.input); config.input = g_strdup(optarg); break;
+            case 'l':
+                g_free(config.replay_load); config.replay_load = g_strdup(optarg);
+                if (g_strcmp0(optarg, "memory") != 0 && g_strcmp0(optarg, "mmap") != 0) {
+                    g_printerr("Error: replay-load must be memory or mmap\n"); return FALSE;
+                }
+                break;
+            case 'a':
+                g_free(config.app_format); config.app_format = g_strdup(optarg);
+                if (gst_video_format_from_string(optarg) == GST_VIDEO_FORMAT_UNKNOWN) {
+                    g_printerr("Error: unknown app-format '%s'\n", optarg); return FALSE;
+                }
+                break;
+            case 'T': g_free(config.source); config.source = g_strdup("test"); break;
+            case 'L': config.bench_seconds = atoi(optarg); if (config.bench_seconds<=0){ g_printerr("bench-profile>0\n"); return FALSE; } break;
+            case 'Q': config.bench_quality = TRUE; break;
+            case 'D': config.dtls_prewarm = FALSE; break;
+            case 'r': config.dtls_rotate_hours = atoi(optarg); if (config.dtls_rotate_hours<0){ g_printerr("dtls-rotate>=0\n"); return FALSE; } break;
+            case 'B': config.bench_startup = TRUE; break;
+            case 'E': config.bench_encoders = TRUE; break;
+            case '?': default: print_usage(argv[0]); return FALSE;
+        }
+    }
+    const SourceKind *source = find_source_kind(config.source);
+    if (source->compressed) {
+        if (!g_str_equal(source->element, "v4l2src") && !config.input) {
+            g_printerr("Error: --source=%s needs --input\n", source->name); return FALSE;
+        }
+        // A file names its own codec; --codec may only agree with it
+        const CodecInfo *carried = g_str_equal(source->name, "file") ? probe_file_codec(config.input) : NULL;
+        if (carried && codec_given && !g_str_equal(carried->name, config.codec)) {
+            g_printerr("Error: %s carries %s; drop --codec or set --codec=%s\n", config.input, carried->name, carried->name);
+            return FALSE;
+        }
+        if (carried && !codec_given) { g_free(config.codec); config.codec = g_strdup(carried->name); }
+        if (!carried && g_str_equal(source->name, "file"))
+            g_printerr("Could not read the video codec of %s; assuming --codec=%s\n", config.input, config.codec);
+        if (g_strcmp0(config.codec, "h264") != 0 && g_strcmp0(config.codec, "h265") != 0) {
+            g_printerr("Error: --source=%s carries h264 or h265; set --codec to match\n", source->name); return FALSE;
+        }
+        if (g_str_equal(source->name, "uvc-h264") && g_strcmp0(config.codec, "h264") != 0) {
+            g_printerr("Error: --source=uvc-h264 needs --codec=h264\n"); return FALSE;
+        }
+    }
+    if (g_str_equal(source->name, "replay") && !config.input) {
+        g_printerr("Error: --source=replay needs --input\n"); return FALSE;
+    }
+    if (!config.multicast_group && (config.multicast_sdp || config.multicast_http_port || config.multicast_srtp)) {
+        g_printerr("Error: --multicast-sdp / --multicast-http / --multicast-srtp need --multicast\n"); return FALSE;
+    }
+    if (config.bench_encoders && g_strcmp0(config.codec, "h264") != 0 && g_strcmp0(config.codec, "h265") != 0) {
+        g_printerr("Error: --bench-encoders compares the h264 / h265 backends; set --codec to one of them\n"); return FALSE;
+    }
+    if (config.bench_quality && (!config.bench_seconds || !g_str_equal(source->name, "replay"))) {
+        g_printerr("Error: --bench-quality needs --bench-profile and --source=replay\n"); return FALSE;
+    }
+    return init_thread_placement();
+}
+
+// ===================== Sender API =====================
+// gpt_sender.h. gpt.cpp's main() is one client, bench/push_bench.cpp another.
+extern "C" int gpt_sender_init(int argc, char *argv[]) {
+    startup.start = g_get_monotonic_time();
+    gst_init(&argc, &argv);
+    startup.init = g_get_monotonic_time();
+    if (!parse_arguments(argc, argv)) return FALSE;
+    if (g_str_equal(config.source, "replay") && !load_replay_clip(config.input, g_str_equal(config.replay_load, "mmap")))
+        return FALSE;
+    app_frame_quark = g_quark_from_static_string("gpt-app-frame");
+
+    factory_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, gst_object_unref);
+    if (!config.encoder) choose_encoder_backend();
+    // The encoder benchmark builds its own pipelines
+    if (!config.bench_encoders && !preload_factories(pipeline_desc_from_config())) return FALSE;
+    startup.registry = g_get_monotonic_time();
+    if (config.dtls_prewarm && !config.bench_encoders && !prewarm_dtls_certificate())
+        g_printerr("No shared DTLS certificate; the first viewer will pay for generating one\n");
+    startup.dtls = g_get_monotonic_time();
+
+    loop = g_main_loop_new(NULL, FALSE);
+    ws_outbox = g_async_queue_new_full(g_free);
+    sessions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, peer_session_unref);
+    // One worker per live or pre-warmed session; keep a few idle threads around for the next joins.
+    session_pool = g_thread_pool_new(session_thread, NULL, config.max_viewers + config.pool_size, FALSE, NULL);
+    g_thread_pool_set_max_unused_threads(4);
+
+    if (config.bench_encoders) g_idle_add(on_bench_encoders, NULL);
+    else if (!build_and_start_pipeline()) return FALSE;
+
+    // Connect to signaling; benchmarks only need the pipeline
+    soup_session = soup_session_new();
+    if (!config.bench_startup && !config.bench_seconds && !config.bench_encoders) {
+        connect_signaling();
+        g_mutex_lock(&sessions_lock);
+        warm_pool_enabled = TRUE;
+        refill_warm_pool();
+        g_mutex_unlock(&sessions_lock);
+    }
+    return TRUE;
+}
+
+extern "C" void gpt_sender_run(void) { g_main_loop_run(loop); }
+
+extern "C" void gpt_sender_quit(void) { if (loop) g_main_loop_quit(loop); }
+
+extern "C" void gpt_sender_print_stats(void) {
+    print_join_histogram();
+    print_keyframe_stats();
+    print_threads_placed();
+    if (g_str_equal(config.source, "app")) print_app_stats();
+    if (config.skip_static) print_skip_stats();
+    if (config.multicast_group) print_multicast_stats();
+}
+
+extern "C" GptPushResult gpt_sender_push_frame(const GptFrame *frame) {
+    if (!frame) return GPT_PUSH_INVALID;
+    if (!config.source || !g_str_equal(config.source, "app")) return refuse_app_frame(frame, GPT_PUSH_NOT_RUNNING);
+    return push_app_frame(frame);
+}
+
+extern "C" void gpt_sender_set_flow_callback(void (*callback)(int ready, void *user_data), void *user_data) {
+    app_flow_data = user_data;
+    app_flow_callback = callback;
+}
+
+extern "C" void gpt_sender_shutdown(void) {
+    gboolean bench = config.bench_startup || config.bench_seconds || config.bench_encoders;
+    ws_stopping = TRUE;
+    if (ws_reconnect_id) g_source_remove(ws_reconnect_id);
+    g_mutex_lock(&sessions_lock);
+    warm_pool_enabled = FALSE;
+    g_mutex_unlock(&sessions_lock);
+    end_all_sessions();
+    g_thread_pool_free(session_pool, FALSE, TRUE);
+    g_hash_table_unref(sessions);
+    stop_and_destroy_pipeline();
+    if (ws_conn) { soup_websocket_connection_close(ws_conn, SOUP_WEBSOCKET_CLOSE_NORMAL, NULL); g_clear_object(&ws_conn); }
+    g_object_unref(soup_session);
+    g_async_queue_unref(ws_outbox);
+    g_main_loop_unref(loop);
+    loop = NULL;
+    g_hash_table_unref(factory_cache);
+    if (dtls_rotate_id) g_source_remove(dtls_rotate_id);
+    set_dtls_pem(NULL);
+
+    if (!bench) gpt_sender_print_stats();
+    if (bench_latency_ms) g_array_free(bench_latency_ms, TRUE);
+    if (bench_frame_bytes) g_array_free(bench_frame_bytes, TRUE);
+    if (bench_capture_ms) g_array_free(bench_capture_ms, TRUE);
+    g_free(my_id);
+    g_free(my_token);
+    g_free(config.codec); g_free(config.device); g_free(config.profile);
+    g_free(config.encoder); g_free(config.intra_refresh); g_free(config.codecs); g_free(config.server); g_free(config.room);
+    g_free(config.source); g_free(config.input); g_free(config.replay_load); g_free(config.app_format);
+    for (gchar *cpus : config.cpus) g_free(cpus);
+    g_free(config.multicast_group); g_free(config.multicast_iface); g_free(config.multicast_sdp);
+    free_replay_clip();
+    reset_skip_state(NULL);
+    if (codec_preferences) gst_caps_unref(codec_preferences);
+}
@@ -0,0 +1,66 @@
+// Streaming core of gpt as a library: the same sender (signaling, viewer
+// sessions, shared encoders), driven from the caller's process. With
+// --source=app the caller pushes its own frames instead of a camera feeding
+// them, and they are wrapped, not copied, on the way into the pipeline.
+//
+//   g++ -O2 -fPIC -shared -o libgptsender.so gpt_sender.cpp $(pkg-config ...) -lcrypto
+//   g++ -O2 -o gpt gpt.cpp -L. -lgptsender $(pkg-config --cflags --libs gstreamer-1.0)
+//
+// gpt.cpp is the CLI, a thin client of this API; linking gpt_sender.cpp into
+// it directly works the same. One sender per process. Options are the gpt
+// command line ones. index.cpp, the older one-viewer sender, keeps its own
+// pipeline and is not a client of this API.
+#ifndef GPT_SENDER_H
+#define GPT_SENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPT_PTS_NONE UINT64_MAX
+
+typedef enum {
+    GPT_PUSH_OK,                // queued for the encoders
+    GPT_PUSH_BUSY,              // the sender is backed up (or idle with no viewers): frame dropped
+    GPT_PUSH_NOT_RUNNING,       // no --source=app pipeline playing: frame dropped
+    GPT_PUSH_INVALID,           // layout does not fit --app-format / --width / --height, or overruns size
+} GptPushResult;
+
+// A caller-owned frame in --app-format at --width x --height. The sender reads
+// it in place until release(user_data), which runs exactly once per push,
+// whatever the result: right away, from the pushing thread, when the frame is
+// not taken, otherwise from a streaming thread once no element holds it.
+typedef struct {
+    const void *data;
+    size_t size;
+    int n_planes;               // 0 = GStreamer's default layout for the format
+    size_t offset[4];           // per plane, from data
+    int stride[4];
+    uint64_t pts;               // capture time in CLOCK_MONOTONIC ns, GPT_PTS_NONE = time of push
+    void (*release)(void *user_data);
+    void *user_data;
+} GptFrame;
+
+// Parses options, builds the pipeline and connects to signaling. 0 on failure.
+int gpt_sender_init(int argc, char *argv[]);
+// Runs the sender's main loop on the default GMainContext until gpt_sender_quit().
+void gpt_sender_run(void);
+// Any thread.
+void gpt_sender_quit(void);
+void gpt_sender_shutdown(void);
+void gpt_sender_print_stats(void);
+
+// Any thread; never blocks on the pipeline.
+GptPushResult gpt_sender_push_frame(const GptFrame *frame);
+// ready is 0 once the sender's queue is full (pushes return GPT_PUSH_BUSY) and
+// 1 when it wants frames again. Called from streaming threads.
+void gpt_sender_set_flow_callback(void (*callback)(int ready, void *user_data), void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPT_SENDER_H
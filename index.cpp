@@ -17,6 +17,7 @@ struct Config {
     gint width;
     gint height;
     gchar *device;
+    gint ice_grace_ms;
 };
 
 // Global variables
@@ -29,17 +30,34 @@ static gchar *my_id = NULL;
 static struct Config config;
 static gboolean offer_in_progress = FALSE;
 
+// Negotiation deadline: an offer without a working answer is retried, so a
+// lost answer can no longer leave offer_in_progress stuck
+static guint offer_timeout_id = 0;
+static guint offer_retries = 0;
+
+// ICE recovery state (only touched on the main loop)
+static guint ice_timer_id = 0;
+static gint64 ice_disconnected_at = 0;
+static gboolean ice_restarting = FALSE;
+
 // Signaling server details
 static const gchar *server_url = "ws://192.168.25.69:8080";
 
+// How long an ICE restart may take before the peer is dropped
+static const guint ice_restart_timeout_ms = 10000;
+
+// How long an offer may wait for its answer, and how often it is retried
+static const guint offer_timeout_ms = 10000;
+static const guint offer_max_retries = 2;
+
 // Function declarations
 static void on_offer_created(GstPromise *promise, gpointer user_data);
-static void force_renegotiate();
+static void on_description_set(GstPromise *promise, gpointer user_data);
+static void force_renegotiate(gboolean ice_restart);
 static void on_negotiation_needed(GstElement *element, gpointer user_data);
 static void on_ice_candidate(GstElement *webrtc, guint mlineindex, gchar *candidate, gpointer user_data);
 static void send_ice_candidate_message(guint mlineindex, const gchar *candidate);
 static void on_incoming_stream(GstElement *webrtc, GstPad *pad, gpointer user_data);
-static void reset_webrtc_element();
 // Send JSON message via WebSocket
 static void send_json_message(JsonObject *msg) {
     if (!ws_conn) {
@@ -68,7 +86,19 @@ static void reset_peer_state() {
         peer_id = NULL;
     }
     
+    if (offer_timeout_id) {
+        g_source_remove(offer_timeout_id);
+        offer_timeout_id = 0;
+    }
     offer_in_progress = FALSE;
+
+    // A pending grace or restart timer would otherwise offer to nobody
+    if (ice_timer_id) {
+        g_source_remove(ice_timer_id);
+        ice_timer_id = 0;
+    }
+    ice_disconnected_at = 0;
+    ice_restarting = FALSE;
 }
 
 // Handle incoming WebSocket messages
@@ -121,13 +151,19 @@ static void on_message(SoupWebsocketConnection *conn, SoupWebsocketDataType type
         GstWebRTCSessionDescription *answer = gst_webrtc_session_description_new(
             GST_WEBRTC_SDP_TYPE_ANSWER, sdp);
         
-        GstPromise *promise = gst_promise_new();
+        GstPromise *promise = gst_promise_new_with_change_func(on_description_set,
+                                                               (gpointer)"set-remote-description", NULL);
         g_signal_emit_by_name(webrtc, "set-remote-description", answer, promise);
-        gst_promise_interrupt(promise);
         gst_promise_unref(promise);
         
         gst_webrtc_session_description_free(answer);
         offer_in_progress = FALSE;
+
+        // The answer arrived; failures are reported through on_description_set
+        if (offer_timeout_id) {
+            g_source_remove(offer_timeout_id);
+            offer_timeout_id = 0;
+        }
         
     } else if (g_strcmp0(msg_type, "ice-candidate") == 0) {
         if (!json_object_has_member(object, "candidate")) {
@@ -179,9 +215,18 @@ static void on_message(SoupWebsocketConnection *conn, SoupWebsocketDataType type
     
     // IMPORTANT: Always reset these flags
     offer_in_progress = FALSE;
+    offer_retries = 0;
+
+    // A fresh session replaces any pending ICE recovery
+    if (ice_timer_id) {
+        g_source_remove(ice_timer_id);
+        ice_timer_id = 0;
+    }
+    ice_disconnected_at = 0;
+    ice_restarting = FALSE;
     
     // Create new offer
-    force_renegotiate();
+    force_renegotiate(FALSE);
         
     } else if (g_strcmp0(msg_type, "peer-left") == 0) {
         const gchar *left_id = NULL;
@@ -240,8 +285,71 @@ static void on_ice_candidate(GstElement *webrtc, guint mlineindex,
     send_ice_candidate_message(mlineindex, candidate);
 }
 
-// Force renegotiation
-static void force_renegotiate() {
+// Retry the offer after a timeout or a failed description, or give up on the peer
+static void retry_offer_or_give_up() {
+    offer_in_progress = FALSE;
+
+    if (!peer_id) {
+        return;
+    }
+
+    if (offer_retries >= offer_max_retries) {
+        g_printerr("✗ Negotiation failed after %u retries\n", offer_retries);
+        offer_retries = 0;
+        reset_peer_state();
+        return;
+    }
+
+    offer_retries++;
+    g_print("Retrying offer (%u/%u)\n", offer_retries, offer_max_retries);
+    force_renegotiate(ice_restarting);
+}
+
+// No answer arrived in time
+static gboolean on_offer_timeout(gpointer user_data) {
+    offer_timeout_id = 0;
+    g_printerr("No answer within %u ms\n", offer_timeout_ms);
+    retry_offer_or_give_up();
+    return G_SOURCE_REMOVE;
+}
+
+// Main-loop side of a failed description
+static gboolean on_negotiation_error(gpointer user_data) {
+    if (offer_timeout_id) {
+        g_source_remove(offer_timeout_id);
+        offer_timeout_id = 0;
+    }
+    retry_offer_or_give_up();
+    return G_SOURCE_REMOVE;
+}
+
+// Report the outcome of set-local-description / set-remote-description.
+// Called from a webrtcbin thread.
+static void on_description_set(GstPromise *promise, gpointer user_data) {
+    const gchar *what = (const gchar *)user_data;
+
+    if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+        g_printerr("✗ %s was interrupted\n", what);
+        g_idle_add(on_negotiation_error, NULL);
+        return;
+    }
+
+    const GstStructure *reply = gst_promise_get_reply(promise);
+    if (reply && gst_structure_has_field(reply, "error")) {
+        GError *error = NULL;
+        gst_structure_get(reply, "error", G_TYPE_ERROR, &error, NULL);
+        g_printerr("✗ %s failed: %s\n", what, error ? error->message : "unknown error");
+        g_clear_error(&error);
+        g_idle_add(on_negotiation_error, NULL);
+        return;
+    }
+
+    g_print("✓ %s done\n", what);
+}
+
+// Force renegotiation; with ice_restart the existing webrtcbin gathers new
+// ICE credentials while DTLS and the encoder stay as they are
+static void force_renegotiate(gboolean ice_restart) {
     if (!webrtc) {
         g_printerr("Cannot renegotiate: webrtc element not available\n");
         return;
@@ -252,32 +360,50 @@ static void force_renegotiate() {
         return;
     }
     
-    g_print("Creating new offer for reconnection\n");
+    g_print("Creating new offer for reconnection%s\n", ice_restart ? " (ice-restart)" : "");
     offer_in_progress = TRUE;
+
+    if (offer_timeout_id) {
+        g_source_remove(offer_timeout_id);
+    }
+    offer_timeout_id = g_timeout_add(offer_timeout_ms, on_offer_timeout, NULL);
     
+    GstStructure *options = NULL;
+    if (ice_restart) {
+        options = gst_structure_new("offer-options", "ice-restart", G_TYPE_BOOLEAN, TRUE, NULL);
+    }
+
     GstPromise *promise = gst_promise_new_with_change_func(on_offer_created, NULL, NULL);
-    g_signal_emit_by_name(webrtc, "create-offer", NULL, promise);
+    g_signal_emit_by_name(webrtc, "create-offer", options, promise);
+
+    if (options) {
+        gst_structure_free(options);
+    }
 }
 
 // Handle offer creation
 static void on_offer_created(GstPromise *promise, gpointer user_data) {
     GstWebRTCSessionDescription *offer = NULL;
-    const GstStructure *reply = gst_promise_get_reply(promise);
-    
-    gst_structure_get(reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+    const GstStructure *reply = NULL;
+
+    if (gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED) {
+        reply = gst_promise_get_reply(promise);
+    }
+    if (reply) {
+        gst_structure_get(reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+    }
     gst_promise_unref(promise);
 
     if (!offer) {
         g_printerr("Failed to create offer\n");
-        offer_in_progress = FALSE;
+        g_idle_add(on_negotiation_error, NULL);
         return;
     }
 
     g_print("Offer created, setting local description\n");
     
-    promise = gst_promise_new();
+    promise = gst_promise_new_with_change_func(on_description_set, (gpointer)"set-local-description", NULL);
     g_signal_emit_by_name(webrtc, "set-local-description", offer, promise);
-    gst_promise_interrupt(promise);
     gst_promise_unref(promise);
 
     // Send offer via signaling
@@ -286,6 +412,9 @@ static void on_offer_created(GstPromise *promise, gpointer user_data) {
     JsonObject *msg = json_object_new();
     json_object_set_string_member(msg, "type", "offer");
     json_object_set_string_member(msg, "sdp", sdp_text);
+    if (peer_id) {
+        json_object_set_string_member(msg, "to", peer_id);
+    }
 
     send_json_message(msg);
     
@@ -329,8 +458,91 @@ static void on_ice_gathering_state_notify(GstElement *webrtc, GParamSpec *pspec,
     g_print("ICE gathering state: %s\n", state_str);
 }
 
+// ICE restart deadline expired: give up on this peer
+static gboolean on_ice_restart_expired(gpointer user_data) {
+    ice_timer_id = 0;
+    g_printerr("✗ ICE restart did not recover within %u ms\n", ice_restart_timeout_ms);
+    ice_restarting = FALSE;
+    ice_disconnected_at = 0;
+    reset_peer_state();
+    return G_SOURCE_REMOVE;
+}
+
+// Send an ice-restart offer on the existing webrtcbin
+static void start_ice_restart() {
+    g_print("Restarting ICE\n");
+    ice_restarting = TRUE;
+
+    // A stale offer must not block the restart
+    offer_in_progress = FALSE;
+    force_renegotiate(TRUE);
+
+    if (ice_timer_id) {
+        g_source_remove(ice_timer_id);
+    }
+    ice_timer_id = g_timeout_add(ice_restart_timeout_ms, on_ice_restart_expired, NULL);
+}
+
+// Grace period after DISCONNECTED expired without recovery
+static gboolean on_ice_grace_expired(gpointer user_data) {
+    ice_timer_id = 0;
+    g_print("Still disconnected after %d ms\n", config.ice_grace_ms);
+    start_ice_restart();
+    return G_SOURCE_REMOVE;
+}
+
+// Drive ICE recovery from the main loop. A DISCONNECTED peer gets a grace
+// period to come back by itself, then an ICE restart; only a FAILED restart
+// resets the peer.
+static gboolean handle_ice_recovery(gpointer user_data) {
+    GstWebRTCICEConnectionState state = (GstWebRTCICEConnectionState)GPOINTER_TO_INT(user_data);
+    gint64 now = g_get_monotonic_time();
+
+    switch (state) {
+        case GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED:
+        case GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED:
+            offer_retries = 0;
+            if (ice_disconnected_at) {
+                g_print("✓ ICE recovered in %.1f ms (%s)\n", (now - ice_disconnected_at) / 1000.0,
+                        ice_restarting ? "ice-restart" : "no restart");
+                if (ice_timer_id) {
+                    g_source_remove(ice_timer_id);
+                    ice_timer_id = 0;
+                }
+                ice_disconnected_at = 0;
+                ice_restarting = FALSE;
+            }
+            break;
+        case GST_WEBRTC_ICE_CONNECTION_STATE_DISCONNECTED:
+            if (!ice_disconnected_at && peer_id) {
+                ice_disconnected_at = now;
+                ice_timer_id = g_timeout_add(config.ice_grace_ms, on_ice_grace_expired, NULL);
+            }
+            break;
+        case GST_WEBRTC_ICE_CONNECTION_STATE_FAILED:
+            if (ice_restarting || !peer_id) {
+                // reset_peer_state() also cancels the ICE timer and restart state
+                if (ice_restarting) g_printerr("✗ ICE restart failed\n");
+                else g_printerr("✗ ICE failed with no peer, resetting\n");
+                reset_peer_state();
+            } else {
+                if (!ice_disconnected_at) {
+                    ice_disconnected_at = now;
+                }
+                if (ice_timer_id) {
+                    g_source_remove(ice_timer_id);
+                    ice_timer_id = 0;
+                }
+                start_ice_restart();
+            }
+            break;
+        default:
+            break;
+    }
+    return G_SOURCE_REMOVE;
+}
+
 // Handle ICE connection state changes
-// Modify the on_ice_connection_state_notify function
 static void on_ice_connection_state_notify(GstElement *webrtc, GParamSpec *pspec, gpointer user_data) {
     GstWebRTCICEConnectionState ice_conn_state;
     g_object_get(webrtc, "ice-connection-state", &ice_conn_state, NULL);
@@ -353,19 +565,10 @@ static void on_ice_connection_state_notify(GstElement *webrtc, GParamSpec *pspec
         case GST_WEBRTC_ICE_CONNECTION_STATE_FAILED:
             state_str = "failed";
             g_printerr("✗ ICE connection failed\n");
-            reset_peer_state();
             break;
         case GST_WEBRTC_ICE_CONNECTION_STATE_DISCONNECTED:
             state_str = "disconnected";
-            g_print("Peer disconnected, ready for new connection\n");
-            reset_peer_state();
-            // ADD THIS: Create new webrtcbin to reset state completely
-                // IMPORTANT: Reset the webrtcbin to clear transceivers
-            if (webrtc) {
-                g_print("Resetting webrtcbin state\n");
-                gst_element_set_state(webrtc, GST_STATE_READY);
-                gst_element_set_state(webrtc, GST_STATE_PLAYING);
-            }
+            g_print("Peer disconnected, waiting %d ms before ICE restart\n", config.ice_grace_ms);
             break;
         case GST_WEBRTC_ICE_CONNECTION_STATE_CLOSED:
             state_str = "closed";
@@ -376,72 +579,11 @@ static void on_ice_connection_state_notify(GstElement *webrtc, GParamSpec *pspec
     }
     
     g_print("ICE connection state: %s\n", state_str);
+
+    // Called from a webrtcbin thread; timers live on the main loop
+    g_idle_add(handle_ice_recovery, GINT_TO_POINTER(ice_conn_state));
 }
-// Add this new function to reset the webrtcbin element
-static void reset_webrtc_element() {
-    if (!webrtc || !pipeline) return;
-    
-    g_print("Resetting WebRTC element for new connection\n");
-    
-    // Disconnect all signals
-    g_signal_handlers_disconnect_by_data(webrtc, NULL);
-    
-    // Set to NULL state
-    gst_element_set_state(webrtc, GST_STATE_NULL);
-    
-    // Remove from pipeline
-    gst_bin_remove(GST_BIN(pipeline), webrtc);
-    gst_object_unref(webrtc);
-    
-    // Create new webrtcbin
-    webrtc = gst_element_factory_make("webrtcbin", "webrtcbin");
-    g_object_set(webrtc, 
-                 "bundle-policy", 0,  // max-bundle
-                 "stun-server", "stun://stun.l.google.com:19302",
-                 NULL);
-    
-    // Add back to pipeline
-    gst_bin_add(GST_BIN(pipeline), webrtc);
-    
-    // Reconnect signals
-    g_signal_connect(webrtc, "on-negotiation-needed", 
-                     G_CALLBACK(on_negotiation_needed), NULL);
-    g_signal_connect(webrtc, "on-ice-candidate", 
-                     G_CALLBACK(on_ice_candidate), NULL);
-    g_signal_connect(webrtc, "pad-added", 
-                     G_CALLBACK(on_incoming_stream), NULL);
-    g_signal_connect(webrtc, "notify::ice-gathering-state",
-                     G_CALLBACK(on_ice_gathering_state_notify), NULL);
-    g_signal_connect(webrtc, "notify::ice-connection-state",
-                     G_CALLBACK(on_ice_connection_state_notify), NULL);
-    
-    // Relink video and audio pads
-    GstElement *video_pay = gst_bin_get_by_name(GST_BIN(pipeline), "videopay");
-    GstElement *audio_pay = gst_bin_get_by_name(GST_BIN(pipeline), "audiopay");
-    
-    if (video_pay) {
-        GstPad *video_src = gst_element_get_static_pad(video_pay, "src");
-        GstPad *video_sink = gst_element_get_request_pad(webrtc, "sink_0");
-        gst_pad_link(video_src, video_sink);
-        gst_object_unref(video_src);
-        gst_object_unref(video_sink);
-        gst_object_unref(video_pay);
-    }
-    
-    if (audio_pay) {
-        GstPad *audio_src = gst_element_get_static_pad(audio_pay, "src");
-        GstPad *audio_sink = gst_element_get_request_pad(webrtc, "sink_1");
-        gst_pad_link(audio_src, audio_sink);
-        gst_object_unref(audio_src);
-        gst_object_unref(audio_sink);
-        gst_object_unref(audio_pay);
-    }
-    
-    // Sync state with pipeline
-    gst_element_sync_state_with_parent(webrtc);
-    
-    g_print("✓ WebRTC element reset complete\n");
-}
+
 // WebSocket connection established
 static void on_websocket_connected(GObject *session, GAsyncResult *res, gpointer user_data) {
     GError *error = NULL;
@@ -507,6 +649,7 @@ static void print_usage(const char *prog_name) {
     g_print("  --width=WIDTH       Video width (default: 1280)\n");
     g_print("  --height=HEIGHT     Video height (default: 720)\n");
     g_print("  --device=PATH       Camera device path (default: /dev/video0)\n");
+    g_print("  --ice-grace=MS      Wait before ICE restart on disconnect (default: 3000)\n");
     g_print("  --help              Show this help message\n");
     g_print("\nExamples:\n");
     g_print("  %s --codec=h264 --bitrate=5000 --fps=30\n", prog_name);
@@ -521,6 +664,7 @@ static gboolean parse_arguments(int argc, char *argv[]) {
     config.width = 1280;
     config.height = 720;
     config.device = g_strdup("/dev/video0");
+    config.ice_grace_ms = 3000;
 
     struct option long_options[] = {
         {"codec",    required_argument, 0, 'c'},
@@ -529,6 +673,7 @@ static gboolean parse_arguments(int argc, char *argv[]) {
         {"width",    required_argument, 0, 'w'},
         {"height",   required_argument, 0, 'H'},
         {"device",   required_argument, 0, 'd'},
+        {"ice-grace", required_argument, 0, 'g'},
         {"help",     no_argument,       0, '?'},
         {0, 0, 0, 0}
     };
@@ -536,7 +681,7 @@ static gboolean parse_arguments(int argc, char *argv[]) {
     int option_index = 0;
     int c;
 
-    while ((c = getopt_long(argc, argv, "c:b:f:w:H:d:?", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "c:b:f:w:H:d:g:?", long_options, &option_index)) != -1) {
         switch (c) {
             case 'c':
                 g_free(config.codec);
@@ -578,6 +723,13 @@ static gboolean parse_arguments(int argc, char *argv[]) {
                 g_free(config.device);
                 config.device = g_strdup(optarg);
                 break;
+            case 'g':
+                config.ice_grace_ms = atoi(optarg);
+                if (config.ice_grace_ms < 0) {
+                    g_printerr("Error: ice-grace must not be negative\n");
+                    return FALSE;
+                }
+                break;
             case '?':
             default:
                 print_usage(argv[0]);
@@ -607,8 +759,8 @@ static std::string build_pipeline_string() {
         payload = 96;
     }
 
-    char pipeline_buf[2048];
-    snprintf(pipeline_buf, sizeof(pipeline_buf),
+    // Heap-allocated so a long device path cannot truncate the description
+    gchar *pipeline_buf = g_strdup_printf(
         "webrtcbin name=webrtcbin bundle-policy=max-bundle latency=100 "
         "stun-server=stun://stun.l.google.com:19302 "
         "v4l2src device=%s ! "
@@ -643,7 +795,9 @@ static std::string build_pipeline_string() {
     g_print("Device:     %s\n", config.device);
     g_print("====================\n\n");
 
-    return std::string(pipeline_buf);
+    std::string pipeline_str(pipeline_buf);
+    g_free(pipeline_buf);
+    return pipeline_str;
 }
 
 int main(int argc, char *argv[]) {
@@ -2,85 +2,116 @@ const express = require('express');
 const http = require('http');
 const WebSocket = require('ws');
 const path = require('path');
+const crypto = require('crypto');
 
 const app = express();
 const server = http.createServer(app);
 const wss = new WebSocket.Server({ server });
 
+// Per-message logging costs more than the relaying itself during join storms
+const verbose = !!process.env.SIGNAL_VERBOSE;
+
 // Serve static files (HTML client)
 app.use(express.static('public'));
 
-// Store connected clients
+// Store connected clients: id -> { ws, room, role }
 const clients = new Map();
+// Room name -> { senders: Set<id>, viewers: Set<id> }
+const rooms = new Map();
+
+// Id -> { token, timer }: the secret sent with 'registered'. It outlives the
+// socket by RESUME_GRACE_MS so a reconnecting client can reclaim its id; the
+// room only hears 'peer-left' once that grace is over without a reclaim, so
+// peer connections with live media ride out a signaling blip.
+const resumeTokens = new Map();
+const RESUME_GRACE_MS = 60000;
+
+// Relay counters, read by bench/signaling_load.js
+const stats = { in: 0, out: 0, bytesOut: 0 };
+
+app.get('/stats', (req, res) => {
+  res.json({ clients: clients.size, rooms: rooms.size, ...stats, cpu: process.cpuUsage() });
+});
+
+wss.on('connection', (ws, req) => {
+  // A reconnecting client may ask for its previous id (ws://host:port/?id=...&token=...),
+  // so peers that still hold a connection to it can keep addressing it. Only
+  // the token issued with that id reclaims it; anyone else gets a fresh one.
+  const params = new URL(req.url, 'http://localhost').searchParams;
+  const requested = params.get('id');
+  const held = requested && resumeTokens.get(requested);
+  const clientId = held && held.token === params.get('token') ? requested : generateId();
+  const stale = clients.get(clientId);
+  if (stale) {
+    console.log(`Client ${clientId} re-registered, dropping stale socket`);
+    leaveRoom(clientId, stale);
+    stale.ws.terminate();
+  }
+  // Clients that never send 'join' are viewers of the default room
+  const client = { ws, room: null, role: null };
+  clients.set(clientId, client);
+  const token = crypto.randomBytes(16).toString('hex');
+  if (held && clientId === requested) clearTimeout(held.timer);
+  resumeTokens.set(clientId, { token, timer: null });
+  joinRoom(clientId, client, 'default', 'viewer');
 
-wss.on('connection', (ws) => {
-  const clientId = generateId();
-  clients.set(clientId, ws);
-  
   console.log(`Client connected: ${clientId}`);
   console.log(`Total clients: ${clients.size}`);
-  
+
   // Send client their ID
-  ws.send(JSON.stringify({
+  send(client, JSON.stringify({
     type: 'registered',
-    id: clientId
+    id: clientId,
+    token
   }));
 
   ws.on('message', (message) => {
+    stats.in++;
     try {
       const data = JSON.parse(message);
-      console.log(`Received from ${clientId}:`, data.type);
-      
+      if (verbose) console.log(`Received from ${clientId}:`, data.type);
+
       // Handle different message types
       switch(data.type) {
-        // Ask other peers (e.g., the sender) to create a fresh offer
+        case 'join': {
+          const room = typeof data.room === 'string' && data.room ? data.room : 'default';
+          const role = data.clientType === 'sender' ? 'sender' : 'viewer';
+          leaveRoom(clientId, client);
+          joinRoom(clientId, client, room, role);
+          console.log(`Client ${clientId} joined ${room} as ${role}`);
+          break;
+        }
+
+        // Ask the room's sender(s) to create a fresh offer
         case 'request-offer':
-          // broadcast(clientId, data);
-           broadcast(clientId, { type: 'request-offer', from: clientId });
+          relay(clientId, client, data.to, 'senders', { type: 'request-offer', from: clientId });
           break;
 
         case 'offer':
-          // Forward offer to all other clients (broadcast)
-          broadcast(clientId, data);
+          // Offers go to the viewer that asked for them; untargeted ones to the room's viewers
+          relay(clientId, client, data.to, 'viewers', { type: 'offer', from: clientId, sdp: data.sdp });
           break;
-          
+
         case 'answer':
-          // Forward answer to specific peer
-          if (data.to && clients.has(data.to)) {
-            const targetWs = clients.get(data.to);
-            targetWs.send(JSON.stringify({
-              type: 'answer',
-              from: clientId,
-              sdp: data.sdp
-            }));
-          }
+          relay(clientId, client, data.to, null, { type: 'answer', from: clientId, sdp: data.sdp });
           break;
-          
+
         case 'ice-candidate':
-          // Forward ICE candidate
-          if (data.to) {
-            if (clients.has(data.to)) {
-              const targetWs = clients.get(data.to);
-              targetWs.send(JSON.stringify({
-                type: 'ice-candidate',
-                from: clientId,
-                candidate: data.candidate
-              }));
-            }
-          } else {
-            // Broadcast to all if no specific target
-            broadcast(clientId, {
-              type: 'ice-candidate',
-              from: clientId,
-              candidate: data.candidate
-            });
-          }
+          // Untargeted candidates only reach the other side of the room
+          relay(clientId, client, data.to, peersOf(client),
+            { type: 'ice-candidate', from: clientId, candidate: data.candidate });
+          break;
+
+        case 'control':
+          // Viewer <-> sender control relayed over signaling; the data channel
+          // carries the same messages without this hop
+          relay(clientId, client, data.to, null, { ...data, from: clientId });
           break;
-          
+
         case 'ping':
-          ws.send(JSON.stringify({ type: 'pong' }));
+          send(client, JSON.stringify({ type: 'pong' }));
           break;
-          
+
         default:
           console.log('Unknown message type:', data.type);
       }
@@ -91,9 +122,18 @@ wss.on('connection', (ws) => {
 
   ws.on('close', () => {
     console.log(`Client disconnected: ${clientId}`);
+    // A re-registered client already owns this id on a newer socket
+    if (clients.get(clientId) !== client) return;
     clients.delete(clientId);
-    // Let others know this peer left
-    broadcast(clientId, { type: 'peer-left', id: clientId });
+    leaveRoom(clientId, client);
+    const entry = resumeTokens.get(clientId);
+    if (entry) entry.timer = setTimeout(() => {
+      resumeTokens.delete(clientId);
+      // Only the other side of the room cares that this peer left
+      const members = rooms.get(client.room);
+      const message = JSON.stringify({ type: 'peer-left', id: clientId, from: clientId });
+      if (members) members[peersOf(client)].forEach((id) => send(clients.get(id), message));
+    }, RESUME_GRACE_MS);
     console.log(`Total clients: ${clients.size}`);
   });
 
@@ -102,20 +142,50 @@ wss.on('connection', (ws) => {
   });
 });
 
-// Broadcast message to all clients except sender
-function broadcast(senderId, data) {
-  const message = JSON.stringify({
-    ...data,
-    from: senderId
-  });
-  
-  clients.forEach((client, id) => {
-    if (id !== senderId && client.readyState === WebSocket.OPEN) {
-      client.send(message);
-    }
+function joinRoom(id, client, room, role) {
+  if (!rooms.has(room)) rooms.set(room, { senders: new Set(), viewers: new Set() });
+  rooms.get(room)[role === 'sender' ? 'senders' : 'viewers'].add(id);
+  client.room = room;
+  client.role = role;
+}
+
+function leaveRoom(id, client) {
+  const members = rooms.get(client.room);
+  if (!members) return;
+  members.senders.delete(id);
+  members.viewers.delete(id);
+  if (members.senders.size === 0 && members.viewers.size === 0) rooms.delete(client.room);
+}
+
+// The half of a room a client talks to
+function peersOf(client) {
+  return client.role === 'sender' ? 'viewers' : 'senders';
+}
+
+// Serialize once, then deliver to the addressed peer if it shares the
+// sender's room, or, when untargeted, to one half of that room
+// ('senders' / 'viewers'; null drops it).
+function relay(senderId, client, to, group, data) {
+  const message = JSON.stringify(data);
+  if (to) {
+    const target = clients.get(to);
+    if (target && target.room === client.room) send(target, message);
+    return;
+  }
+  const members = group && rooms.get(client.room);
+  if (!members) return;
+  members[group].forEach((id) => {
+    if (id !== senderId) send(clients.get(id), message);
   });
 }
 
+function send(client, message) {
+  if (!client || client.ws.readyState !== WebSocket.OPEN) return;
+  client.ws.send(message);
+  stats.out++;
+  stats.bytesOut += message.length;
+}
+
 function generateId() {
   return Math.random().toString(36).substr(2, 9);
 }